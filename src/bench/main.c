@@ -0,0 +1,540 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <clog/clog.h>
+#include <clog/console.h>
+#include <imprint/linear_allocator.h>
+#include <rectify/rectify.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+clog_config g_clog;
+char g_clog_temp_str[CLOG_TEMP_STR_SIZE];
+
+typedef uint64_t BenchNanoseconds;
+
+static BenchNanoseconds benchNow(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (BenchNanoseconds) ((double) counter.QuadPart * 1e9 / (double) frequency.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (BenchNanoseconds) now.tv_sec * 1000000000u + (BenchNanoseconds) now.tv_nsec;
+#endif
+}
+
+typedef struct BenchScenario {
+    size_t participantCount;
+    size_t maxTicksFromAuthoritative;
+    size_t stateOctetSize;
+    unsigned mispredictionPercent;
+    size_t backlogTicks; // authoritative steps are held back and delivered in one burst every this many frames
+    size_t touchedOctetSize; // octets written by each tick, zero writes the whole state
+    bool useStateArenas; // keeps the states in the Rectify state arenas
+    size_t instanceCount; // independent Rectify instances that are all updated every frame
+    size_t workerThreadCount; // updates the instances with rectifyUpdateMany() if not zero
+    size_t frameCount;
+} BenchScenario;
+
+typedef struct BenchResult {
+    double nanosecondsPerUpdate;
+    BenchNanoseconds worstUpdateNanoseconds;
+    double resimulatedTicksPerSecond;
+    size_t resimulatedTicks;
+    size_t authoritativeTicks;
+    size_t copyCount;
+    size_t allocatedOctetCount;
+} BenchResult;
+
+/// Synthetic VM: a byte array where every tick writes the touched octets, so the cost scales with the touched size
+typedef struct BenchVm {
+    uint8_t* state;
+    size_t octetSize;
+    size_t touchedOctetSize;
+    RectifyStateArena* arena; // the state is kept in the arena, which detects the written pages by itself
+} BenchVm;
+
+typedef struct BenchCallback {
+    BenchVm authoritative;
+    BenchVm predicted;
+    Rectify* rectify;
+    bool useStateArenas;
+    size_t authoritativeTickCount;
+    size_t predictionTickCount;
+    size_t copyCount;
+} BenchCallback;
+
+typedef struct BenchParticipantInput {
+    int32_t horizontalAxis;
+    int32_t verticalAxis;
+} BenchParticipantInput;
+
+static void benchVmTick(BenchVm* self, const TransmuteInput* input)
+{
+    uint32_t mix = 0x9e3779b9u;
+    for (size_t i = 0; i < input->participantCount; ++i) {
+        const TransmuteParticipantInput* participantInput = &input->participantInputs[i];
+        if (participantInput->octetSize == sizeof(BenchParticipantInput)) {
+            const BenchParticipantInput* benchInput = (const BenchParticipantInput*) participantInput->input;
+            mix ^= (uint32_t) benchInput->horizontalAxis * 31u + (uint32_t) benchInput->verticalAxis;
+        }
+        mix = mix * 16777619u + participantInput->participantId;
+    }
+
+    size_t offset = 0;
+    size_t octetCount = self->octetSize;
+    if (self->touchedOctetSize > 0 && self->touchedOctetSize < self->octetSize) {
+        octetCount = self->touchedOctetSize;
+        offset = (mix % (self->octetSize / octetCount)) * octetCount;
+    }
+
+    if (self->arena != 0) {
+        self->state = self->arena->octets;
+    }
+    uint8_t* touched = self->state + offset;
+    for (size_t i = 0; i < octetCount; ++i) {
+        touched[i] = (uint8_t) (touched[i] + (uint8_t) (mix >> (i & 7u)));
+    }
+}
+
+static void benchVmUseArena(BenchVm* self, RectifyStateArena* arena)
+{
+    self->arena = arena;
+    self->state = arena->octets;
+}
+
+static void benchAuthoritativeDeserialize(void* _self, const TransmuteState* state, StepId stepId)
+{
+    BenchCallback* self = (BenchCallback*) _self;
+    (void) stepId;
+    if (self->useStateArenas) {
+        // The arenas are created by rectifyInit(), just before the first deserialize
+        benchVmUseArena(&self->authoritative, rectifyAuthoritativeStateArena(self->rectify));
+        benchVmUseArena(&self->predicted, rectifyPredictedStateArena(self->rectify));
+        memcpy(self->authoritative.state, state->state, state->octetSize);
+        return;
+    }
+    memcpy(self->authoritative.state, state->state, state->octetSize);
+}
+
+static void benchAuthoritativeTick(void* _self, const TransmuteInput* input, StepId stepId)
+{
+    BenchCallback* self = (BenchCallback*) _self;
+    (void) stepId;
+    self->authoritativeTickCount++;
+    benchVmTick(&self->authoritative, input);
+}
+
+static void benchCopyAuthoritativeToPrediction(void* _self, StepId stepId)
+{
+    BenchCallback* self = (BenchCallback*) _self;
+    (void) stepId;
+    self->copyCount++;
+    memcpy(self->predicted.state, self->authoritative.state, self->authoritative.octetSize);
+}
+
+static void benchPredictionTick(void* _self, const TransmuteInput* input, StepId stepId)
+{
+    BenchCallback* self = (BenchCallback*) _self;
+    (void) stepId;
+    self->predictionTickCount++;
+    benchVmTick(&self->predicted, input);
+}
+
+/// Allocator that keeps track of how many octets Rectify (and Seer and Assent) allocated
+typedef struct BenchAllocator {
+    ImprintLinearAllocator linear;
+    uint8_t* memory;
+} BenchAllocator;
+
+static void benchAllocatorInit(BenchAllocator* self, size_t octetSize)
+{
+    self->memory = malloc(octetSize);
+    imprintLinearAllocatorInit(&self->linear, self->memory, octetSize, "rectify_bench");
+}
+
+static size_t benchAllocatorAllocatedOctetCount(const BenchAllocator* self)
+{
+    return (size_t) (self->linear.next - self->linear.memory);
+}
+
+static void benchAllocatorDestroy(BenchAllocator* self)
+{
+    free(self->memory);
+}
+
+/// Small deterministic pseudo random generator, so runs are comparable between versions
+static uint32_t benchRandom(uint32_t* seed)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed >> 8;
+}
+
+static void benchFillInput(TransmuteInput* input, TransmuteParticipantInput* participantInputs,
+                           BenchParticipantInput* payloads, size_t participantCount, bool isAuthoritative,
+                           bool mispredict)
+{
+    for (size_t i = 0; i < participantCount; ++i) {
+        TransmuteParticipantInput* participantInput = &participantInputs[i];
+        participantInput->participantId = (uint8_t) (i + 1);
+        participantInput->localPartyId = 0;
+        bool isLocal = i == 0;
+        if (isLocal || (isAuthoritative && mispredict)) {
+            payloads[i].horizontalAxis = (isAuthoritative && mispredict) ? -1 : 1;
+            payloads[i].verticalAxis = 0;
+            participantInput->inputType = TransmuteParticipantInputTypeNormal;
+            participantInput->input = &payloads[i];
+            participantInput->octetSize = sizeof(BenchParticipantInput);
+        } else {
+            participantInput->inputType = TransmuteParticipantInputTypeNoInputInTime;
+            participantInput->input = 0;
+            participantInput->octetSize = 0;
+        }
+    }
+    input->participantInputs = participantInputs;
+    input->participantCount = isAuthoritative ? participantCount : 1;
+}
+
+/// One Rectify with its own VMs, inputs and allocator
+typedef struct BenchInstance {
+    BenchAllocator allocator;
+    Rectify* rectify;
+    BenchCallback callback;
+    RectifyCallbackObjectVtbl vtbl;
+    uint8_t* initialOctets;
+    uint8_t* ownedAuthoritativeOctets;
+    uint8_t* ownedPredictedOctets;
+    TransmuteParticipantInput* participantInputs;
+    BenchParticipantInput* payloads;
+    TransmuteInput input;
+    size_t authoritativeLag;
+    StepId firstStepId;
+    StepId nextAuthoritativeStepId;
+    uint32_t seed;
+    size_t allocatedOctetCount;
+} BenchInstance;
+
+static void benchInstanceInit(BenchInstance* self, const BenchScenario* scenario, uint32_t seed)
+{
+    benchAllocatorInit(&self->allocator, 64 * 1024 * 1024 + 8 * scenario->stateOctetSize);
+
+    self->rectify = malloc(sizeof(Rectify));
+
+    BenchCallback* callback = &self->callback;
+    memset(callback, 0, sizeof(*callback));
+    callback->rectify = self->rectify;
+    callback->useStateArenas = scenario->useStateArenas;
+    self->initialOctets = calloc(1, scenario->stateOctetSize);
+    callback->authoritative.state = calloc(1, scenario->stateOctetSize);
+    callback->authoritative.octetSize = scenario->stateOctetSize;
+    callback->authoritative.touchedOctetSize = scenario->touchedOctetSize;
+    callback->predicted.state = calloc(1, scenario->stateOctetSize);
+    callback->predicted.octetSize = scenario->stateOctetSize;
+    callback->predicted.touchedOctetSize = scenario->touchedOctetSize;
+    self->ownedAuthoritativeOctets = callback->authoritative.state;
+    self->ownedPredictedOctets = callback->predicted.state;
+
+    memset(&self->vtbl, 0, sizeof(self->vtbl));
+    self->vtbl.authoritativeDeserializeFn = benchAuthoritativeDeserialize;
+    self->vtbl.authoritativeTickFn = benchAuthoritativeTick;
+    self->vtbl.copyFromAuthoritativeToPredictionFn = benchCopyAuthoritativeToPrediction;
+    self->vtbl.predictionTickFn = benchPredictionTick;
+
+    RectifyCallbackObject callbackObject = {.vtbl = &self->vtbl, .self = callback};
+
+    Clog log;
+    log.config = &g_clog;
+    log.constantPrefix = "bench";
+
+    RectifySetup setup;
+    rectifySetupDefaults(&setup);
+    setup.allocator = &self->allocator.linear.info;
+    setup.maxStepOctetSizeForSingleParticipant = sizeof(BenchParticipantInput);
+    setup.maxPlayerCount = scenario->participantCount;
+    setup.maxTicksFromAuthoritative = scenario->maxTicksFromAuthoritative;
+    setup.stateArenaOctetSize = scenario->useStateArenas ? scenario->stateOctetSize : 0;
+    setup.log = log;
+
+    TransmuteState initialState = {.state = self->initialOctets, .octetSize = scenario->stateOctetSize};
+    self->firstStepId = 1;
+
+    rectifyInit(self->rectify, callbackObject, setup, initialState, self->firstStepId);
+    self->allocatedOctetCount = benchAllocatorAllocatedOctetCount(&self->allocator);
+
+    self->participantInputs = calloc(scenario->participantCount, sizeof(TransmuteParticipantInput));
+    self->payloads = calloc(scenario->participantCount, sizeof(BenchParticipantInput));
+
+    // Authoritative runs behind the prediction, like it would with network latency
+    self->authoritativeLag = scenario->maxTicksFromAuthoritative > 1 ? scenario->maxTicksFromAuthoritative - 1 : 0;
+    self->nextAuthoritativeStepId = self->firstStepId;
+    self->seed = seed;
+}
+
+/// Adds the authoritative and predicted steps that have arrived for `frame`
+static void benchInstanceAddSteps(BenchInstance* self, const BenchScenario* scenario, size_t frame)
+{
+    StepId predictedStepId = self->firstStepId + (StepId) frame;
+
+    bool shouldDeliver = scenario->backlogTicks == 0 || (frame % scenario->backlogTicks) == 0;
+    while (shouldDeliver && self->nextAuthoritativeStepId + self->authoritativeLag <= predictedStepId) {
+        bool mispredict = benchRandom(&self->seed) % 100u < scenario->mispredictionPercent;
+        benchFillInput(&self->input, self->participantInputs, self->payloads, scenario->participantCount, true,
+                       mispredict);
+        rectifyAddAuthoritativeStep(self->rectify, &self->input, self->nextAuthoritativeStepId);
+        self->nextAuthoritativeStepId++;
+    }
+
+    benchFillInput(&self->input, self->participantInputs, self->payloads, scenario->participantCount, false, false);
+    rectifyAddPredictedStep(self->rectify, &self->input, predictedStepId);
+}
+
+static void benchInstanceDestroy(BenchInstance* self)
+{
+    rectifyDestroy(self->rectify);
+    free(self->payloads);
+    free(self->participantInputs);
+    free(self->rectify);
+    free(self->ownedPredictedOctets);
+    free(self->ownedAuthoritativeOctets);
+    free(self->initialOctets);
+    benchAllocatorDestroy(&self->allocator);
+}
+
+static BenchResult benchRun(BenchScenario scenario)
+{
+    BenchInstance* instances = calloc(scenario.instanceCount, sizeof(BenchInstance));
+    Rectify** rectifies = calloc(scenario.instanceCount, sizeof(Rectify*));
+    for (size_t i = 0; i < scenario.instanceCount; ++i) {
+        benchInstanceInit(&instances[i], &scenario, 0x1234u + (uint32_t) i);
+        rectifies[i] = instances[i].rectify;
+    }
+
+    // The pool is only used when there are worker threads, to measure the plain rectifyUpdate() otherwise
+    bool usePool = scenario.workerThreadCount > 0;
+    BenchAllocator poolAllocator;
+    RectifyWorkerPool pool;
+    if (usePool) {
+        benchAllocatorInit(&poolAllocator, 1024 * 1024);
+        rectifyWorkerPoolInit(&pool, &poolAllocator.linear.info, scenario.workerThreadCount, scenario.instanceCount);
+    }
+
+    BenchNanoseconds totalNanoseconds = 0;
+    BenchNanoseconds worstNanoseconds = 0;
+
+    for (size_t frame = 0; frame < scenario.frameCount; ++frame) {
+        for (size_t i = 0; i < scenario.instanceCount; ++i) {
+            benchInstanceAddSteps(&instances[i], &scenario, frame);
+        }
+
+        BenchNanoseconds before = benchNow();
+        if (usePool) {
+            rectifyUpdateMany(rectifies, scenario.instanceCount, &pool);
+        } else {
+            for (size_t i = 0; i < scenario.instanceCount; ++i) {
+                rectifyUpdate(rectifies[i]);
+            }
+        }
+        BenchNanoseconds elapsed = benchNow() - before;
+
+        totalNanoseconds += elapsed;
+        if (elapsed > worstNanoseconds) {
+            worstNanoseconds = elapsed;
+        }
+    }
+
+    // Each predicted step is ticked at least once, everything above that is re-simulation
+    size_t predictedStepCount = scenario.frameCount * scenario.instanceCount;
+    size_t predictionTickCount = 0;
+    size_t authoritativeTickCount = 0;
+    size_t copyCount = 0;
+    size_t allocatedOctetCount = 0;
+    for (size_t i = 0; i < scenario.instanceCount; ++i) {
+        predictionTickCount += instances[i].callback.predictionTickCount;
+        authoritativeTickCount += instances[i].callback.authoritativeTickCount;
+        // With the state arenas, Rectify copies the states itself
+        copyCount += rectifyStats(instances[i].rectify)->predictionResets;
+        allocatedOctetCount += instances[i].allocatedOctetCount;
+    }
+    size_t resimulatedTicks = predictionTickCount > predictedStepCount ? predictionTickCount - predictedStepCount
+                                                                       : 0;
+
+    BenchResult result;
+    result.nanosecondsPerUpdate = (double) totalNanoseconds / (double) scenario.frameCount;
+    result.worstUpdateNanoseconds = worstNanoseconds;
+    result.resimulatedTicks = resimulatedTicks;
+    result.resimulatedTicksPerSecond = totalNanoseconds > 0
+                                           ? (double) resimulatedTicks * 1e9 / (double) totalNanoseconds
+                                           : 0.0;
+    result.authoritativeTicks = authoritativeTickCount;
+    result.copyCount = copyCount;
+    result.allocatedOctetCount = allocatedOctetCount;
+
+    if (usePool) {
+        rectifyWorkerPoolDestroy(&pool);
+        benchAllocatorDestroy(&poolAllocator);
+    }
+    for (size_t i = 0; i < scenario.instanceCount; ++i) {
+        benchInstanceDestroy(&instances[i]);
+    }
+    free(rectifies);
+    free(instances);
+
+    return result;
+}
+
+typedef enum BenchFormat {
+    BenchFormatCsv,
+    BenchFormatJson,
+} BenchFormat;
+
+static void benchPrintHeader(BenchFormat format)
+{
+    if (format == BenchFormatCsv) {
+        printf("participants,maxTicksFromAuthoritative,stateOctetSize,mispredictionPercent,backlogTicks,"
+               "touchedOctets,stateArenas,instances,workerThreads,frames,nsPerUpdate,worstUpdateNs,"
+               "resimulatedTicks,resimulatedTicksPerSecond,authoritativeTicks,copies,allocatedOctets\n");
+    } else {
+        printf("[\n");
+    }
+}
+
+static void benchPrintResult(BenchFormat format, BenchScenario scenario, BenchResult result, bool isFirst)
+{
+    if (format == BenchFormatCsv) {
+        printf("%zu,%zu,%zu,%u,%zu,%zu,%d,%zu,%zu,%zu,%.1f,%llu,%zu,%.1f,%zu,%zu,%zu\n", scenario.participantCount,
+               scenario.maxTicksFromAuthoritative, scenario.stateOctetSize, scenario.mispredictionPercent,
+               scenario.backlogTicks, scenario.touchedOctetSize, scenario.useStateArenas ? 1 : 0,
+               scenario.instanceCount, scenario.workerThreadCount, scenario.frameCount, result.nanosecondsPerUpdate,
+               (unsigned long long) result.worstUpdateNanoseconds, result.resimulatedTicks,
+               result.resimulatedTicksPerSecond, result.authoritativeTicks, result.copyCount,
+               result.allocatedOctetCount);
+    } else {
+        printf("%s  {\"participants\": %zu, \"maxTicksFromAuthoritative\": %zu, \"stateOctetSize\": %zu, "
+               "\"mispredictionPercent\": %u, \"backlogTicks\": %zu, \"touchedOctets\": %zu, "
+               "\"stateArenas\": %s, \"instances\": %zu, \"workerThreads\": %zu, \"frames\": %zu, "
+               "\"nsPerUpdate\": %.1f, \"worstUpdateNs\": %llu, \"resimulatedTicks\": %zu, "
+               "\"resimulatedTicksPerSecond\": %.1f, \"authoritativeTicks\": %zu, \"copies\": %zu, "
+               "\"allocatedOctets\": %zu}",
+               isFirst ? "" : ",\n", scenario.participantCount, scenario.maxTicksFromAuthoritative,
+               scenario.stateOctetSize, scenario.mispredictionPercent, scenario.backlogTicks,
+               scenario.touchedOctetSize, scenario.useStateArenas ? "true" : "false", scenario.instanceCount,
+               scenario.workerThreadCount, scenario.frameCount, result.nanosecondsPerUpdate,
+               (unsigned long long) result.worstUpdateNanoseconds, result.resimulatedTicks,
+               result.resimulatedTicksPerSecond, result.authoritativeTicks, result.copyCount,
+               result.allocatedOctetCount);
+    }
+}
+
+static void benchPrintFooter(BenchFormat format)
+{
+    if (format == BenchFormatJson) {
+        printf("\n]\n");
+    }
+}
+
+int main(int argc, const char* const argv[])
+{
+    g_clog.log = clog_console;
+    g_clog.level = CLOG_TYPE_WARN;
+
+    BenchFormat format = BenchFormatCsv;
+    size_t frameCount = 2000;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0) {
+            format = BenchFormatJson;
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            format = BenchFormatCsv;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameCount = (size_t) strtoul(argv[++i], 0, 10);
+        } else {
+            fprintf(stderr, "usage: rectify_bench [--csv | --json] [--frames count]\n");
+            return 1;
+        }
+    }
+
+    const BenchScenario baseline = {
+        .participantCount = 8,
+        .maxTicksFromAuthoritative = 8,
+        .stateOctetSize = 16 * 1024,
+        .mispredictionPercent = 10,
+        .backlogTicks = 0,
+        .touchedOctetSize = 0,
+        .useStateArenas = false,
+        .instanceCount = 1,
+        .workerThreadCount = 0,
+        .frameCount = frameCount,
+    };
+
+    const size_t participantCounts[] = {2, 8, 32, 64, 128};
+    const size_t predictionDepths[] = {2, 4, 8, 16};
+    const size_t stateOctetSizes[] = {1024, 16 * 1024, 256 * 1024, 1024 * 1024};
+    const unsigned mispredictionPercents[] = {0, 10, 50, 100};
+    const size_t backlogs[] = {0, 5, 20, 60};
+    const size_t workerThreadCounts[] = {0, 1, 3, 7};
+
+    BenchScenario scenarios[32];
+    size_t scenarioCount = 0;
+
+    // Sweep one dimension at a time, keeping the others at the baseline
+    for (size_t i = 0; i < sizeof(participantCounts) / sizeof(participantCounts[0]); ++i) {
+        scenarios[scenarioCount] = baseline;
+        scenarios[scenarioCount++].participantCount = participantCounts[i];
+    }
+    for (size_t i = 0; i < sizeof(predictionDepths) / sizeof(predictionDepths[0]); ++i) {
+        scenarios[scenarioCount] = baseline;
+        scenarios[scenarioCount++].maxTicksFromAuthoritative = predictionDepths[i];
+    }
+    for (size_t i = 0; i < sizeof(stateOctetSizes) / sizeof(stateOctetSizes[0]); ++i) {
+        scenarios[scenarioCount] = baseline;
+        scenarios[scenarioCount++].stateOctetSize = stateOctetSizes[i];
+    }
+    for (size_t i = 0; i < sizeof(mispredictionPercents) / sizeof(mispredictionPercents[0]); ++i) {
+        scenarios[scenarioCount] = baseline;
+        scenarios[scenarioCount++].mispredictionPercent = mispredictionPercents[i];
+    }
+    for (size_t i = 0; i < sizeof(backlogs) / sizeof(backlogs[0]); ++i) {
+        scenarios[scenarioCount] = baseline;
+        scenarios[scenarioCount++].backlogTicks = backlogs[i];
+    }
+    // A large state where each tick writes a small part, with and without the dirty chunks of the state arenas
+    for (size_t i = 0; i < 2; ++i) {
+        scenarios[scenarioCount] = baseline;
+        scenarios[scenarioCount].stateOctetSize = 1024 * 1024;
+        scenarios[scenarioCount].touchedOctetSize = 1024;
+        scenarios[scenarioCount].backlogTicks = 5;
+        scenarios[scenarioCount++].useStateArenas = i == 1;
+    }
+    // Thread scaling of rectifyUpdateMany(), for a server that runs many matches
+    for (size_t i = 0; i < sizeof(workerThreadCounts) / sizeof(workerThreadCounts[0]); ++i) {
+        scenarios[scenarioCount] = baseline;
+        scenarios[scenarioCount].instanceCount = 32;
+        scenarios[scenarioCount++].workerThreadCount = workerThreadCounts[i];
+    }
+
+    benchPrintHeader(format);
+    for (size_t i = 0; i < scenarioCount; ++i) {
+        BenchResult result = benchRun(scenarios[i]);
+        benchPrintResult(format, scenarios[i], result, i == 0);
+        fflush(stdout);
+    }
+    benchPrintFooter(format);
+
+    return 0;
+}
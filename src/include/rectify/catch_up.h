@@ -0,0 +1,58 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_CATCH_UP_H
+#define RECTIFY_CATCH_UP_H
+
+#include <monotonic-time/monotonic_time.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum RectifyCatchUpMode {
+    RectifyCatchUpModeTickCount, // at most maxTicksPerUpdate authoritative ticks each update
+    RectifyCatchUpModeTimeBudget, // as many ticks as fits in timeBudgetMs, but at most maxTicksPerUpdate
+    RectifyCatchUpModeAdaptive, // grows with the backlog, shrinks when the tick cost rises
+} RectifyCatchUpMode;
+
+typedef struct RectifyCatchUpSetup {
+    RectifyCatchUpMode mode;
+    size_t maxTicksPerUpdate; // zero means the default of 20
+    size_t minTicksPerUpdate; // only used for adaptive
+    MonotonicTimeMs timeBudgetMs; // used for time budget and adaptive
+} RectifyCatchUpSetup;
+
+/// How the authoritative catch-up went during the last update.
+typedef struct RectifyCatchUpReport {
+    size_t backlogBeforeUpdate;
+    size_t backlogAfterUpdate;
+    size_t ticksLastUpdate;
+    MonotonicTimeMs elapsedMsLastUpdate;
+    size_t tickCostMicroseconds; // moving average
+    bool wasCappedLastUpdate;
+} RectifyCatchUpReport;
+
+typedef struct RectifyCatchUp {
+    RectifyCatchUpSetup setup;
+    MonotonicTimeMs updateStartedAt;
+    size_t ticksLeftThisUpdate;
+    size_t measuredTicks;
+    MonotonicTimeMs measuredMs;
+    RectifyCatchUpReport report;
+} RectifyCatchUp;
+
+/// When to jump to an authoritative snapshot instead of ticking through the steps to it
+typedef struct RectifySnapshotPolicy {
+    size_t minStepsBehind; // always use the snapshot when at least this far behind, zero disables
+    MonotonicTimeMs maxCatchUpMs; // use the snapshot when ticking through is estimated to take longer, zero disables
+} RectifySnapshotPolicy;
+
+void rectifyCatchUpInit(RectifyCatchUp* self, RectifyCatchUpSetup setup);
+void rectifyCatchUpBegin(RectifyCatchUp* self, size_t backlog);
+size_t rectifyCatchUpNextChunk(RectifyCatchUp* self);
+void rectifyCatchUpChunkDone(RectifyCatchUp* self, size_t ticksExecuted);
+void rectifyCatchUpEnd(RectifyCatchUp* self, size_t backlog);
+bool rectifyCatchUpPrefersSnapshot(const RectifyCatchUp* self, const RectifySnapshotPolicy* policy,
+                                   size_t stepsBehind);
+
+#endif
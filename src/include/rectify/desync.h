@@ -0,0 +1,61 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_DESYNC_H
+#define RECTIFY_DESYNC_H
+
+#include <nimble-steps/steps.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct ImprintAllocator;
+
+typedef struct RectifyDesyncSetup {
+    size_t checkpointInterval; // hash the authoritative state every N ticks, zero disables the desync checks
+    size_t maxCheckpointCount; // how long a local hash waits for the server hash, zero means the default of 64
+} RectifyDesyncSetup;
+
+typedef struct RectifyDesyncCheckpoint {
+    StepId stepId;
+    bool isValid;
+    bool hasLocalHash;
+    bool hasServerHash;
+    uint64_t localHash;
+    uint64_t serverHash;
+} RectifyDesyncCheckpoint;
+
+/// Result of the checkpoints so far. The state first diverged somewhere after `lastVerifiedStepId`,
+/// and at or before `firstDesyncStepId`.
+typedef struct RectifyDesyncReport {
+    bool hasVerified;
+    StepId lastVerifiedStepId;
+    bool hasDesynced;
+    StepId firstDesyncStepId;
+    uint64_t localHash; // for the first desync step
+    uint64_t serverHash;
+} RectifyDesyncReport;
+
+typedef enum RectifyDesyncResult {
+    RectifyDesyncResultPending,
+    RectifyDesyncResultVerified,
+    RectifyDesyncResultDesynced,
+} RectifyDesyncResult;
+
+/// Ring of checkpoint hashes indexed by StepId.
+/// The local and the server hash for a checkpoint can arrive in any order.
+typedef struct RectifyDesync {
+    RectifyDesyncCheckpoint* checkpoints;
+    size_t capacity;
+    size_t checkpointInterval;
+    RectifyDesyncReport report;
+} RectifyDesync;
+
+void rectifyDesyncInit(RectifyDesync* self, struct ImprintAllocator* allocator, RectifyDesyncSetup setup);
+void rectifyDesyncReInit(RectifyDesync* self);
+bool rectifyDesyncIsCheckpoint(const RectifyDesync* self, StepId stepId);
+RectifyDesyncResult rectifyDesyncAddLocal(RectifyDesync* self, StepId stepId, uint64_t hash);
+RectifyDesyncResult rectifyDesyncAddServer(RectifyDesync* self, StepId stepId, uint64_t hash);
+
+#endif
@@ -0,0 +1,51 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_DIRTY_RANGES_H
+#define RECTIFY_DIRTY_RANGES_H
+
+#include <nimble-steps/steps.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct ImprintAllocator;
+
+typedef struct RectifyDirtyRange {
+    size_t offset;
+    size_t octetCount;
+} RectifyDirtyRange;
+
+/// Reports the state ranges that have changed since the last call, and starts a new tracking window.
+/// Returns the number of ranges written, or a negative value if the changes are unknown or do not fit.
+typedef int (*RectifyDirtyRangesFn)(void* self, RectifyDirtyRange* ranges, size_t maxRangeCount);
+
+/// Copies only the `ranges` of the authoritative state to the predicted state.
+/// The copied ranges must not be reported as changed by the next prediction RectifyDirtyRangesFn.
+typedef void (*RectifyCopyRangesFromAuthoritativeFn)(void* self, const RectifyDirtyRange* ranges, size_t rangeCount,
+                                                     StepId stepId);
+
+/// One dirty bit for each chunk of a state.
+/// Optional helper for the application to implement a RectifyDirtyRangesFn.
+typedef struct RectifyDirtyChunks {
+    uint64_t* bits;
+    size_t wordCount;
+    size_t chunkCount;
+    size_t chunkOctetSize;
+    size_t maxStateOctetSize;
+} RectifyDirtyChunks;
+
+void rectifyDirtyChunksInit(RectifyDirtyChunks* self, struct ImprintAllocator* allocator, size_t maxStateOctetSize,
+                            size_t chunkOctetSize);
+void rectifyDirtyChunksMark(RectifyDirtyChunks* self, size_t offset, size_t octetCount);
+void rectifyDirtyChunksMarkAll(RectifyDirtyChunks* self);
+void rectifyDirtyChunksClear(RectifyDirtyChunks* self);
+int rectifyDirtyChunksCollect(const RectifyDirtyChunks* self, RectifyDirtyRange* ranges, size_t maxRangeCount);
+
+size_t rectifyDirtyRangesMerge(RectifyDirtyRange* ranges, size_t rangeCount);
+size_t rectifyDirtyRangesOctetCount(const RectifyDirtyRange* ranges, size_t rangeCount);
+void rectifyDirtyRangesCopy(const RectifyDirtyRange* ranges, size_t rangeCount, uint8_t* target,
+                            const uint8_t* source);
+
+#endif
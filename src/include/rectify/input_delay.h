@@ -0,0 +1,51 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_INPUT_DELAY_H
+#define RECTIFY_INPUT_DELAY_H
+
+#include <nimble-steps/steps.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RECTIFY_INPUT_DELAY_MAX_TICKS (16)
+
+typedef struct RectifyInputDelaySetup {
+    size_t ticks; // local input delay, the adaptive delay never goes below this
+    size_t maxTicks; // the delay adapts between ticks and maxTicks, zero keeps it fixed at ticks. At most 16.
+    size_t resimulationBudgetMicroseconds; // acceptable average re-simulation cost for each update
+    size_t adaptAfterUpdates; // updates that are measured before each change, zero means the default of 60
+} RectifyInputDelaySetup;
+
+/// Maps the local predicted steps forward by the input delay. The delayed inputs are queued, but the prediction is
+/// only ticked up to the local tick, see rectifyInputDelayLocalTick(), so the delay never makes a correction
+/// re-simulate more ticks. The delay pays off when the local ticks follow the time sync, since the time sync keeps
+/// the delayed steps at the target lead, which moves the local tick closer to the authoritative state.
+/// The adaptive delay only changes one tick at a time, and only keeps a longer delay if the re-simulation cost that
+/// was measured with it is lower.
+typedef struct RectifyInputDelay {
+    RectifyInputDelaySetup setup;
+    bool isAdaptive;
+    size_t ticks;
+    bool hasMappedStep;
+    StepId lastMappedStepId;
+    StepId localTickId; // the last tickId that was mapped
+    size_t periodUpdateCount;
+    size_t periodResimulatedTicks;
+    size_t periodCorrectionCount;
+    size_t resimulatedTicksThisUpdate;
+    size_t lastResimulationCostMicroseconds; // average for each update in the last period
+    size_t periodIndex;
+    size_t costMicrosecondsForTicks[RECTIFY_INPUT_DELAY_MAX_TICKS + 1]; // the last measured cost for each delay
+    size_t measuredPeriodForTicks[RECTIFY_INPUT_DELAY_MAX_TICKS + 1]; // zero if never measured
+} RectifyInputDelay;
+
+void rectifyInputDelayInit(RectifyInputDelay* self, RectifyInputDelaySetup setup);
+void rectifyInputDelayReInit(RectifyInputDelay* self);
+size_t rectifyInputDelayMap(RectifyInputDelay* self, StepId tickId, StepId* outFirstStepId);
+bool rectifyInputDelayLocalTick(const RectifyInputDelay* self, StepId* outTickId);
+void rectifyInputDelayCountResimulatedTick(RectifyInputDelay* self);
+size_t rectifyInputDelayUpdate(RectifyInputDelay* self, size_t tickCostMicroseconds);
+
+#endif
@@ -0,0 +1,106 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_INPUT_HISTORY_H
+#define RECTIFY_INPUT_HISTORY_H
+
+#include <nimble-steps/steps.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <transmute/transmute.h>
+
+struct ImprintAllocator;
+
+/// With delta encoding, a new key step is written at least this often
+#define RECTIFY_INPUT_HISTORY_KEY_INTERVAL (16)
+
+typedef enum RectifyInputEncoding {
+    RectifyInputEncodingFull,
+    RectifyInputEncodingSame, // same payload as in the key step
+    RectifyInputEncodingXor, // a span of the payload in the key step, xor:ed with the new payload
+    RectifyInputEncodingNoPayload,
+} RectifyInputEncoding;
+
+/// How a participant input is stored in the compact ring when delta encoding is used
+typedef struct RectifyEncodedParticipantInput {
+    uint8_t participantId;
+    uint8_t localPartyId;
+    uint8_t inputType;
+    uint8_t encoding;
+    uint16_t octetSize;
+    uint16_t deltaOffset;
+    uint16_t deltaOctetCount;
+} RectifyEncodedParticipantInput;
+
+typedef struct RectifyInputHistoryEntry {
+    StepId stepId;
+    bool isValid;
+    bool hasHash;
+    uint64_t hash;
+    TransmuteInput input;
+    uint8_t* payload;
+    size_t ringOffset; // only used when compact
+    size_t ringOctetCount;
+    uint64_t writeIndex;
+    bool isKey; // the rest is only used with delta encoding
+    StepId keyStepId;
+    uint64_t keyWriteIndex;
+} RectifyInputHistoryEntry;
+
+/// Where an entry was written in the compact ring. A region is stale if the entry has been written again since.
+typedef struct RectifyInputHistoryRingRegion {
+    size_t entryIndex;
+    uint64_t writeIndex;
+} RectifyInputHistoryRingRegion;
+
+/// Fixed size ring of composed inputs, indexed by StepId.
+/// The participant inputs are copied, so the caller buffers do not need to be kept alive.
+/// A compact history stores the participant inputs and their payloads back-to-back in a byte ring, instead of
+/// reserving room for the max participant count with max size inputs for every step. When the ring is full,
+/// the oldest steps are evicted and can no longer be found. The written regions are queued in ring order,
+/// so only the regions at the head of the queue need to be checked when making room.
+/// With delta encoding, each participant input in the compact ring is stored as the same as, or as a xor span
+/// against, the same participant in the last key step. The inputs are decoded when they are found.
+/// Deltas are against the key step instead of the previous step, so that decoding a step only reads the step and
+/// its key, and so that evicting or rewriting a step never breaks the steps after it. The key interval limits how
+/// many steps are lost if a key step is evicted, and keeps the key close to the inputs that are encoded against it.
+typedef struct RectifyInputHistory {
+    RectifyInputHistoryEntry* entries;
+    size_t capacity;
+    TransmuteParticipantInput* participantInputs;
+    uint8_t* payloads;
+    size_t maxParticipantCount;
+    size_t maxOctetSizeForSingleParticipant;
+    bool isCompact;
+    uint8_t* ring;
+    size_t ringOctetSize;
+    size_t ringWriteOffset;
+    RectifyInputHistoryRingRegion* ringRegions; // oldest first, starting at ringRegionHead
+    size_t ringRegionCapacity;
+    size_t ringRegionHead;
+    size_t ringRegionCount;
+    size_t evictedCount;
+    bool useDeltaEncoding;
+    uint64_t writeCount;
+    bool hasKey;
+    StepId keyStepId;
+    uint64_t keyWriteIndex;
+    RectifyEncodedParticipantInput* encodedScratch;
+    size_t* keyPayloadOffsetsScratch;
+    TransmuteParticipantInput* decodedParticipantInputs;
+    uint8_t* decodedPayloads;
+} RectifyInputHistory;
+
+void rectifyInputHistoryInit(RectifyInputHistory* self, struct ImprintAllocator* allocator, size_t capacity,
+                             size_t maxParticipantCount, size_t maxOctetSizeForSingleParticipant,
+                             size_t compactOctetSize, bool useDeltaEncoding);
+void rectifyInputHistoryReInit(RectifyInputHistory* self);
+int rectifyInputHistoryWrite(RectifyInputHistory* self, const TransmuteInput* input, StepId stepId);
+bool rectifyInputHistoryHas(const RectifyInputHistory* self, StepId stepId);
+RectifyInputHistoryEntry* rectifyInputHistoryFind(RectifyInputHistory* self, StepId stepId);
+
+bool rectifyInputIsEqual(const TransmuteInput* a, const TransmuteInput* b);
+
+#endif
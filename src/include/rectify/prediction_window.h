@@ -0,0 +1,34 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_PREDICTION_WINDOW_H
+#define RECTIFY_PREDICTION_WINDOW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct RectifyPredictionWindowSetup {
+    size_t minTicks; // the effective window never shrinks below this, zero keeps it at maxTicksFromAuthoritative
+    size_t marginTicks; // headroom over the measured lead, so jitter does not stall the prediction
+    size_t shrinkHysteresisTicks; // only shrink when the window is at least this much larger than needed
+    size_t shrinkAfterUpdates; // measurements in a row that must allow the shrink, zero means the default of 30
+} RectifyPredictionWindowSetup;
+
+/// Effective number of predicted ticks allowed ahead of the authoritative state, within the preallocated maximum.
+/// Grows as soon as the measured lead needs it, but only shrinks after the lead has stayed low for a while.
+typedef struct RectifyPredictionWindow {
+    RectifyPredictionWindowSetup setup;
+    bool isEnabled;
+    size_t maxTicks;
+    size_t effectiveTicks;
+    size_t lastLeadTicks;
+    size_t shrinkCandidateCount;
+    size_t shrinkCandidateTicks; // largest window needed while shrink candidates were counted
+} RectifyPredictionWindow;
+
+void rectifyPredictionWindowInit(RectifyPredictionWindow* self, RectifyPredictionWindowSetup setup, size_t maxTicks);
+void rectifyPredictionWindowReInit(RectifyPredictionWindow* self);
+size_t rectifyPredictionWindowAddLead(RectifyPredictionWindow* self, size_t leadTicks);
+
+#endif
@@ -0,0 +1,31 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_PREDICTION_WORKER_H
+#define RECTIFY_PREDICTION_WORKER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct ImprintAllocator;
+struct RectifyPredictionWorkerThread;
+
+typedef void (*RectifyPredictionJobFn)(void* self);
+
+/// Runs one prediction job at a time on a background thread.
+/// Without thread support, the job is run directly on the calling thread.
+typedef struct RectifyPredictionWorker {
+    struct RectifyPredictionWorkerThread* thread;
+    RectifyPredictionJobFn jobFn;
+    void* jobSelf;
+} RectifyPredictionWorker;
+
+void rectifyPredictionWorkerInit(RectifyPredictionWorker* self, struct ImprintAllocator* allocator, bool useThread,
+                                 RectifyPredictionJobFn jobFn, void* jobSelf);
+void rectifyPredictionWorkerDestroy(RectifyPredictionWorker* self);
+void rectifyPredictionWorkerKick(RectifyPredictionWorker* self);
+void rectifyPredictionWorkerFence(const RectifyPredictionWorker* self);
+bool rectifyPredictionWorkerIsBusy(const RectifyPredictionWorker* self);
+
+#endif
@@ -0,0 +1,40 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_PRESENTATION_H
+#define RECTIFY_PRESENTATION_H
+
+#include <nimble-steps/steps.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <transmute/transmute.h>
+
+struct ImprintAllocator;
+
+typedef struct RectifyPresentationState {
+    StepId stepId;
+    TransmuteState state;
+} RectifyPresentationState;
+
+#define RECTIFY_PRESENTATION_SLOT_COUNT (3)
+
+/// Triple buffer of complete predicted states, with a single writer and a single reader.
+/// The writer and the reader never wait for each other, they only exchange slot indices.
+typedef struct RectifyPresentation {
+    RectifyPresentationState slots[RECTIFY_PRESENTATION_SLOT_COUNT];
+    uint8_t* octets;
+    size_t maxOctetSize;
+    uint8_t writeIndex; // only used by the writer
+    uint8_t readIndex; // only used by the reader
+    uint8_t sharedIndex; // exchanged between the writer and the reader
+    bool hasState; // only used by the reader
+} RectifyPresentation;
+
+void rectifyPresentationInit(RectifyPresentation* self, struct ImprintAllocator* allocator, size_t maxOctetSize);
+void rectifyPresentationReInit(RectifyPresentation* self);
+int rectifyPresentationWrite(RectifyPresentation* self, const TransmuteState* state, StepId stepId);
+const RectifyPresentationState* rectifyPresentationRead(RectifyPresentation* self);
+
+#endif
@@ -6,18 +6,47 @@
 #define RECTIFY_H
 
 #include <assent/assent.h>
+#include <rectify/catch_up.h>
+#include <rectify/desync.h>
+#include <rectify/dirty_ranges.h>
+#include <rectify/input_delay.h>
+#include <rectify/input_history.h>
+#include <rectify/prediction_window.h>
+#include <rectify/prediction_worker.h>
+#include <rectify/presentation.h>
+#include <rectify/remote_predictor.h>
+#include <rectify/replay_recorder.h>
+#include <rectify/resimulation.h>
+#include <rectify/speculation.h>
+#include <rectify/state_arena.h>
+#include <rectify/state_hash.h>
+#include <rectify/stats.h>
+#include <rectify/time_sync.h>
+#include <rectify/trace.h>
+#include <rectify/worker_pool.h>
 #include <seer/seer.h>
 
+typedef uint64_t (*RectifyPredictionHashFn)(void* self);
+typedef TransmuteState (*RectifyAuthoritativeGetStateFn)(void* self);
+typedef TransmuteState (*RectifyPredictionGetStateFn)(void* self);
 
 typedef struct RectifyCallbackObjectVtbl {
     AssentPreAuthoritativeTicksFn preAuthoritativeTicksFn;
     AssentAuthoritativeTickFn authoritativeTickFn;
     AssentDeserializeStateFn authoritativeDeserializeFn;
-    AssentAuthoritativeHashFn authoritativeHashFn;
+    AssentAuthoritativeHashFn authoritativeHashFn; // optional, otherwise the built in state hash is used
+    RectifyAuthoritativeGetStateFn authoritativeGetStateFn; // optional, for the built in state hash
 
     SeerPredictionCopyFromAuthoritativeFn copyFromAuthoritativeToPredictionFn;
     SeerPredictionTickFn predictionTickFn;
     SeerPredictionPostPredictionTicksFn postPredictionTicksFn;
+    RectifyPredictionHashFn predictionHashFn; // optional, compared against authoritativeHashFn
+    RectifyPredictionGetStateFn predictionGetStateFn; // optional, for the presentation
+    RectifySpeculativeRemoteInputFn speculativeRemoteInputFn; // optional, for RectifySpeculationHypothesisCustom
+    RectifyPredictRemoteInputFn predictRemoteInputFn; // optional, overrides the built in remote input prediction
+    RectifyDirtyRangesFn authoritativeDirtyRangesFn; // optional, together with the two below
+    RectifyDirtyRangesFn predictionDirtyRangesFn; // must include the changes done by predictionTickFn
+    RectifyCopyRangesFromAuthoritativeFn copyRangesFromAuthoritativeToPredictionFn;
 } RectifyCallbackObjectVtbl;
 
 typedef struct RectifyCallbackObject {
@@ -26,16 +55,56 @@ typedef struct RectifyCallbackObject {
 } RectifyCallbackObject;
 
 typedef struct Rectify {
+    RectifyCallbackObject callbackObject;
     SeerCallbackObjectVtbl seerCallbackVtbl;
     AssentCallbackVtbl assentCallbackVtbl;
     Seer predicted;
     Assent authoritative;
     TransmuteInput buildComposedPredictedInput;
     size_t buildComposedPredictedInputMaxParticipantCount;
+    size_t stepParticipantCapacity; // see RectifySetup::maxActivePlayerCount
+    int16_t composedIndexForParticipantId[RECTIFY_PARTICIPANT_ID_COUNT];
+    bool composedLayoutIsDirty;
+    size_t* patchedComposedIndices;
+    size_t patchedComposedIndexCount;
     Clog log;
     char prefixAuthoritative[32];
     char prefixPredicted[32];
     bool authoritativeHasBeenCopiedToPrediction;
+    RectifyInputHistory predictedInputs;
+    bool predictionHasDiverged;
+    StepId firstDivergentStepId;
+    RectifyCatchUp catchUp;
+    RectifyStats stats;
+    bool hasPredictedAnyStep;
+    StepId nextNeverPredictedStepId;
+    bool useTrace;
+    RectifyTrace trace;
+    bool usePresentation;
+    RectifyPresentation presentation;
+    bool authoritativeWasDrainedLastUpdate;
+    size_t authoritativeBacklogAfterUpdate;
+    RectifyPredictionWorker predictionWorker;
+    bool useSpeculation;
+    RectifySpeculation speculation;
+    RectifyRemotePredictor remotePredictor;
+    bool useDirtyRanges;
+    RectifyDirtyRange* dirtyRanges;
+    size_t maxDirtyRangeCount;
+    bool dirtyRangesNeedFullCopy;
+    bool useStateArenas;
+    RectifyStateArena authoritativeStateArena;
+    RectifyStateArena predictedStateArena;
+    bool comparesStateHashes;
+    bool useDesync;
+    RectifyDesync desync;
+    RectifyReplayRecorder* replayRecorder;
+    RectifySnapshotPolicy snapshotPolicy;
+    bool authoritativeSnapshotWasSet;
+    RectifyPredictionWindow predictionWindow;
+    RectifyTimeSync timeSync;
+    RectifyInputDelay inputDelay;
+    RectifyResimulation resimulation;
 } Rectify;
 
 typedef struct RectifySetup {
@@ -43,15 +112,76 @@ typedef struct RectifySetup {
     size_t maxStepOctetSizeForSingleParticipant;
     size_t maxTicksFromAuthoritative;
     size_t maxPlayerCount;
+    // Hard limit for the participants in each step, not a memory hint. Assent and Seer reserve room for this many
+    // participants in every step, and authoritative steps with more participants are rejected. Zero uses
+    // maxPlayerCount.
+    size_t maxActivePlayerCount;
+    RectifyCatchUpSetup catchUp;
+    size_t traceEventCapacity; // zero disables the trace ring
+    size_t maxPresentationStateOctetSize; // zero disables rectifyPresentationState()
+    bool useAsyncPrediction; // predicts on a worker thread, where supported
+    RectifySpeculationSetup speculation; // needs the state arenas, ticked serially, see RectifySpeculation
+    RectifyRemotePredictorSetup remotePrediction;
+    size_t maxDirtyRangeCount; // zero always copies the full authoritative state to the prediction
+    size_t stateArenaOctetSize; // zero disables the state arenas, see rectifyAuthoritativeStateArena()
+    RectifyDesyncSetup desync; // also limits the predicted state hashing to the checkpoints
+    size_t compactStepOctetSize; // octet budget for each kept step history, zero reserves max size steps
+    bool useDeltaEncodedSteps; // delta encodes the inputs in the kept step histories, needs compactStepOctetSize
+    RectifyReplayRecorder* replayRecorder; // optional, records the initial state and all authoritative steps
+    RectifySnapshotPolicy snapshotPolicy; // see rectifyOfferAuthoritativeSnapshot()
+    RectifyPredictionWindowSetup predictionWindow; // adapts the window to the latency, up to maxTicksFromAuthoritative
+    RectifyTimeSyncSetup timeSync; // see rectifyTickDurationPermille()
+    RectifyInputDelaySetup inputDelay; // maps the rectifyAddPredictedStep() tickIds forward
+    RectifyResimulationSetup resimulation; // spreads the re-simulation after a correction over several updates
     Clog log;
 } RectifySetup;
 
+/// rectifyAddAuthoritativeStepsRaw() takes consecutive combined steps, as serialized by nimble-steps-serialize.
+/// Each combined step is prefixed with its octet count, as an uint16 in network order (big endian).
+/// rectifyWriteAuthoritativeStepsRawStep() writes one step in this format.
+#define RECTIFY_AUTHORITATIVE_STEPS_RAW_LENGTH_OCTET_SIZE (2)
+
+/// Returned when an authoritative step has more participants than RectifySetup::maxActivePlayerCount
+#define RECTIFY_ERROR_TOO_MANY_PARTICIPANTS (-10)
+
+void rectifySetupDefaults(RectifySetup* self);
 void rectifyInit(Rectify* self, RectifyCallbackObject callbackObject, RectifySetup setup, TransmuteState state, StepId stepId);
+void rectifyReset(Rectify* self, TransmuteState state, StepId stepId);
+/// Only stops the prediction thread. No memory is freed, everything was allocated from RectifySetup::allocator,
+/// which is owned by the caller. The caller frees or resets that allocator after rectifyDestroy().
+void rectifyDestroy(Rectify* self);
 void rectifyUpdate(Rectify* self);
 ssize_t rectifyAddAuthoritativeStep(Rectify* self, const TransmuteInput* input, StepId tickId);
 int rectifyAddAuthoritativeStepRaw(Rectify* self, const uint8_t* combinedStep, size_t octetCount, StepId tickId);
+int rectifyAddAuthoritativeStepsRaw(Rectify* self, const uint8_t* buffer, size_t octetCount, StepId firstStepId,
+                                    size_t stepCount);
+int rectifyWriteAuthoritativeStepsRawStep(uint8_t* target, size_t maxOctetCount, const uint8_t* combinedStep,
+                                          size_t octetCount);
+int rectifyAddAuthoritativeHash(Rectify* self, StepId stepId, uint64_t hash);
+int rectifySetAuthoritativeSnapshot(Rectify* self, TransmuteState state, StepId stepId);
+bool rectifyPrefersAuthoritativeSnapshot(const Rectify* self, StepId stepId);
+int rectifyOfferAuthoritativeSnapshot(Rectify* self, TransmuteState state, StepId stepId);
 
 bool rectifyMustAddPredictedStepThisTick(const Rectify* self);
+size_t rectifyEffectivePredictionWindow(const Rectify* self);
+uint32_t rectifyTickDurationPermille(const Rectify* self);
+size_t rectifyInputDelayTicks(const Rectify* self);
+bool rectifyPredictionIsCurrent(const Rectify* self);
 int rectifyAddPredictedStep(Rectify* self, const TransmuteInput* input, StepId tickId);
 
+const RectifyCatchUpReport* rectifyCatchUpReport(const Rectify* self);
+const RectifyStats* rectifyStats(const Rectify* self);
+void rectifyStatsReset(Rectify* self);
+const RectifyTrace* rectifyGetTrace(const Rectify* self);
+const RectifyDesyncReport* rectifyDesyncReport(const Rectify* self);
+
+void rectifyPredictionFence(const Rectify* self);
+bool rectifyPredictionIsBusy(const Rectify* self);
+const RectifyPresentationState* rectifyPresentationState(Rectify* self);
+
+const RectifyRemoteParticipant* rectifyRemoteParticipant(const Rectify* self, uint8_t participantId);
+
+RectifyStateArena* rectifyAuthoritativeStateArena(Rectify* self);
+RectifyStateArena* rectifyPredictedStateArena(Rectify* self);
+
 #endif
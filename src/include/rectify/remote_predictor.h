@@ -0,0 +1,70 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_REMOTE_PREDICTOR_H
+#define RECTIFY_REMOTE_PREDICTOR_H
+
+#include <nimble-steps/steps.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <transmute/transmute.h>
+
+struct ImprintAllocator;
+
+#define RECTIFY_PARTICIPANT_ID_COUNT (256)
+
+/// Can override the built in prediction, which is already set in `participantInput`
+typedef void (*RectifyPredictRemoteInputFn)(void* self, StepId stepId, TransmuteParticipantInput* participantInput);
+
+typedef enum RectifyRemoteInputPredictionMode {
+    RectifyRemoteInputPredictionModeNoInput, // remote participants are predicted as no input in time
+    RectifyRemoteInputPredictionModeRepeatLast, // repeat the last authoritative input of the participant
+    RectifyRemoteInputPredictionModeDecayToNeutral, // repeat the last input, then all zero octets after a while
+} RectifyRemoteInputPredictionMode;
+
+typedef struct RectifyRemotePredictorSetup {
+    RectifyRemoteInputPredictionMode mode;
+    size_t decayAfterTicks; // only for RectifyRemoteInputPredictionModeDecayToNeutral
+} RectifyRemotePredictorSetup;
+
+typedef struct RectifyRemoteParticipant {
+    uint8_t participantId;
+    bool isLocal;
+    bool hasInput;
+    StepId lastSeenStepId; // last authoritative step with a normal input
+    StepId lastPresentStepId; // last authoritative step that had the participant at all
+    uint8_t* octets;
+    size_t octetSize;
+    size_t hits; // authoritative input was the same as predicted
+    size_t misses;
+} RectifyRemoteParticipant;
+
+/// Predicts the remote participant inputs from the last input seen in the authoritative steps.
+/// A participant gets one of the `maxParticipantCount` slots when it is first seen, and gives it back when it is
+/// no longer in the authoritative steps.
+typedef struct RectifyRemotePredictor {
+    RectifyRemoteParticipant* participants;
+    size_t participantCount;
+    size_t maxParticipantCount;
+    int16_t participantIndexForParticipantId[RECTIFY_PARTICIPANT_ID_COUNT]; // -1 if the participant has no slot
+    RectifyRemotePredictorSetup setup;
+    uint8_t* octets;
+    uint8_t* neutralOctets;
+    size_t maxOctetSize;
+} RectifyRemotePredictor;
+
+void rectifyRemotePredictorInit(RectifyRemotePredictor* self, struct ImprintAllocator* allocator,
+                                RectifyRemotePredictorSetup setup, size_t maxParticipantCount, size_t maxOctetSize);
+void rectifyRemotePredictorReInit(RectifyRemotePredictor* self);
+const RectifyRemoteParticipant* rectifyRemotePredictorFind(const RectifyRemotePredictor* self, uint8_t participantId);
+void rectifyRemotePredictorSetLocal(RectifyRemotePredictor* self, uint8_t participantId);
+bool rectifyRemotePredictorIsLocal(const RectifyRemotePredictor* self, uint8_t participantId);
+void rectifyRemotePredictorAddAuthoritative(RectifyRemotePredictor* self, const TransmuteInput* authoritativeInput,
+                                            const TransmuteInput* predictedInput, StepId stepId);
+void rectifyRemotePredictorPredict(const RectifyRemotePredictor* self, StepId stepId,
+                                   TransmuteParticipantInput* participantInput);
+void rectifyRemotePredictorClearCounters(RectifyRemotePredictor* self);
+
+#endif
@@ -0,0 +1,50 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_REPLAY_H
+#define RECTIFY_REPLAY_H
+
+#include <rectify/rectify.h>
+#include <rectify/replay_recorder.h>
+
+struct ImprintAllocator;
+
+typedef struct RectifyReplayRecord {
+    RectifyReplayRecordType type;
+    StepId stepId;
+    const uint8_t* octets; // points into the mapped file
+    size_t octetCount;
+    TransmuteInput input; // only for input steps, valid until the next record is read
+    TransmuteState state; // only for states and snapshots
+} RectifyReplayRecord;
+
+/// Reads a file written by RectifyReplayRecorder. The file is memory mapped where supported.
+typedef struct RectifyReplay {
+    const uint8_t* octets;
+    size_t octetCount;
+    size_t position;
+    bool isMapped;
+    TransmuteParticipantInput* participantInputs;
+    size_t maxParticipantCount;
+} RectifyReplay;
+
+typedef struct RectifyReplayReport {
+    size_t stateCount;
+    size_t snapshotCount;
+    size_t stepCount;
+    size_t rejectedStepCount;
+    size_t authoritativeTicks;
+    MonotonicTimeMs elapsedMs;
+} RectifyReplayReport;
+
+int rectifyReplayOpen(RectifyReplay* self, struct ImprintAllocator* allocator, const char* path,
+                      size_t maxParticipantCount);
+int rectifyReplayNext(RectifyReplay* self, RectifyReplayRecord* record);
+void rectifyReplayRewind(RectifyReplay* self);
+void rectifyReplayClose(RectifyReplay* self);
+
+int rectifyReplayRun(RectifyReplay* self, Rectify* rectify, RectifyCallbackObject callbackObject, RectifySetup setup,
+                     RectifyReplayReport* report);
+
+#endif
@@ -0,0 +1,58 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_REPLAY_RECORDER_H
+#define RECTIFY_REPLAY_RECORDER_H
+
+#include <nimble-steps/steps.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <transmute/transmute.h>
+
+struct ImprintAllocator;
+
+#define RECTIFY_REPLAY_MAGIC "RCTFYRPL"
+#define RECTIFY_REPLAY_MAGIC_OCTET_SIZE (8)
+#define RECTIFY_REPLAY_VERSION (1)
+#define RECTIFY_REPLAY_FILE_HEADER_OCTET_SIZE (RECTIFY_REPLAY_MAGIC_OCTET_SIZE + 4)
+#define RECTIFY_REPLAY_RECORD_HEADER_OCTET_SIZE (12)
+#define RECTIFY_REPLAY_PARTICIPANT_HEADER_OCTET_SIZE (6)
+
+/// The file starts with the magic and the version as an uint32. After that the records follow back-to-back,
+/// each with an uint8 type, three reserved octets, an uint32 StepId and an uint32 octet count, followed by the
+/// payload. All integers are little endian.
+typedef enum RectifyReplayRecordType {
+    RectifyReplayRecordTypeState = 1, // the authoritative state that the following steps are ticked from
+    RectifyReplayRecordTypeRawStep = 2, // a combined step, as given to rectifyAddAuthoritativeStepRaw()
+    RectifyReplayRecordTypeInputStep = 3, // uint16 participant count, then for each participant: participantId,
+                                          // localPartyId, inputType, a reserved octet, an uint16 octet count
+                                          // and the input octets
+    RectifyReplayRecordTypeSnapshot = 4, // an authoritative state from rectifySetAuthoritativeSnapshot()
+} RectifyReplayRecordType;
+
+/// Appends the initial state and the authoritative steps to a replay file.
+/// The records are collected in a block and written when the block is full, so there is no system call per step.
+typedef struct RectifyReplayRecorder {
+    FILE* file;
+    uint8_t* block;
+    size_t blockOctetSize;
+    size_t blockOctetCount;
+    size_t recordCount;
+    size_t writtenOctetCount;
+    bool hasFailed;
+} RectifyReplayRecorder;
+
+int rectifyReplayRecorderOpen(RectifyReplayRecorder* self, struct ImprintAllocator* allocator, const char* path,
+                              size_t blockOctetSize);
+void rectifyReplayRecorderAddState(RectifyReplayRecorder* self, const TransmuteState* state, StepId stepId);
+void rectifyReplayRecorderAddSnapshot(RectifyReplayRecorder* self, const TransmuteState* state, StepId stepId);
+void rectifyReplayRecorderAddRawStep(RectifyReplayRecorder* self, const uint8_t* combinedStep, size_t octetCount,
+                                     StepId stepId);
+void rectifyReplayRecorderAddInputStep(RectifyReplayRecorder* self, const TransmuteInput* input, StepId stepId);
+int rectifyReplayRecorderFlush(RectifyReplayRecorder* self);
+int rectifyReplayRecorderClose(RectifyReplayRecorder* self);
+
+#endif
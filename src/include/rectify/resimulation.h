@@ -0,0 +1,36 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_RESIMULATION_H
+#define RECTIFY_RESIMULATION_H
+
+#include <monotonic-time/monotonic_time.h>
+#include <nimble-steps/steps.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct RectifyResimulationSetup {
+    size_t maxTicksPerUpdate; // re-simulated ticks for each update after a correction, zero disables time slicing
+    MonotonicTimeMs timeBudgetMs; // also limits the ticks from the measured tick cost, zero disables
+} RectifyResimulationSetup;
+
+/// Spreads the re-simulation after a correction over several updates.
+/// The re-simulation is done when the prediction has reached the newest predicted step at the time of the
+/// correction, steps predicted after that are ticked as usual.
+typedef struct RectifyResimulation {
+    RectifyResimulationSetup setup;
+    bool isEnabled;
+    bool isInProgress;
+    StepId targetStepId;
+    size_t updateCount; // updates used by the current re-simulation
+    size_t tickCount;
+} RectifyResimulation;
+
+void rectifyResimulationInit(RectifyResimulation* self, RectifyResimulationSetup setup);
+void rectifyResimulationReInit(RectifyResimulation* self);
+void rectifyResimulationBegin(RectifyResimulation* self, StepId predictedStepId, StepId targetStepId);
+size_t rectifyResimulationTicksThisUpdate(const RectifyResimulation* self, size_t tickCostMicroseconds);
+bool rectifyResimulationAdvance(RectifyResimulation* self, StepId predictedStepId, size_t ticks);
+
+#endif
@@ -0,0 +1,80 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_SPECULATION_H
+#define RECTIFY_SPECULATION_H
+
+#include <nimble-steps/steps.h>
+#include <rectify/input_history.h>
+#include <rectify/remote_predictor.h>
+#include <rectify/state_arena.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <transmute/transmute.h>
+
+struct ImprintAllocator;
+
+/// Sets the input for a remote participant in a speculative branch
+typedef void (*RectifySpeculativeRemoteInputFn)(void* self, size_t branchIndex, StepId stepId,
+                                                TransmuteParticipantInput* participantInput);
+
+typedef enum RectifySpeculationHypothesis {
+    RectifySpeculationHypothesisNoInput, // remote participants did not send any input in time
+    RectifySpeculationHypothesisRepeatLastAuthoritative, // remote participants repeat their last known input
+    RectifySpeculationHypothesisCustom, // set by speculativeRemoteInputFn
+} RectifySpeculationHypothesis;
+
+#define RECTIFY_SPECULATION_MAX_BRANCH_COUNT (4)
+
+typedef struct RectifySpeculationSetup {
+    size_t branchCount; // zero disables speculative branches
+    RectifySpeculationHypothesis hypotheses[RECTIFY_SPECULATION_MAX_BRANCH_COUNT];
+} RectifySpeculationSetup;
+
+/// An alternative prediction that follows the main prediction up to `startStepId`, and from there on
+/// uses the hypothesis for the remote participants. The branch state is kept in its own arena, that is swapped with
+/// the predicted state arena while the branch is ticked, and for good when the branch is adopted.
+typedef struct RectifySpeculativeBranch {
+    RectifySpeculationHypothesis hypothesis;
+    bool isValid;
+    bool hasDiverged; // an authoritative input did not match the input used by the branch
+    StepId startStepId;
+    StepId stepId;
+    RectifyStateArena arena;
+    RectifyInputHistory inputs;
+} RectifySpeculativeBranch;
+
+/// The branches are evaluated one after the other on the thread that calls rectifyUpdate(), not as worker pool jobs.
+/// They all tick through the same predictionTickFn, which finds its state through rectifyPredictedStateArena(), and
+/// there is only one predicted state arena to swap a branch into. The composed branch input is also shared.
+/// Ticking the branches in parallel would need a prediction callback that is given the state to tick.
+typedef struct RectifySpeculation {
+    RectifySpeculativeBranch branches[RECTIFY_SPECULATION_MAX_BRANCH_COUNT];
+    size_t branchCount;
+    TransmuteParticipantInput* buildParticipantInputs;
+    size_t maxParticipantCount;
+} RectifySpeculation;
+
+void rectifySpeculationInit(RectifySpeculation* self, struct ImprintAllocator* allocator,
+                            const RectifySpeculationSetup* setup, size_t historyCapacity, size_t maxParticipantCount,
+                            size_t maxOctetSizeForSingleParticipant, size_t compactInputOctetSize,
+                            bool useDeltaEncodedInputs, size_t stateArenaOctetSize);
+void rectifySpeculationDestroy(RectifySpeculation* self);
+void rectifySpeculationInvalidate(RectifySpeculation* self);
+void rectifySpeculationDiverge(RectifySpeculation* self);
+void rectifySpeculationCheckAuthoritative(RectifySpeculation* self, const TransmuteInput* authoritativeInput,
+                                          const RectifyInputHistoryEntry* mainInput, StepId stepId);
+RectifySpeculativeBranch* rectifySpeculationFindMatching(RectifySpeculation* self, StepId authoritativeStepId,
+                                                         StepId predictedStepId);
+void rectifySpeculationRestart(RectifySpeculation* self, size_t branchIndex, const RectifyStateArena* mainArena,
+                               StepId stepId);
+void rectifySpeculationSwapArena(RectifySpeculation* self, size_t branchIndex, RectifyStateArena* mainArena);
+int rectifySpeculationComposeInput(RectifySpeculation* self, size_t branchIndex, const TransmuteInput* mainInput,
+                                   const RectifyRemotePredictor* remotePredictor,
+                                   const TransmuteInput* lastAuthoritativeInput,
+                                   RectifySpeculativeRemoteInputFn customFn, void* customSelf, StepId stepId,
+                                   TransmuteInput* outInput);
+
+#endif
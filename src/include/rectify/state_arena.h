@@ -0,0 +1,41 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_STATE_ARENA_H
+#define RECTIFY_STATE_ARENA_H
+
+#include <rectify/dirty_ranges.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct ImprintAllocator;
+
+#define RECTIFY_STATE_ARENA_MAX_COUNT (1024)
+
+/// Page aligned memory for a simulation state, where the written pages are detected without help from the
+/// application. On Linux and macOS the pages are write protected, and the first write to a page is caught by a
+/// fault handler that marks the page and makes it writable again. The handler is installed with the first arena and
+/// the previous handler is restored when the last arena is destroyed. On other platforms, or when the pages could
+/// not be mapped, all pages are always reported as written.
+/// System calls must not write directly into the arena, since they fail on a write protected page.
+typedef struct RectifyStateArena {
+    uint8_t* octets;
+    size_t stateOctetSize; // as requested, the hashed size
+    size_t octetSize; // rounded up to a whole number of pages
+    size_t pageOctetSize;
+    bool isMapped;
+    bool isWriteTracked;
+    RectifyDirtyChunks writtenPages; // since the last rectifyStateArenaDirtyRanges(), set by the fault handler
+} RectifyStateArena;
+
+void rectifyStateArenaInit(RectifyStateArena* self, struct ImprintAllocator* allocator, size_t octetSize);
+void rectifyStateArenaDestroy(RectifyStateArena* self);
+void rectifyStateArenaCopy(RectifyStateArena* self, const uint8_t* source);
+void rectifyStateArenaCopyRanges(RectifyStateArena* self, const RectifyDirtyRange* ranges, size_t rangeCount,
+                                 const uint8_t* source);
+int rectifyStateArenaDirtyRanges(RectifyStateArena* self, RectifyDirtyRange* ranges, size_t maxRangeCount);
+void rectifyStateArenaForgetChanges(RectifyStateArena* self);
+
+#endif
@@ -0,0 +1,33 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_STATE_HASH_H
+#define RECTIFY_STATE_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <transmute/transmute.h>
+
+#define RECTIFY_STATE_HASH_LANE_COUNT (8)
+#define RECTIFY_STATE_HASH_STRIPE_OCTET_SIZE (RECTIFY_STATE_HASH_LANE_COUNT * 8)
+
+/// Incremental 64-bit state hash. Uses AVX2 or SSE2 when the compiler targets them, with a scalar fallback.
+/// All implementations produce the same hash, so it can be compared between client and server.
+/// The state is read as little endian 64-bit lanes.
+typedef struct RectifyStateHasher {
+    uint64_t lanes[RECTIFY_STATE_HASH_LANE_COUNT];
+    uint8_t buffer[RECTIFY_STATE_HASH_STRIPE_OCTET_SIZE];
+    size_t bufferedOctetCount;
+    size_t stripesInBlock;
+    uint64_t totalOctetCount;
+} RectifyStateHasher;
+
+void rectifyStateHasherInit(RectifyStateHasher* self);
+void rectifyStateHasherAdd(RectifyStateHasher* self, const uint8_t* octets, size_t octetCount);
+uint64_t rectifyStateHasherFinish(const RectifyStateHasher* self);
+
+uint64_t rectifyStateHash(const uint8_t* octets, size_t octetCount);
+uint64_t rectifyTransmuteStateHash(const TransmuteState* state);
+
+#endif
@@ -0,0 +1,43 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_STATS_H
+#define RECTIFY_STATS_H
+
+#include <stddef.h>
+
+/// Counters that are cheap enough to always be updated.
+/// They accumulate until reset with rectifyStatsReset(), except for the current authoritative backlog.
+typedef struct RectifyStats {
+    size_t updateCount;
+    size_t authoritativeTicks;
+    size_t predictionTicks;
+    size_t predictionResimulatedTicks; // predicted ticks for a StepId that had already been predicted
+    size_t predictionResets; // copy from the authoritative state
+    size_t predictionDirtyRangeResets; // predictionResets that only copied the changed ranges
+    size_t predictionDirtyRangeOctets; // octets copied by the predictionDirtyRangeResets
+    size_t predictionConfirmations; // authoritative steps matched the prediction, nothing was re-simulated
+    size_t authoritativeBacklog;
+    size_t maxAuthoritativeBacklog;
+    size_t duplicateAuthoritativeSteps;
+    size_t rejectedAuthoritativeSteps;
+    size_t rejectedPredictedSteps;
+    size_t cappedUpdates; // updates that could not consume the whole authoritative backlog
+    size_t speculativeTicks; // ticks of the speculative branches
+    size_t speculativeBranchAdoptions; // a speculative branch matched the authoritative steps, nothing was re-simulated
+    size_t verifiedCheckpoints; // authoritative state hash was the same as the server hash
+    size_t desyncedCheckpoints;
+    size_t authoritativeSnapshots; // authoritative state set from a snapshot
+    size_t authoritativeSnapshotSkippedSteps; // steps that did not have to be ticked thanks to the snapshots
+    size_t predictionWindowTicks; // the current effective prediction window
+    size_t predictionWindowChanges;
+    size_t inputDelayTicks; // the current local input delay
+    size_t inputDelayChanges;
+    size_t slicedResimulations; // re-simulations that were spread over the updates
+    size_t slicedResimulationUpdates; // updates used by the slicedResimulations
+} RectifyStats;
+
+void rectifyStatsClear(RectifyStats* self);
+
+#endif
@@ -0,0 +1,40 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_TIME_SYNC_H
+#define RECTIFY_TIME_SYNC_H
+
+#include <nimble-steps/steps.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RECTIFY_TIME_SYNC_NORMAL_PERMILLE (1000u)
+
+typedef struct RectifyTimeSyncSetup {
+    size_t targetLeadTicks; // predicted ticks wanted ahead of the arriving authoritative steps, zero disables
+    size_t maxDilationPermille; // zero means the default of 30, e.g. tick durations from 0.970 to 1.030
+    size_t permillePerTick; // dilation for each tick that the lead is off from the target, zero means 10
+    size_t smoothingUpdates; // the measured lead is averaged over about this many updates, zero means 8
+} RectifyTimeSyncSetup;
+
+/// Recommends a local tick duration that slowly moves the prediction lead to the target.
+/// The lead is only measured when authoritative steps arrive, it is smoothed in 1/256 of a tick.
+typedef struct RectifyTimeSync {
+    RectifyTimeSyncSetup setup;
+    bool isEnabled;
+    bool hasPredicted;
+    StepId newestPredictedStepId;
+    bool hasMeasured;
+    int32_t lastLeadTicks;
+    int32_t smoothedLeadFraction;
+    uint32_t tickDurationPermille;
+} RectifyTimeSync;
+
+void rectifyTimeSyncInit(RectifyTimeSync* self, RectifyTimeSyncSetup setup);
+void rectifyTimeSyncReInit(RectifyTimeSync* self);
+void rectifyTimeSyncAddPredicted(RectifyTimeSync* self, StepId stepId);
+uint32_t rectifyTimeSyncAddAuthoritative(RectifyTimeSync* self, StepId authoritativeStepId);
+
+#endif
@@ -0,0 +1,58 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_TRACE_H
+#define RECTIFY_TRACE_H
+
+#include <monotonic-time/monotonic_time.h>
+#include <nimble-steps/steps.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct ImprintAllocator;
+
+typedef enum RectifyTraceEventType {
+    RectifyTraceEventTypeUpdateBegin, // stepId: authoritative, a: authoritative backlog
+    RectifyTraceEventTypeUpdateEnd, // stepId: predicted, a: authoritative ticks, b: authoritative backlog
+    RectifyTraceEventTypeCatchUpCapped, // stepId: first waiting authoritative, a: backlog, b: backlog before update
+    RectifyTraceEventTypePredictionConfirmed, // stepId: authoritative, a: predicted
+    RectifyTraceEventTypePredictionReset, // stepId: authoritative, a: predicted before the reset
+    RectifyTraceEventTypeAuthoritativeStepAdded, // stepId: added step
+    RectifyTraceEventTypeAuthoritativeStepRejected, // stepId: rejected step, a: error code
+    RectifyTraceEventTypePredictedStepAdded, // stepId: added step
+    RectifyTraceEventTypePredictedStepRejected, // stepId: rejected step, a: error code
+    RectifyTraceEventTypePredictionBranchAdopted, // stepId: authoritative, a: branch index, b: predicted
+    RectifyTraceEventTypeDesync, // stepId: checkpoint where the authoritative state hash differed from the server
+    RectifyTraceEventTypeAuthoritativeSnapshot, // stepId: snapshot, a: skipped steps, b: discarded queued steps
+    RectifyTraceEventTypePredictionWindowChanged, // stepId: authoritative, a: effective window, b: measured lead
+    RectifyTraceEventTypeInputDelayChanged, // stepId: authoritative, a: input delay, b: re-simulation cost in us
+    RectifyTraceEventTypeResimulationCompleted, // stepId: predicted, a: updates used, b: ticks
+} RectifyTraceEventType;
+
+typedef struct RectifyTraceEvent {
+    MonotonicTimeMs time;
+    StepId stepId;
+    uint32_t a;
+    uint32_t b;
+    uint8_t type;
+} RectifyTraceEvent;
+
+/// Fixed size ring of compact binary events. When full, the oldest events are overwritten.
+typedef struct RectifyTrace {
+    RectifyTraceEvent* events;
+    size_t capacity;
+    size_t writeIndex;
+    size_t count;
+} RectifyTrace;
+
+void rectifyTraceInit(RectifyTrace* self, struct ImprintAllocator* allocator, size_t capacity);
+void rectifyTraceClear(RectifyTrace* self);
+void rectifyTraceAdd(RectifyTrace* self, RectifyTraceEventType type, StepId stepId, uint32_t a, uint32_t b);
+const RectifyTraceEvent* rectifyTraceEventAt(const RectifyTrace* self, size_t index);
+const char* rectifyTraceEventTypeToString(RectifyTraceEventType type);
+int rectifyTraceToString(const RectifyTrace* self, char* target, size_t maxTargetOctetSize);
+int rectifyTraceToChromeTraceJson(const RectifyTrace* self, char* target, size_t maxTargetOctetSize);
+
+#endif
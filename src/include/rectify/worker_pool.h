@@ -0,0 +1,46 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#ifndef RECTIFY_WORKER_POOL_H
+#define RECTIFY_WORKER_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct ImprintAllocator;
+struct Rectify;
+struct RectifyWorkerPoolThreads;
+
+typedef struct RectifyUpdateResult {
+    uint64_t elapsedMicroseconds; // coarse, whole milliseconds, on platforms without thread support
+    size_t workerIndex; // zero is the thread calling rectifyUpdateMany()
+    bool isDone;
+} RectifyUpdateResult;
+
+/// Updates independent Rectify instances in parallel.
+/// Every worker gets its own deque with an equal share of the instances. A worker takes instances from the front of
+/// its own deque, and when that is empty, steals the back half of the deque of another worker. That way slow
+/// instances do not hold up the others, and the workers only contend on a lock when they steal.
+/// The calling thread works as well, so a pool without threads updates all instances on the calling thread.
+typedef struct RectifyWorkerPool {
+    struct RectifyWorkerPoolThreads* threads;
+    size_t threadCount;
+    RectifyUpdateResult* results;
+    size_t maxInstanceCount;
+    struct Rectify** instances;
+    size_t instanceCount;
+    size_t stolenCount; // instances that were stolen from another worker in the last rectifyUpdateMany()
+    uint64_t elapsedMicroseconds; // the whole last rectifyUpdateMany()
+    bool isShuttingDown;
+} RectifyWorkerPool;
+
+int rectifyWorkerPoolInit(RectifyWorkerPool* self, struct ImprintAllocator* allocator, size_t threadCount,
+                          size_t maxInstanceCount);
+void rectifyWorkerPoolDestroy(RectifyWorkerPool* self);
+const RectifyUpdateResult* rectifyWorkerPoolResult(const RectifyWorkerPool* self, size_t instanceIndex);
+
+int rectifyUpdateMany(struct Rectify** instances, size_t count, RectifyWorkerPool* pool);
+
+#endif
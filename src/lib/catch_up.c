@@ -0,0 +1,148 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <rectify/catch_up.h>
+#include <stdint.h>
+#include <tiny-libc/tiny_libc.h>
+
+#define RECTIFY_CATCH_UP_DEFAULT_MAX_TICKS (20u)
+#define RECTIFY_CATCH_UP_MEASURE_WINDOW (256u)
+#define RECTIFY_CATCH_UP_PROBE_CHUNK (8u)
+
+void rectifyCatchUpInit(RectifyCatchUp* self, RectifyCatchUpSetup setup)
+{
+    if (setup.maxTicksPerUpdate == 0) {
+        setup.maxTicksPerUpdate = setup.mode == RectifyCatchUpModeTickCount ? RECTIFY_CATCH_UP_DEFAULT_MAX_TICKS
+                                                                            : SIZE_MAX;
+    }
+    if (setup.minTicksPerUpdate == 0) {
+        setup.minTicksPerUpdate = 1;
+    }
+    if (setup.minTicksPerUpdate > setup.maxTicksPerUpdate) {
+        setup.minTicksPerUpdate = setup.maxTicksPerUpdate;
+    }
+    self->setup = setup;
+    self->measuredTicks = 0;
+    self->measuredMs = 0;
+    self->ticksLeftThisUpdate = 0;
+    tc_mem_clear_type(&self->report);
+}
+
+static size_t rectifyCatchUpTickCostMicroseconds(const RectifyCatchUp* self)
+{
+    if (self->measuredTicks == 0) {
+        return 0;
+    }
+
+    return (size_t) self->measuredMs * 1000u / self->measuredTicks;
+}
+
+/// Number of ticks that should fit in the time budget, given the measured tick cost.
+/// If the cost is not known yet, a small chunk is returned so the cost can be measured.
+static size_t rectifyCatchUpTicksInBudget(const RectifyCatchUp* self, MonotonicTimeMs budgetMs)
+{
+    size_t tickCost = rectifyCatchUpTickCostMicroseconds(self);
+    if (budgetMs <= 0) {
+        return 0;
+    }
+    if (tickCost == 0) {
+        return RECTIFY_CATCH_UP_PROBE_CHUNK;
+    }
+
+    return (size_t) budgetMs * 1000u / tickCost;
+}
+
+void rectifyCatchUpBegin(RectifyCatchUp* self, size_t backlog)
+{
+    self->updateStartedAt = monotonicTimeMsNow();
+    self->report.backlogBeforeUpdate = backlog;
+    self->report.ticksLastUpdate = 0;
+
+    size_t maxTicks = self->setup.maxTicksPerUpdate;
+    if (self->setup.mode == RectifyCatchUpModeAdaptive) {
+        // Try to consume half of the backlog each update, so a large backlog is caught up with in a few updates
+        size_t wanted = backlog / 2u + self->setup.minTicksPerUpdate;
+        size_t affordable = self->setup.timeBudgetMs > 0
+                                ? rectifyCatchUpTicksInBudget(self, self->setup.timeBudgetMs)
+                                : self->setup.maxTicksPerUpdate;
+        if (affordable < self->setup.minTicksPerUpdate) {
+            affordable = self->setup.minTicksPerUpdate;
+        }
+        maxTicks = wanted < affordable ? wanted : affordable;
+        if (maxTicks > self->setup.maxTicksPerUpdate) {
+            maxTicks = self->setup.maxTicksPerUpdate;
+        }
+    }
+
+    self->ticksLeftThisUpdate = maxTicks;
+}
+
+/// Returns the maximum number of ticks to execute in the next chunk, zero if the update is done
+size_t rectifyCatchUpNextChunk(RectifyCatchUp* self)
+{
+    if (self->ticksLeftThisUpdate == 0) {
+        return 0;
+    }
+
+    if (self->setup.mode != RectifyCatchUpModeTimeBudget) {
+        // Tick count and adaptive are decided up front, and done in one chunk
+        return self->ticksLeftThisUpdate;
+    }
+
+    MonotonicTimeMs elapsed = monotonicTimeMsNow() - self->updateStartedAt;
+    size_t chunk = rectifyCatchUpTicksInBudget(self, self->setup.timeBudgetMs - elapsed);
+    if (chunk == 0) {
+        return 0;
+    }
+
+    return chunk < self->ticksLeftThisUpdate ? chunk : self->ticksLeftThisUpdate;
+}
+
+void rectifyCatchUpChunkDone(RectifyCatchUp* self, size_t ticksExecuted)
+{
+    self->report.ticksLastUpdate += ticksExecuted;
+    self->ticksLeftThisUpdate = ticksExecuted < self->ticksLeftThisUpdate ? self->ticksLeftThisUpdate - ticksExecuted
+                                                                          : 0;
+    if (ticksExecuted == 0) {
+        self->ticksLeftThisUpdate = 0;
+    }
+}
+
+void rectifyCatchUpEnd(RectifyCatchUp* self, size_t backlog)
+{
+    MonotonicTimeMs elapsed = monotonicTimeMsNow() - self->updateStartedAt;
+
+    self->report.backlogAfterUpdate = backlog;
+    self->report.elapsedMsLastUpdate = elapsed;
+    self->report.wasCappedLastUpdate = backlog > 0;
+
+    if (self->report.ticksLastUpdate > 0) {
+        // The timer only has millisecond resolution, so the cost is accumulated over many ticks
+        self->measuredTicks += self->report.ticksLastUpdate;
+        self->measuredMs += elapsed;
+        if (self->measuredTicks > RECTIFY_CATCH_UP_MEASURE_WINDOW) {
+            self->measuredTicks /= 2u;
+            self->measuredMs /= 2;
+        }
+    }
+
+    self->report.tickCostMicroseconds = rectifyCatchUpTickCostMicroseconds(self);
+}
+
+/// Checks if jumping to a snapshot is better than ticking `stepsBehind` steps.
+/// The tick time is estimated from the measured tick cost, so it is only used after some steps have been ticked.
+bool rectifyCatchUpPrefersSnapshot(const RectifyCatchUp* self, const RectifySnapshotPolicy* policy,
+                                   size_t stepsBehind)
+{
+    if (policy->minStepsBehind > 0 && stepsBehind >= policy->minStepsBehind) {
+        return true;
+    }
+
+    size_t tickCost = rectifyCatchUpTickCostMicroseconds(self);
+    if (policy->maxCatchUpMs <= 0 || tickCost == 0) {
+        return false;
+    }
+
+    return stepsBehind * tickCost / 1000u > (size_t) policy->maxCatchUpMs;
+}
@@ -0,0 +1,87 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <imprint/allocator.h>
+#include <rectify/desync.h>
+#include <tiny-libc/tiny_libc.h>
+
+void rectifyDesyncInit(RectifyDesync* self, struct ImprintAllocator* allocator, RectifyDesyncSetup setup)
+{
+    self->checkpointInterval = setup.checkpointInterval;
+    self->capacity = setup.maxCheckpointCount > 0 ? setup.maxCheckpointCount : 64;
+    self->checkpoints = IMPRINT_ALLOC_TYPE_COUNT(allocator, RectifyDesyncCheckpoint, self->capacity);
+    rectifyDesyncReInit(self);
+}
+
+void rectifyDesyncReInit(RectifyDesync* self)
+{
+    for (size_t i = 0; i < self->capacity; ++i) {
+        self->checkpoints[i].isValid = false;
+    }
+    tc_mem_clear_type(&self->report);
+}
+
+bool rectifyDesyncIsCheckpoint(const RectifyDesync* self, StepId stepId)
+{
+    return self->checkpointInterval > 0 && (stepId % self->checkpointInterval) == 0;
+}
+
+/// Returns the checkpoint for the StepId, an older checkpoint in the same slot that never got both hashes is dropped
+static RectifyDesyncCheckpoint* rectifyDesyncCheckpoint(RectifyDesync* self, StepId stepId)
+{
+    RectifyDesyncCheckpoint* checkpoint = &self->checkpoints[(stepId / self->checkpointInterval) % self->capacity];
+    if (!checkpoint->isValid || checkpoint->stepId != stepId) {
+        checkpoint->stepId = stepId;
+        checkpoint->isValid = true;
+        checkpoint->hasLocalHash = false;
+        checkpoint->hasServerHash = false;
+    }
+
+    return checkpoint;
+}
+
+static RectifyDesyncResult rectifyDesyncCompare(RectifyDesync* self, RectifyDesyncCheckpoint* checkpoint)
+{
+    if (!checkpoint->hasLocalHash || !checkpoint->hasServerHash) {
+        return RectifyDesyncResultPending;
+    }
+
+    checkpoint->isValid = false;
+    RectifyDesyncReport* report = &self->report;
+
+    if (checkpoint->localHash == checkpoint->serverHash) {
+        if (!report->hasVerified || checkpoint->stepId > report->lastVerifiedStepId) {
+            report->lastVerifiedStepId = checkpoint->stepId;
+            report->hasVerified = true;
+        }
+        return RectifyDesyncResultVerified;
+    }
+
+    if (!report->hasDesynced || checkpoint->stepId < report->firstDesyncStepId) {
+        report->firstDesyncStepId = checkpoint->stepId;
+        report->localHash = checkpoint->localHash;
+        report->serverHash = checkpoint->serverHash;
+        report->hasDesynced = true;
+    }
+
+    return RectifyDesyncResultDesynced;
+}
+
+RectifyDesyncResult rectifyDesyncAddLocal(RectifyDesync* self, StepId stepId, uint64_t hash)
+{
+    RectifyDesyncCheckpoint* checkpoint = rectifyDesyncCheckpoint(self, stepId);
+    checkpoint->localHash = hash;
+    checkpoint->hasLocalHash = true;
+
+    return rectifyDesyncCompare(self, checkpoint);
+}
+
+RectifyDesyncResult rectifyDesyncAddServer(RectifyDesync* self, StepId stepId, uint64_t hash)
+{
+    RectifyDesyncCheckpoint* checkpoint = rectifyDesyncCheckpoint(self, stepId);
+    checkpoint->serverHash = hash;
+    checkpoint->hasServerHash = true;
+
+    return rectifyDesyncCompare(self, checkpoint);
+}
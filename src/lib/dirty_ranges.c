@@ -0,0 +1,141 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <imprint/allocator.h>
+#include <rectify/dirty_ranges.h>
+#include <tiny-libc/tiny_libc.h>
+
+void rectifyDirtyChunksInit(RectifyDirtyChunks* self, struct ImprintAllocator* allocator, size_t maxStateOctetSize,
+                            size_t chunkOctetSize)
+{
+    self->chunkOctetSize = chunkOctetSize;
+    self->maxStateOctetSize = maxStateOctetSize;
+    self->chunkCount = (maxStateOctetSize + chunkOctetSize - 1) / chunkOctetSize;
+    self->wordCount = (self->chunkCount + 63) / 64;
+    self->bits = IMPRINT_ALLOC_TYPE_COUNT(allocator, uint64_t, self->wordCount);
+
+    // Nothing is known about the target state yet
+    rectifyDirtyChunksMarkAll(self);
+}
+
+void rectifyDirtyChunksMark(RectifyDirtyChunks* self, size_t offset, size_t octetCount)
+{
+    if (octetCount == 0 || offset >= self->maxStateOctetSize) {
+        return;
+    }
+
+    size_t lastOctet = offset + octetCount - 1;
+    if (lastOctet >= self->maxStateOctetSize) {
+        lastOctet = self->maxStateOctetSize - 1;
+    }
+
+    size_t lastChunk = lastOctet / self->chunkOctetSize;
+    for (size_t chunk = offset / self->chunkOctetSize; chunk <= lastChunk; ++chunk) {
+        self->bits[chunk / 64] |= (uint64_t) 1 << (chunk % 64);
+    }
+}
+
+void rectifyDirtyChunksMarkAll(RectifyDirtyChunks* self)
+{
+    tc_memset_octets(self->bits, 0xff, self->wordCount * sizeof(uint64_t));
+}
+
+void rectifyDirtyChunksClear(RectifyDirtyChunks* self)
+{
+    tc_mem_clear_type_n(self->bits, self->wordCount);
+}
+
+/// Converts the dirty chunks to ranges, adjacent chunks are joined into one range.
+/// Returns the number of ranges, or -1 if they do not fit in `ranges`.
+int rectifyDirtyChunksCollect(const RectifyDirtyChunks* self, RectifyDirtyRange* ranges, size_t maxRangeCount)
+{
+    size_t rangeCount = 0;
+    bool isInRange = false;
+
+    for (size_t wordIndex = 0; wordIndex < self->wordCount; ++wordIndex) {
+        uint64_t word = self->bits[wordIndex];
+        if ((word == 0 && !isInRange) || (word == UINT64_MAX && isInRange)) {
+            continue;
+        }
+        for (size_t bit = 0; bit < 64; ++bit) {
+            size_t chunk = wordIndex * 64 + bit;
+            if (chunk >= self->chunkCount) {
+                break;
+            }
+            bool isDirty = (word >> bit) & 1;
+            if (isDirty && !isInRange) {
+                if (rangeCount == maxRangeCount) {
+                    return -1;
+                }
+                ranges[rangeCount].offset = chunk * self->chunkOctetSize;
+                isInRange = true;
+            } else if (!isDirty && isInRange) {
+                ranges[rangeCount].octetCount = chunk * self->chunkOctetSize - ranges[rangeCount].offset;
+                rangeCount++;
+                isInRange = false;
+            }
+        }
+    }
+
+    if (isInRange) {
+        ranges[rangeCount].octetCount = self->maxStateOctetSize - ranges[rangeCount].offset;
+        rangeCount++;
+    }
+
+    return (int) rangeCount;
+}
+
+/// Sorts the ranges on offset and joins the ones that overlap or touch.
+/// Returns the new number of ranges.
+size_t rectifyDirtyRangesMerge(RectifyDirtyRange* ranges, size_t rangeCount)
+{
+    // The range lists are short and mostly sorted already, so insertion sort is fine
+    for (size_t i = 1; i < rangeCount; ++i) {
+        RectifyDirtyRange range = ranges[i];
+        size_t j = i;
+        while (j > 0 && ranges[j - 1].offset > range.offset) {
+            ranges[j] = ranges[j - 1];
+            j--;
+        }
+        ranges[j] = range;
+    }
+
+    size_t mergedCount = 0;
+    for (size_t i = 0; i < rangeCount; ++i) {
+        if (ranges[i].octetCount == 0) {
+            continue;
+        }
+        if (mergedCount > 0) {
+            RectifyDirtyRange* last = &ranges[mergedCount - 1];
+            size_t lastEnd = last->offset + last->octetCount;
+            if (ranges[i].offset <= lastEnd) {
+                size_t end = ranges[i].offset + ranges[i].octetCount;
+                if (end > lastEnd) {
+                    last->octetCount = end - last->offset;
+                }
+                continue;
+            }
+        }
+        ranges[mergedCount++] = ranges[i];
+    }
+
+    return mergedCount;
+}
+
+size_t rectifyDirtyRangesOctetCount(const RectifyDirtyRange* ranges, size_t rangeCount)
+{
+    size_t octetCount = 0;
+    for (size_t i = 0; i < rangeCount; ++i) {
+        octetCount += ranges[i].octetCount;
+    }
+    return octetCount;
+}
+
+void rectifyDirtyRangesCopy(const RectifyDirtyRange* ranges, size_t rangeCount, uint8_t* target,
+                            const uint8_t* source)
+{
+    for (size_t i = 0; i < rangeCount; ++i) {
+        tc_memcpy_octets(target + ranges[i].offset, source + ranges[i].offset, ranges[i].octetCount);
+    }
+}
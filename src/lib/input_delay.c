@@ -0,0 +1,152 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <rectify/input_delay.h>
+
+#include <tiny-libc/tiny_libc.h>
+
+#define RECTIFY_INPUT_DELAY_DEFAULT_ADAPT_AFTER_UPDATES (60u)
+#define RECTIFY_INPUT_DELAY_MEASUREMENT_MAX_AGE (8u) // periods until a measured cost is measured again
+
+void rectifyInputDelayInit(RectifyInputDelay* self, RectifyInputDelaySetup setup)
+{
+    if (setup.ticks > RECTIFY_INPUT_DELAY_MAX_TICKS) {
+        setup.ticks = RECTIFY_INPUT_DELAY_MAX_TICKS;
+    }
+    if (setup.maxTicks > RECTIFY_INPUT_DELAY_MAX_TICKS) {
+        setup.maxTicks = RECTIFY_INPUT_DELAY_MAX_TICKS;
+    }
+    if (setup.maxTicks < setup.ticks) {
+        setup.maxTicks = setup.ticks;
+    }
+    if (setup.adaptAfterUpdates == 0) {
+        setup.adaptAfterUpdates = RECTIFY_INPUT_DELAY_DEFAULT_ADAPT_AFTER_UPDATES;
+    }
+    self->setup = setup;
+    self->isAdaptive = setup.maxTicks > setup.ticks && setup.resimulationBudgetMicroseconds > 0;
+    rectifyInputDelayReInit(self);
+}
+
+void rectifyInputDelayReInit(RectifyInputDelay* self)
+{
+    self->ticks = self->setup.ticks;
+    self->hasMappedStep = false;
+    self->lastMappedStepId = 0;
+    self->localTickId = 0;
+    self->periodUpdateCount = 0;
+    self->periodResimulatedTicks = 0;
+    self->periodCorrectionCount = 0;
+    self->resimulatedTicksThisUpdate = 0;
+    self->lastResimulationCostMicroseconds = 0;
+    self->periodIndex = 0;
+    tc_mem_clear_type_n(self->costMicrosecondsForTicks, RECTIFY_INPUT_DELAY_MAX_TICKS + 1);
+    tc_mem_clear_type_n(self->measuredPeriodForTicks, RECTIFY_INPUT_DELAY_MAX_TICKS + 1);
+}
+
+/// Maps the local `tickId` to the predicted steps that should get its input.
+/// Returns the number of steps from `outFirstStepId`. It is two or more right after the delay grew, since the
+/// steps in between must have an input too, and zero right after the delay shrunk, since that step already has one.
+size_t rectifyInputDelayMap(RectifyInputDelay* self, StepId tickId, StepId* outFirstStepId)
+{
+    StepId delayedStepId = tickId + (StepId) self->ticks;
+    *outFirstStepId = delayedStepId;
+    self->localTickId = tickId;
+    if (!self->hasMappedStep) {
+        self->lastMappedStepId = delayedStepId;
+        self->hasMappedStep = true;
+        return 1;
+    }
+
+    if (delayedStepId <= self->lastMappedStepId) {
+        return 0;
+    }
+
+    // Only fill the gaps that the delay could have caused, a longer gap is a new start for the prediction
+    if (delayedStepId - self->lastMappedStepId - 1u <= self->setup.maxTicks) {
+        *outFirstStepId = self->lastMappedStepId + 1u;
+    }
+    self->lastMappedStepId = delayedStepId;
+
+    return delayedStepId - *outFirstStepId + 1u;
+}
+
+/// Returns true if an input delay is used and a local tick has been mapped. The prediction should not be ticked past
+/// `outTickId`, the steps after it only have the queued delayed inputs.
+bool rectifyInputDelayLocalTick(const RectifyInputDelay* self, StepId* outTickId)
+{
+    *outTickId = self->localTickId;
+    return self->setup.maxTicks > 0 && self->hasMappedStep;
+}
+
+/// Called for every predicted tick for a StepId that had already been predicted
+void rectifyInputDelayCountResimulatedTick(RectifyInputDelay* self)
+{
+    self->resimulatedTicksThisUpdate++;
+}
+
+static bool rectifyInputDelayMeasuredCost(const RectifyInputDelay* self, size_t ticks, size_t* outCostMicroseconds)
+{
+    size_t measuredPeriod = self->measuredPeriodForTicks[ticks];
+    *outCostMicroseconds = self->costMicrosecondsForTicks[ticks];
+    return measuredPeriod != 0 && self->periodIndex - measuredPeriod < RECTIFY_INPUT_DELAY_MEASUREMENT_MAX_AGE;
+}
+
+/// Adapts the delay after every RectifyInputDelaySetup::adaptAfterUpdates updates, from the re-simulation cost that
+/// was measured for each delay. A longer delay is tried when the cost is over the budget, and is only kept if it
+/// measured cheaper than the delay before it. A measured cost is trusted for a few periods, then tried again.
+/// A shorter delay can at most add one re-simulated tick to each correction, which bounds its cost when it has
+/// not been measured lately.
+/// @param tickCostMicroseconds measured cost of a simulation tick, zero if unknown
+/// Returns the current delay.
+size_t rectifyInputDelayUpdate(RectifyInputDelay* self, size_t tickCostMicroseconds)
+{
+    self->periodUpdateCount++;
+    self->periodResimulatedTicks += self->resimulatedTicksThisUpdate;
+    if (self->resimulatedTicksThisUpdate > 0) {
+        self->periodCorrectionCount++;
+    }
+    self->resimulatedTicksThisUpdate = 0;
+
+    if (!self->isAdaptive || self->periodUpdateCount < self->setup.adaptAfterUpdates) {
+        return self->ticks;
+    }
+
+    size_t costMicroseconds = self->periodResimulatedTicks * tickCostMicroseconds / self->periodUpdateCount;
+    size_t shorterDelayBoundMicroseconds = (self->periodResimulatedTicks + self->periodCorrectionCount) *
+                                           tickCostMicroseconds / self->periodUpdateCount;
+    self->lastResimulationCostMicroseconds = costMicroseconds;
+    self->periodUpdateCount = 0;
+    self->periodResimulatedTicks = 0;
+    self->periodCorrectionCount = 0;
+    self->periodIndex++;
+    self->costMicrosecondsForTicks[self->ticks] = costMicroseconds;
+    self->measuredPeriodForTicks[self->ticks] = self->periodIndex;
+
+    size_t shorterCostMicroseconds = 0;
+    bool hasShorter = self->ticks > self->setup.ticks;
+    bool hasMeasuredShorter = hasShorter &&
+                              rectifyInputDelayMeasuredCost(self, self->ticks - 1, &shorterCostMicroseconds);
+    size_t longerCostMicroseconds = 0;
+    bool hasMeasuredLonger = self->ticks < self->setup.maxTicks &&
+                             rectifyInputDelayMeasuredCost(self, self->ticks + 1, &longerCostMicroseconds);
+
+    if (hasMeasuredShorter && shorterCostMicroseconds <= costMicroseconds) {
+        // The longer delay did not make the re-simulations cheaper, so it only added latency
+        self->ticks--;
+    } else if (costMicroseconds > self->setup.resimulationBudgetMicroseconds) {
+        if (self->ticks < self->setup.maxTicks && (!hasMeasuredLonger || longerCostMicroseconds < costMicroseconds)) {
+            self->ticks++;
+        }
+    } else if (hasShorter) {
+        if (!hasMeasuredShorter || shorterDelayBoundMicroseconds < shorterCostMicroseconds) {
+            shorterCostMicroseconds = shorterDelayBoundMicroseconds;
+        }
+        // Some headroom, so the delay does not flip back and forth around the budget
+        if (shorterCostMicroseconds * 4u <= self->setup.resimulationBudgetMicroseconds * 3u) {
+            self->ticks--;
+        }
+    }
+
+    return self->ticks;
+}
@@ -0,0 +1,591 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <imprint/allocator.h>
+#include <rectify/input_history.h>
+#include <tiny-libc/tiny_libc.h>
+
+// Keeps the participant inputs in the compact ring aligned
+#define RECTIFY_INPUT_HISTORY_RING_ALIGNMENT (sizeof(uint64_t))
+
+static size_t rectifyInputHistoryAlign(size_t octetCount)
+{
+    return (octetCount + RECTIFY_INPUT_HISTORY_RING_ALIGNMENT - 1) & ~(RECTIFY_INPUT_HISTORY_RING_ALIGNMENT - 1);
+}
+
+/// @param compactOctetSize octet budget for the compact byte ring, zero reserves a fixed slot for every step
+/// @param useDeltaEncoding delta encodes the participant inputs, only used for compact histories
+void rectifyInputHistoryInit(RectifyInputHistory* self, struct ImprintAllocator* allocator, size_t capacity,
+                             size_t maxParticipantCount, size_t maxOctetSizeForSingleParticipant,
+                             size_t compactOctetSize, bool useDeltaEncoding)
+{
+    self->capacity = capacity;
+    self->maxParticipantCount = maxParticipantCount;
+    self->maxOctetSizeForSingleParticipant = maxOctetSizeForSingleParticipant;
+    self->entries = IMPRINT_ALLOC_TYPE_COUNT(allocator, RectifyInputHistoryEntry, capacity);
+    self->isCompact = compactOctetSize > 0;
+
+    if (self->isCompact) {
+        self->ringOctetSize = rectifyInputHistoryAlign(compactOctetSize);
+        self->ring = (uint8_t*) IMPRINT_ALLOC_TYPE_COUNT(allocator, uint64_t,
+                                                         self->ringOctetSize / RECTIFY_INPUT_HISTORY_RING_ALIGNMENT);
+        // Rewritten steps leave stale regions behind, until they are dropped
+        self->ringRegionCapacity = capacity * 2;
+        self->ringRegions = IMPRINT_ALLOC_TYPE_COUNT(allocator, RectifyInputHistoryRingRegion,
+                                                     self->ringRegionCapacity);
+        self->participantInputs = 0;
+        self->payloads = 0;
+        for (size_t i = 0; i < capacity; ++i) {
+            RectifyInputHistoryEntry* entry = &self->entries[i];
+            entry->input.participantInputs = 0;
+            entry->input.participantCount = 0;
+            entry->payload = 0;
+        }
+    } else {
+        self->ring = 0;
+        self->ringOctetSize = 0;
+        self->ringRegions = 0;
+        self->ringRegionCapacity = 0;
+        self->participantInputs = IMPRINT_ALLOC_TYPE_COUNT(allocator, TransmuteParticipantInput,
+                                                           capacity * maxParticipantCount);
+        self->payloads = IMPRINT_ALLOC_TYPE_COUNT(allocator, uint8_t,
+                                                  capacity * maxParticipantCount * maxOctetSizeForSingleParticipant);
+
+        for (size_t i = 0; i < capacity; ++i) {
+            RectifyInputHistoryEntry* entry = &self->entries[i];
+            entry->input.participantInputs = &self->participantInputs[i * maxParticipantCount];
+            entry->input.participantCount = 0;
+            entry->payload = &self->payloads[i * maxParticipantCount * maxOctetSizeForSingleParticipant];
+        }
+    }
+
+    self->useDeltaEncoding = useDeltaEncoding && self->isCompact && maxOctetSizeForSingleParticipant <= UINT16_MAX;
+    if (self->useDeltaEncoding) {
+        self->encodedScratch = IMPRINT_ALLOC_TYPE_COUNT(allocator, RectifyEncodedParticipantInput,
+                                                        maxParticipantCount);
+        self->keyPayloadOffsetsScratch = IMPRINT_ALLOC_TYPE_COUNT(allocator, size_t, maxParticipantCount);
+        self->decodedParticipantInputs = IMPRINT_ALLOC_TYPE_COUNT(allocator, TransmuteParticipantInput,
+                                                                  maxParticipantCount);
+        self->decodedPayloads = IMPRINT_ALLOC_TYPE_COUNT(allocator, uint8_t,
+                                                         maxParticipantCount * maxOctetSizeForSingleParticipant);
+    } else {
+        self->encodedScratch = 0;
+        self->keyPayloadOffsetsScratch = 0;
+        self->decodedParticipantInputs = 0;
+        self->decodedPayloads = 0;
+    }
+
+    rectifyInputHistoryReInit(self);
+}
+
+void rectifyInputHistoryReInit(RectifyInputHistory* self)
+{
+    for (size_t i = 0; i < self->capacity; ++i) {
+        self->entries[i].isValid = false;
+        self->entries[i].hasHash = false;
+        self->entries[i].ringOctetCount = 0;
+    }
+    self->ringWriteOffset = 0;
+    self->ringRegionHead = 0;
+    self->ringRegionCount = 0;
+    self->evictedCount = 0;
+    self->writeCount = 0;
+    self->hasKey = false;
+}
+
+/// Returns the entry that still owns the region, or null if the region is stale
+static RectifyInputHistoryEntry* rectifyInputHistoryRegionEntry(RectifyInputHistory* self,
+                                                                const RectifyInputHistoryRingRegion* region)
+{
+    RectifyInputHistoryEntry* entry = &self->entries[region->entryIndex];
+    if (!entry->isValid || entry->ringOctetCount == 0 || entry->writeIndex != region->writeIndex) {
+        return 0;
+    }
+
+    return entry;
+}
+
+static void rectifyInputHistoryDropRegion(RectifyInputHistory* self)
+{
+    self->ringRegionHead = (self->ringRegionHead + 1) % self->ringRegionCapacity;
+    self->ringRegionCount--;
+}
+
+static void rectifyInputHistoryAppendRegion(RectifyInputHistory* self, const RectifyInputHistoryRingRegion* region)
+{
+    self->ringRegions[(self->ringRegionHead + self->ringRegionCount) % self->ringRegionCapacity] = *region;
+    self->ringRegionCount++;
+}
+
+/// Evicts the entry of the oldest region, if it still owns it
+static void rectifyInputHistoryPopRegion(RectifyInputHistory* self)
+{
+    RectifyInputHistoryEntry* entry = rectifyInputHistoryRegionEntry(self, &self->ringRegions[self->ringRegionHead]);
+    if (entry != 0) {
+        entry->isValid = false;
+        entry->ringOctetCount = 0;
+        self->evictedCount++;
+    }
+    rectifyInputHistoryDropRegion(self);
+}
+
+/// Invalidates the entries that have any part of their data in the ring range. The regions are queued in the order
+/// the write position reaches them, so the ones to evict are always at the head of the queue.
+static void rectifyInputHistoryEvict(RectifyInputHistory* self, size_t offset, size_t octetCount)
+{
+    if (offset < self->ringWriteOffset) {
+        // Wraps to the start, the regions after the write position are reached last in the new lap
+        while (self->ringRegionCount > 0) {
+            RectifyInputHistoryRingRegion region = self->ringRegions[self->ringRegionHead];
+            const RectifyInputHistoryEntry* entry = rectifyInputHistoryRegionEntry(self, &region);
+            if (entry != 0 && entry->ringOffset < self->ringWriteOffset) {
+                break;
+            }
+            rectifyInputHistoryDropRegion(self);
+            if (entry != 0) {
+                rectifyInputHistoryAppendRegion(self, &region);
+            }
+        }
+    }
+
+    while (self->ringRegionCount > 0) {
+        const RectifyInputHistoryEntry* entry = rectifyInputHistoryRegionEntry(
+            self, &self->ringRegions[self->ringRegionHead]);
+        bool overlaps = entry != 0 && entry->ringOffset < offset + octetCount &&
+                        offset < entry->ringOffset + entry->ringOctetCount;
+        if (entry != 0 && !overlaps) {
+            break;
+        }
+        rectifyInputHistoryPopRegion(self);
+    }
+}
+
+/// At most one region for each entry is not stale, so this leaves room for at least `capacity` more regions
+static void rectifyInputHistoryDropStaleRegions(RectifyInputHistory* self)
+{
+    size_t count = self->ringRegionCount;
+    self->ringRegionCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+        RectifyInputHistoryRingRegion region = self->ringRegions[(self->ringRegionHead + i) %
+                                                                 self->ringRegionCapacity];
+        if (rectifyInputHistoryRegionEntry(self, &region) != 0) {
+            rectifyInputHistoryAppendRegion(self, &region);
+        }
+    }
+}
+
+/// Queues the region that was just written for the entry
+static void rectifyInputHistoryPushRegion(RectifyInputHistory* self, const RectifyInputHistoryEntry* entry)
+{
+    if (entry->ringOctetCount == 0) {
+        return;
+    }
+    if (self->ringRegionCount == self->ringRegionCapacity) {
+        rectifyInputHistoryDropStaleRegions(self);
+    }
+    RectifyInputHistoryRingRegion region = {.entryIndex = (size_t) (entry - self->entries),
+                                            .writeIndex = entry->writeIndex};
+    rectifyInputHistoryAppendRegion(self, &region);
+}
+
+/// Stores the participant inputs followed by their payloads at the write position of the ring
+static int rectifyInputHistoryWriteCompact(RectifyInputHistory* self, RectifyInputHistoryEntry* entry,
+                                           const TransmuteInput* input)
+{
+    size_t participantInputsOctetSize = input->participantCount * sizeof(TransmuteParticipantInput);
+    size_t octetCount = participantInputsOctetSize;
+    for (size_t i = 0; i < input->participantCount; ++i) {
+        const TransmuteParticipantInput* source = &input->participantInputs[i];
+        if (source->octetSize > self->maxOctetSizeForSingleParticipant) {
+            return -2;
+        }
+        if (source->input != 0) {
+            octetCount += source->octetSize;
+        }
+    }
+    octetCount = rectifyInputHistoryAlign(octetCount);
+    if (octetCount > self->ringOctetSize) {
+        return -3;
+    }
+
+    entry->ringOctetCount = 0;
+    size_t offset = self->ringWriteOffset;
+    if (offset + octetCount > self->ringOctetSize) {
+        offset = 0;
+    }
+    rectifyInputHistoryEvict(self, offset, octetCount);
+
+    TransmuteParticipantInput* targets = (TransmuteParticipantInput*) (self->ring + offset);
+    uint8_t* payloadTarget = self->ring + offset + participantInputsOctetSize;
+    for (size_t i = 0; i < input->participantCount; ++i) {
+        const TransmuteParticipantInput* source = &input->participantInputs[i];
+        TransmuteParticipantInput* target = &targets[i];
+        *target = *source;
+        if (source->input != 0 && source->octetSize > 0) {
+            tc_memcpy_octets(payloadTarget, source->input, source->octetSize);
+            target->input = payloadTarget;
+            payloadTarget += source->octetSize;
+        } else {
+            target->input = 0;
+        }
+    }
+
+    entry->input.participantInputs = targets;
+    entry->payload = self->ring + offset + participantInputsOctetSize;
+    entry->ringOffset = offset;
+    entry->ringOctetCount = octetCount;
+    entry->writeIndex = self->writeCount++;
+    rectifyInputHistoryPushRegion(self, entry);
+    self->ringWriteOffset = offset + octetCount;
+
+    return 0;
+}
+
+/// Returns the key step, if it has not been evicted or overwritten since the delta was encoded
+static const RectifyInputHistoryEntry* rectifyInputHistoryKey(const RectifyInputHistory* self, StepId keyStepId,
+                                                              uint64_t keyWriteIndex)
+{
+    const RectifyInputHistoryEntry* key = &self->entries[keyStepId % self->capacity];
+    if (!key->isValid || key->stepId != keyStepId || key->writeIndex != keyWriteIndex) {
+        return 0;
+    }
+
+    return key;
+}
+
+/// Fills in where the payload of each participant in the key step starts in the ring
+static void rectifyInputHistoryKeyPayloadOffsets(RectifyInputHistory* self, const RectifyInputHistoryEntry* key)
+{
+    const RectifyEncodedParticipantInput* keyInputs = (const RectifyEncodedParticipantInput*) (self->ring +
+                                                                                               key->ringOffset);
+    size_t offset = key->ringOffset + key->input.participantCount * sizeof(RectifyEncodedParticipantInput);
+    for (size_t i = 0; i < key->input.participantCount; ++i) {
+        self->keyPayloadOffsetsScratch[i] = offset;
+        if (keyInputs[i].encoding == RectifyInputEncodingFull) {
+            offset += keyInputs[i].octetSize;
+        }
+    }
+}
+
+/// The participants are usually in the same order in every step, so the same index is tried first
+static int rectifyInputHistoryKeyIndex(const RectifyEncodedParticipantInput* keyInputs, size_t keyCount,
+                                       size_t index, uint8_t participantId)
+{
+    if (index < keyCount && keyInputs[index].participantId == participantId) {
+        return (int) index;
+    }
+
+    for (size_t i = 0; i < keyCount; ++i) {
+        if (keyInputs[i].participantId == participantId) {
+            return (int) i;
+        }
+    }
+
+    return -1;
+}
+
+/// How far back from the write position the offset is
+static size_t rectifyInputHistoryRingDistance(const RectifyInputHistory* self, size_t offset)
+{
+    return self->ringWriteOffset >= offset ? self->ringWriteOffset - offset
+                                           : self->ringOctetSize - offset + self->ringWriteOffset;
+}
+
+/// Encodes every participant input against the last key step. The step becomes a new key step if there is no
+/// usable key step, if RECTIFY_INPUT_HISTORY_KEY_INTERVAL steps have been written since the key step, or if the
+/// deltas would not save at least half of the payload octets.
+static int rectifyInputHistoryWriteEncoded(RectifyInputHistory* self, RectifyInputHistoryEntry* entry,
+                                           const TransmuteInput* input, StepId stepId)
+{
+    const RectifyInputHistoryEntry* key = self->hasKey ? rectifyInputHistoryKey(self, self->keyStepId,
+                                                                                self->keyWriteIndex)
+                                                       : 0;
+    // Keeps the key step from being evicted long before the steps that depend on it, or from getting too old
+    if (key != 0 && (rectifyInputHistoryRingDistance(self, key->ringOffset) > self->ringOctetSize / 2 ||
+                     self->writeCount - self->keyWriteIndex >= RECTIFY_INPUT_HISTORY_KEY_INTERVAL)) {
+        key = 0;
+    }
+
+    const RectifyEncodedParticipantInput* keyInputs = 0;
+    size_t keyCount = 0;
+    if (key != 0) {
+        keyInputs = (const RectifyEncodedParticipantInput*) (self->ring + key->ringOffset);
+        keyCount = key->input.participantCount;
+        rectifyInputHistoryKeyPayloadOffsets(self, key);
+    }
+
+    size_t fullOctetCount = 0;
+    size_t deltaOctetCount = 0;
+    for (size_t i = 0; i < input->participantCount; ++i) {
+        const TransmuteParticipantInput* source = &input->participantInputs[i];
+        if (source->octetSize > self->maxOctetSizeForSingleParticipant) {
+            return -2;
+        }
+        RectifyEncodedParticipantInput* encoded = &self->encodedScratch[i];
+        encoded->participantId = source->participantId;
+        encoded->localPartyId = source->localPartyId;
+        encoded->inputType = (uint8_t) source->inputType;
+        encoded->octetSize = (uint16_t) source->octetSize;
+        encoded->deltaOffset = 0;
+        encoded->deltaOctetCount = 0;
+        if (source->input == 0) {
+            encoded->encoding = RectifyInputEncodingNoPayload;
+            continue;
+        }
+        encoded->encoding = RectifyInputEncodingFull;
+        fullOctetCount += source->octetSize;
+
+        int keyIndex = key != 0 ? rectifyInputHistoryKeyIndex(keyInputs, keyCount, i, source->participantId) : -1;
+        if (keyIndex >= 0 && keyInputs[keyIndex].encoding == RectifyInputEncodingFull &&
+            keyInputs[keyIndex].octetSize == source->octetSize) {
+            const uint8_t* keyPayload = self->ring + self->keyPayloadOffsetsScratch[keyIndex];
+            const uint8_t* payload = (const uint8_t*) source->input;
+            size_t first = 0;
+            while (first < source->octetSize && payload[first] == keyPayload[first]) {
+                first++;
+            }
+            if (first == source->octetSize) {
+                encoded->encoding = RectifyInputEncodingSame;
+                continue;
+            }
+            size_t last = source->octetSize;
+            while (payload[last - 1] == keyPayload[last - 1]) {
+                last--;
+            }
+            encoded->encoding = RectifyInputEncodingXor;
+            encoded->deltaOffset = (uint16_t) first;
+            encoded->deltaOctetCount = (uint16_t) (last - first);
+            deltaOctetCount += last - first;
+            continue;
+        }
+        deltaOctetCount += source->octetSize;
+    }
+
+    size_t encodedOctetSize = input->participantCount * sizeof(RectifyEncodedParticipantInput);
+    bool isKey = key == 0 || deltaOctetCount * 2 > fullOctetCount;
+    size_t octetCount = rectifyInputHistoryAlign(encodedOctetSize + (isKey ? fullOctetCount : deltaOctetCount));
+    size_t offset = self->ringWriteOffset;
+    if (offset + octetCount > self->ringOctetSize) {
+        offset = 0;
+    }
+    if (!isKey && key->ringOffset < offset + octetCount && offset < key->ringOffset + key->ringOctetCount) {
+        // The deltas would overwrite the key step they depend on
+        isKey = true;
+        octetCount = rectifyInputHistoryAlign(encodedOctetSize + fullOctetCount);
+        offset = self->ringWriteOffset;
+        if (offset + octetCount > self->ringOctetSize) {
+            offset = 0;
+        }
+    }
+    if (octetCount > self->ringOctetSize) {
+        return -3;
+    }
+
+    entry->ringOctetCount = 0;
+    rectifyInputHistoryEvict(self, offset, octetCount);
+
+    RectifyEncodedParticipantInput* targets = (RectifyEncodedParticipantInput*) (self->ring + offset);
+    uint8_t* data = self->ring + offset + encodedOctetSize;
+    for (size_t i = 0; i < input->participantCount; ++i) {
+        const TransmuteParticipantInput* source = &input->participantInputs[i];
+        RectifyEncodedParticipantInput* encoded = &self->encodedScratch[i];
+        if (isKey && encoded->encoding != RectifyInputEncodingNoPayload) {
+            encoded->encoding = RectifyInputEncodingFull;
+        }
+        targets[i] = *encoded;
+
+        const uint8_t* payload = (const uint8_t*) source->input;
+        switch (encoded->encoding) {
+            case RectifyInputEncodingFull:
+                tc_memcpy_octets(data, payload, source->octetSize);
+                data += source->octetSize;
+                break;
+            case RectifyInputEncodingXor: {
+                int keyIndex = rectifyInputHistoryKeyIndex(keyInputs, keyCount, i, source->participantId);
+                const uint8_t* keyPayload = self->ring + self->keyPayloadOffsetsScratch[keyIndex];
+                for (size_t k = encoded->deltaOffset; k < (size_t) encoded->deltaOffset + encoded->deltaOctetCount;
+                     ++k) {
+                    *data++ = payload[k] ^ keyPayload[k];
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    entry->input.participantInputs = 0;
+    entry->payload = 0;
+    entry->ringOffset = offset;
+    entry->ringOctetCount = octetCount;
+    entry->writeIndex = self->writeCount++;
+    entry->isKey = isKey;
+    if (isKey) {
+        self->hasKey = true;
+        self->keyStepId = stepId;
+        self->keyWriteIndex = entry->writeIndex;
+    } else {
+        entry->keyStepId = self->keyStepId;
+        entry->keyWriteIndex = self->keyWriteIndex;
+    }
+    rectifyInputHistoryPushRegion(self, entry);
+    self->ringWriteOffset = offset + octetCount;
+
+    return 0;
+}
+
+/// Decodes into the scratch buffers. Full and unchanged payloads point directly into the ring.
+static void rectifyInputHistoryDecode(RectifyInputHistory* self, RectifyInputHistoryEntry* entry)
+{
+    const RectifyEncodedParticipantInput* encodedInputs = (const RectifyEncodedParticipantInput*) (self->ring +
+                                                                                                   entry->ringOffset);
+    size_t participantCount = entry->input.participantCount;
+    const uint8_t* data = self->ring + entry->ringOffset + participantCount * sizeof(RectifyEncodedParticipantInput);
+
+    const RectifyEncodedParticipantInput* keyInputs = 0;
+    size_t keyCount = 0;
+    if (!entry->isKey) {
+        const RectifyInputHistoryEntry* key = rectifyInputHistoryKey(self, entry->keyStepId, entry->keyWriteIndex);
+        keyInputs = (const RectifyEncodedParticipantInput*) (self->ring + key->ringOffset);
+        keyCount = key->input.participantCount;
+        rectifyInputHistoryKeyPayloadOffsets(self, key);
+    }
+
+    uint8_t* payloadTarget = self->decodedPayloads;
+    for (size_t i = 0; i < participantCount; ++i) {
+        const RectifyEncodedParticipantInput* encoded = &encodedInputs[i];
+        TransmuteParticipantInput* target = &self->decodedParticipantInputs[i];
+        target->participantId = encoded->participantId;
+        target->localPartyId = encoded->localPartyId;
+        target->inputType = (TransmuteParticipantInputType) encoded->inputType;
+        target->octetSize = encoded->octetSize;
+
+        switch (encoded->encoding) {
+            case RectifyInputEncodingFull:
+                target->input = data;
+                data += encoded->octetSize;
+                break;
+            case RectifyInputEncodingSame: {
+                int keyIndex = rectifyInputHistoryKeyIndex(keyInputs, keyCount, i, encoded->participantId);
+                target->input = self->ring + self->keyPayloadOffsetsScratch[keyIndex];
+                break;
+            }
+            case RectifyInputEncodingXor: {
+                int keyIndex = rectifyInputHistoryKeyIndex(keyInputs, keyCount, i, encoded->participantId);
+                tc_memcpy_octets(payloadTarget, self->ring + self->keyPayloadOffsetsScratch[keyIndex],
+                                 encoded->octetSize);
+                for (size_t k = encoded->deltaOffset; k < (size_t) encoded->deltaOffset + encoded->deltaOctetCount;
+                     ++k) {
+                    payloadTarget[k] ^= *data++;
+                }
+                target->input = payloadTarget;
+                payloadTarget += self->maxOctetSizeForSingleParticipant;
+                break;
+            }
+            default:
+                target->input = 0;
+                break;
+        }
+    }
+
+    entry->input.participantInputs = self->decodedParticipantInputs;
+    entry->payload = self->decodedPayloads;
+}
+
+int rectifyInputHistoryWrite(RectifyInputHistory* self, const TransmuteInput* input, StepId stepId)
+{
+    if (input->participantCount > self->maxParticipantCount) {
+        return -1;
+    }
+
+    RectifyInputHistoryEntry* entry = &self->entries[stepId % self->capacity];
+    entry->isValid = false;
+    entry->hasHash = false;
+
+    if (self->isCompact) {
+        int result = self->useDeltaEncoding ? rectifyInputHistoryWriteEncoded(self, entry, input, stepId)
+                                            : rectifyInputHistoryWriteCompact(self, entry, input);
+        if (result < 0) {
+            return result;
+        }
+        entry->input.participantCount = input->participantCount;
+        entry->stepId = stepId;
+        entry->isValid = true;
+        return 0;
+    }
+
+    uint8_t* payloadTarget = entry->payload;
+    for (size_t i = 0; i < input->participantCount; ++i) {
+        const TransmuteParticipantInput* source = &input->participantInputs[i];
+        TransmuteParticipantInput* target = &entry->input.participantInputs[i];
+        if (source->octetSize > self->maxOctetSizeForSingleParticipant) {
+            return -2;
+        }
+        *target = *source;
+        if (source->input != 0 && source->octetSize > 0) {
+            tc_memcpy_octets(payloadTarget, source->input, source->octetSize);
+            target->input = payloadTarget;
+        } else {
+            target->input = 0;
+        }
+        payloadTarget += self->maxOctetSizeForSingleParticipant;
+    }
+
+    entry->input.participantCount = input->participantCount;
+    entry->stepId = stepId;
+    entry->isValid = true;
+
+    return 0;
+}
+
+/// Checks if the step can be found, without decoding it
+bool rectifyInputHistoryHas(const RectifyInputHistory* self, StepId stepId)
+{
+    const RectifyInputHistoryEntry* entry = &self->entries[stepId % self->capacity];
+    if (!entry->isValid || entry->stepId != stepId) {
+        return false;
+    }
+
+    return !self->useDeltaEncoding || entry->isKey ||
+           rectifyInputHistoryKey(self, entry->keyStepId, entry->keyWriteIndex) != 0;
+}
+
+/// With delta encoding the returned input is only valid until the next find in the same history
+RectifyInputHistoryEntry* rectifyInputHistoryFind(RectifyInputHistory* self, StepId stepId)
+{
+    if (!rectifyInputHistoryHas(self, stepId)) {
+        return 0;
+    }
+
+    RectifyInputHistoryEntry* entry = &self->entries[stepId % self->capacity];
+    if (self->useDeltaEncoding) {
+        rectifyInputHistoryDecode(self, entry);
+    }
+
+    return entry;
+}
+
+/// Checks if two composed inputs would produce the same simulation.
+/// Participants must be in the same order, a different order is reported as not equal.
+/// localPartyId is ignored, since it is not used in prediction.
+bool rectifyInputIsEqual(const TransmuteInput* a, const TransmuteInput* b)
+{
+    if (a->participantCount != b->participantCount) {
+        return false;
+    }
+
+    for (size_t i = 0; i < a->participantCount; ++i) {
+        const TransmuteParticipantInput* pa = &a->participantInputs[i];
+        const TransmuteParticipantInput* pb = &b->participantInputs[i];
+        if (pa->participantId != pb->participantId || pa->inputType != pb->inputType ||
+            pa->octetSize != pb->octetSize) {
+            return false;
+        }
+        if (pa->octetSize > 0 && tc_memcmp(pa->input, pb->input, pa->octetSize) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,81 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <rectify/prediction_window.h>
+
+#define RECTIFY_PREDICTION_WINDOW_DEFAULT_SHRINK_AFTER_UPDATES (30u)
+
+/// @param maxTicks the preallocated maximum, usually RectifySetup::maxTicksFromAuthoritative
+void rectifyPredictionWindowInit(RectifyPredictionWindow* self, RectifyPredictionWindowSetup setup, size_t maxTicks)
+{
+    if (setup.minTicks > maxTicks) {
+        setup.minTicks = maxTicks;
+    }
+    if (setup.shrinkAfterUpdates == 0) {
+        setup.shrinkAfterUpdates = RECTIFY_PREDICTION_WINDOW_DEFAULT_SHRINK_AFTER_UPDATES;
+    }
+    self->setup = setup;
+    self->isEnabled = setup.minTicks > 0;
+    self->maxTicks = maxTicks;
+    rectifyPredictionWindowReInit(self);
+}
+
+/// Starts over from the maximum window, since nothing is known about the latency yet
+void rectifyPredictionWindowReInit(RectifyPredictionWindow* self)
+{
+    self->effectiveTicks = self->maxTicks;
+    self->lastLeadTicks = 0;
+    self->shrinkCandidateCount = 0;
+    self->shrinkCandidateTicks = 0;
+}
+
+static size_t rectifyPredictionWindowNeededTicks(const RectifyPredictionWindow* self, size_t leadTicks)
+{
+    size_t neededTicks = leadTicks + self->setup.marginTicks;
+    if (neededTicks < self->setup.minTicks) {
+        return self->setup.minTicks;
+    }
+    if (neededTicks > self->maxTicks) {
+        return self->maxTicks;
+    }
+
+    return neededTicks;
+}
+
+/// Adds a measurement of how many predicted steps were waiting when the authoritative steps arrived.
+/// A full window means that the prediction may have stalled, and the real lead is unknown, so it grows by at least one.
+/// Returns the effective window.
+size_t rectifyPredictionWindowAddLead(RectifyPredictionWindow* self, size_t leadTicks)
+{
+    self->lastLeadTicks = leadTicks;
+    if (!self->isEnabled) {
+        return self->effectiveTicks;
+    }
+
+    if (leadTicks >= self->effectiveTicks) {
+        leadTicks = self->effectiveTicks + 1;
+    }
+    size_t neededTicks = rectifyPredictionWindowNeededTicks(self, leadTicks);
+    if (neededTicks > self->effectiveTicks) {
+        // Growing late means that the prediction stalls, so it is done right away
+        self->effectiveTicks = neededTicks;
+        self->shrinkCandidateCount = 0;
+        return self->effectiveTicks;
+    }
+
+    if (neededTicks + self->setup.shrinkHysteresisTicks > self->effectiveTicks) {
+        self->shrinkCandidateCount = 0;
+        return self->effectiveTicks;
+    }
+
+    if (self->shrinkCandidateCount == 0 || neededTicks > self->shrinkCandidateTicks) {
+        self->shrinkCandidateTicks = neededTicks;
+    }
+    if (++self->shrinkCandidateCount >= self->setup.shrinkAfterUpdates) {
+        self->effectiveTicks = self->shrinkCandidateTicks;
+        self->shrinkCandidateCount = 0;
+    }
+
+    return self->effectiveTicks;
+}
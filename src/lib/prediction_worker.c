@@ -0,0 +1,181 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#if (defined TORNADO_OS_LINUX || defined TORNADO_OS_MACOS) && !defined __EMSCRIPTEN__
+#define RECTIFY_PREDICTION_WORKER_USE_THREAD
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#endif
+
+#include <imprint/allocator.h>
+#include <rectify/prediction_worker.h>
+
+#if defined RECTIFY_PREDICTION_WORKER_USE_THREAD
+
+typedef struct RectifyPredictionWorkerThread {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t jobAvailable;
+    pthread_cond_t jobDone;
+    bool hasJob;
+    bool isShuttingDown;
+} RectifyPredictionWorkerThread;
+
+static void* rectifyPredictionWorkerThread(void* _self)
+{
+    RectifyPredictionWorker* self = (RectifyPredictionWorker*) _self;
+    RectifyPredictionWorkerThread* thread = self->thread;
+
+    pthread_mutex_lock(&thread->mutex);
+    for (;;) {
+        while (!thread->hasJob && !thread->isShuttingDown) {
+            pthread_cond_wait(&thread->jobAvailable, &thread->mutex);
+        }
+        if (thread->isShuttingDown) {
+            break;
+        }
+        pthread_mutex_unlock(&thread->mutex);
+        self->jobFn(self->jobSelf);
+        pthread_mutex_lock(&thread->mutex);
+        thread->hasJob = false;
+        pthread_cond_broadcast(&thread->jobDone);
+    }
+    pthread_mutex_unlock(&thread->mutex);
+
+    return 0;
+}
+
+static RectifyPredictionWorkerThread* rectifyPredictionWorkerStartThread(RectifyPredictionWorker* self,
+                                                                         struct ImprintAllocator* allocator)
+{
+    RectifyPredictionWorkerThread* thread = IMPRINT_ALLOC_TYPE(allocator, RectifyPredictionWorkerThread);
+    pthread_mutex_init(&thread->mutex, 0);
+    pthread_cond_init(&thread->jobAvailable, 0);
+    pthread_cond_init(&thread->jobDone, 0);
+    thread->hasJob = false;
+    thread->isShuttingDown = false;
+    self->thread = thread;
+
+    if (pthread_create(&thread->thread, 0, rectifyPredictionWorkerThread, self) != 0) {
+        pthread_cond_destroy(&thread->jobDone);
+        pthread_cond_destroy(&thread->jobAvailable);
+        pthread_mutex_destroy(&thread->mutex);
+        self->thread = 0;
+        return 0;
+    }
+
+    return thread;
+}
+
+void rectifyPredictionWorkerDestroy(RectifyPredictionWorker* self)
+{
+    RectifyPredictionWorkerThread* thread = self->thread;
+    if (thread == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&thread->mutex);
+    while (thread->hasJob) {
+        pthread_cond_wait(&thread->jobDone, &thread->mutex);
+    }
+    thread->isShuttingDown = true;
+    pthread_cond_broadcast(&thread->jobAvailable);
+    pthread_mutex_unlock(&thread->mutex);
+
+    pthread_join(thread->thread, 0);
+    pthread_cond_destroy(&thread->jobDone);
+    pthread_cond_destroy(&thread->jobAvailable);
+    pthread_mutex_destroy(&thread->mutex);
+    self->thread = 0;
+}
+
+/// Starts the job on the worker thread. The previous job must have been fenced.
+void rectifyPredictionWorkerKick(RectifyPredictionWorker* self)
+{
+    RectifyPredictionWorkerThread* thread = self->thread;
+    if (thread == 0) {
+        self->jobFn(self->jobSelf);
+        return;
+    }
+
+    pthread_mutex_lock(&thread->mutex);
+    thread->hasJob = true;
+    pthread_cond_signal(&thread->jobAvailable);
+    pthread_mutex_unlock(&thread->mutex);
+}
+
+/// Waits until the current job, if any, is done
+void rectifyPredictionWorkerFence(const RectifyPredictionWorker* self)
+{
+    RectifyPredictionWorkerThread* thread = self->thread;
+    if (thread == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&thread->mutex);
+    while (thread->hasJob) {
+        pthread_cond_wait(&thread->jobDone, &thread->mutex);
+    }
+    pthread_mutex_unlock(&thread->mutex);
+}
+
+bool rectifyPredictionWorkerIsBusy(const RectifyPredictionWorker* self)
+{
+    RectifyPredictionWorkerThread* thread = self->thread;
+    if (thread == 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&thread->mutex);
+    bool isBusy = thread->hasJob;
+    pthread_mutex_unlock(&thread->mutex);
+
+    return isBusy;
+}
+
+#else
+
+static struct RectifyPredictionWorkerThread* rectifyPredictionWorkerStartThread(RectifyPredictionWorker* self,
+                                                                                struct ImprintAllocator* allocator)
+{
+    (void) self;
+    (void) allocator;
+
+    return 0;
+}
+
+void rectifyPredictionWorkerDestroy(RectifyPredictionWorker* self)
+{
+    (void) self;
+}
+
+void rectifyPredictionWorkerKick(RectifyPredictionWorker* self)
+{
+    self->jobFn(self->jobSelf);
+}
+
+void rectifyPredictionWorkerFence(const RectifyPredictionWorker* self)
+{
+    (void) self;
+}
+
+bool rectifyPredictionWorkerIsBusy(const RectifyPredictionWorker* self)
+{
+    (void) self;
+    return false;
+}
+
+#endif
+
+void rectifyPredictionWorkerInit(RectifyPredictionWorker* self, struct ImprintAllocator* allocator, bool useThread,
+                                 RectifyPredictionJobFn jobFn, void* jobSelf)
+{
+    self->thread = 0;
+    self->jobFn = jobFn;
+    self->jobSelf = jobSelf;
+
+    if (useThread) {
+        rectifyPredictionWorkerStartThread(self, allocator);
+    }
+}
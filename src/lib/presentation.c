@@ -0,0 +1,92 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <imprint/allocator.h>
+#include <rectify/presentation.h>
+#include <tiny-libc/tiny_libc.h>
+
+#define RECTIFY_PRESENTATION_FRESH (0x80)
+#define RECTIFY_PRESENTATION_INDEX_MASK (0x03)
+
+static uint8_t rectifyPresentationExchange(uint8_t* target, uint8_t value)
+{
+#if defined __GNUC__ || defined __clang__
+    return __atomic_exchange_n(target, value, __ATOMIC_ACQ_REL);
+#else
+    // Without atomics there can be no prediction worker thread, so it is only used from a single thread
+    uint8_t previous = *target;
+    *target = value;
+    return previous;
+#endif
+}
+
+static bool rectifyPresentationIsFresh(const uint8_t* target)
+{
+#if defined __GNUC__ || defined __clang__
+    return (__atomic_load_n(target, __ATOMIC_ACQUIRE) & RECTIFY_PRESENTATION_FRESH) != 0;
+#else
+    return (*target & RECTIFY_PRESENTATION_FRESH) != 0;
+#endif
+}
+
+void rectifyPresentationInit(RectifyPresentation* self, struct ImprintAllocator* allocator, size_t maxOctetSize)
+{
+    self->octets = IMPRINT_ALLOC_TYPE_COUNT(allocator, uint8_t, maxOctetSize * RECTIFY_PRESENTATION_SLOT_COUNT);
+    self->maxOctetSize = maxOctetSize;
+    for (size_t i = 0; i < RECTIFY_PRESENTATION_SLOT_COUNT; ++i) {
+        self->slots[i].stepId = 0;
+        self->slots[i].state.state = self->octets + i * maxOctetSize;
+    }
+    rectifyPresentationReInit(self);
+}
+
+/// Forgets the published states. Must not be called while the reader or the writer is active.
+void rectifyPresentationReInit(RectifyPresentation* self)
+{
+    for (size_t i = 0; i < RECTIFY_PRESENTATION_SLOT_COUNT; ++i) {
+        self->slots[i].stepId = 0;
+        self->slots[i].state.octetSize = 0;
+    }
+    self->writeIndex = 0;
+    self->sharedIndex = 1;
+    self->readIndex = 2;
+    self->hasState = false;
+}
+
+/// Copies the state to the slot owned by the writer, and publishes it as the most recent state.
+/// Only call from the thread that runs the prediction.
+int rectifyPresentationWrite(RectifyPresentation* self, const TransmuteState* state, StepId stepId)
+{
+    if (state->octetSize > self->maxOctetSize) {
+        return -1;
+    }
+
+    RectifyPresentationState* slot = &self->slots[self->writeIndex];
+    tc_memcpy_octets(self->octets + self->writeIndex * self->maxOctetSize, state->state, state->octetSize);
+    slot->state.octetSize = state->octetSize;
+    slot->stepId = stepId;
+
+    uint8_t previous = rectifyPresentationExchange(&self->sharedIndex,
+                                                   (uint8_t) (self->writeIndex | RECTIFY_PRESENTATION_FRESH));
+    self->writeIndex = previous & RECTIFY_PRESENTATION_INDEX_MASK;
+
+    return 0;
+}
+
+/// Returns the most recent complete state, or null if no state has been written yet.
+/// The returned state is valid until the next call to rectifyPresentationRead().
+const RectifyPresentationState* rectifyPresentationRead(RectifyPresentation* self)
+{
+    if (rectifyPresentationIsFresh(&self->sharedIndex)) {
+        uint8_t previous = rectifyPresentationExchange(&self->sharedIndex, self->readIndex);
+        self->readIndex = previous & RECTIFY_PRESENTATION_INDEX_MASK;
+        self->hasState = true;
+    }
+
+    if (!self->hasState) {
+        return 0;
+    }
+
+    return &self->slots[self->readIndex];
+}
@@ -4,43 +4,510 @@
  *--------------------------------------------------------------------------------------------*/
 #include "imprint/allocator.h"
 #include <rectify/rectify.h>
+#include <tiny-libc/tiny_libc.h>
+
+static void rectifySetComposedRemote(TransmuteParticipantInput* buildTarget)
+{
+    // Set zero input for remote participants
+    buildTarget->octetSize = 0;
+    buildTarget->input = 0;
+    buildTarget->inputType = TransmuteParticipantInputTypeNoInputInTime;
+}
+
+/// Checks if remote participants can be predicted as something else than no input in time
+static bool rectifyRemoteInputIsPredicted(const Rectify* self)
+{
+    return self->remotePredictor.setup.mode != RectifyRemoteInputPredictionModeNoInput ||
+           self->callbackObject.vtbl->predictRemoteInputFn != 0;
+}
+
+static void rectifyPredictComposedRemote(Rectify* self, TransmuteParticipantInput* buildTarget, StepId stepId)
+{
+    rectifyRemotePredictorPredict(&self->remotePredictor, stepId, buildTarget);
+    if (self->callbackObject.vtbl->predictRemoteInputFn != 0) {
+        self->callbackObject.vtbl->predictRemoteInputFn(self->callbackObject.self, stepId, buildTarget);
+    }
+}
+
+/// Predicts all participants in the composed input that are not local
+static void rectifyPredictComposedRemotes(Rectify* self, StepId stepId)
+{
+    for (size_t i = 0; i < self->buildComposedPredictedInput.participantCount; ++i) {
+        TransmuteParticipantInput* buildTarget = &self->buildComposedPredictedInput.participantInputs[i];
+        if (!rectifyRemotePredictorIsLocal(&self->remotePredictor, buildTarget->participantId)) {
+            rectifyPredictComposedRemote(self, buildTarget, stepId);
+        }
+    }
+}
+
+/// Lays out the composed predicted input in the same participant order as the last authoritative input,
+/// with all participants set as remote.
+static void rectifyRebuildComposedLayout(Rectify* self)
+{
+    const TransmuteInput* lastAuthoritativeInput = &self->authoritative.lastTransmuteInput;
+    size_t participantCount = lastAuthoritativeInput->participantCount;
+    if (participantCount > self->buildComposedPredictedInputMaxParticipantCount) {
+        CLOG_C_ERROR(&self->log, "authoritative has more participants than was prepared for: %zu, buildComposed:%zu",
+                     participantCount, self->buildComposedPredictedInputMaxParticipantCount)
+        participantCount = self->buildComposedPredictedInputMaxParticipantCount;
+    }
+
+    for (size_t i = 0; i < RECTIFY_PARTICIPANT_ID_COUNT; ++i) {
+        self->composedIndexForParticipantId[i] = -1;
+    }
+
+    for (size_t i = 0; i < participantCount; ++i) {
+        TransmuteParticipantInput* buildTarget = &self->buildComposedPredictedInput.participantInputs[i];
+        buildTarget->participantId = lastAuthoritativeInput->participantInputs[i].participantId;
+        buildTarget->localPartyId = 0; // localPartyId is not used in prediction
+        rectifySetComposedRemote(buildTarget);
+        self->composedIndexForParticipantId[buildTarget->participantId] = (int16_t) i;
+    }
+
+    self->buildComposedPredictedInput.participantCount = participantCount;
+    self->patchedComposedIndexCount = 0;
+    self->composedLayoutIsDirty = false;
+}
+
+static bool rectifyComposedLayoutIsSame(const Rectify* self, const TransmuteInput* input)
+{
+    if (input->participantCount != self->buildComposedPredictedInput.participantCount) {
+        return false;
+    }
+
+    for (size_t i = 0; i < input->participantCount; ++i) {
+        if (input->participantInputs[i].participantId !=
+            self->buildComposedPredictedInput.participantInputs[i].participantId) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void rectifyAddTraceEvent(Rectify* self, RectifyTraceEventType type, StepId stepId, size_t a, size_t b)
+{
+    if (!self->useTrace) {
+        return;
+    }
+    rectifyTraceAdd(&self->trace, type, stepId, (uint32_t) a, (uint32_t) b);
+}
+
+static void rectifyCountPredictionTick(Rectify* self, StepId stepId)
+{
+    self->stats.predictionTicks++;
+    if (self->hasPredictedAnyStep && stepId < self->nextNeverPredictedStepId) {
+        self->stats.predictionResimulatedTicks++;
+        rectifyInputDelayCountResimulatedTick(&self->inputDelay);
+    } else {
+        self->nextNeverPredictedStepId = stepId + 1;
+        self->hasPredictedAnyStep = true;
+    }
+}
+
+/// Uses the application hash if there is one, otherwise the built in hash of the authoritative state
+static bool rectifyHashAuthoritativeState(const Rectify* self, uint64_t* outHash)
+{
+    const RectifyCallbackObjectVtbl* vtbl = self->callbackObject.vtbl;
+    if (vtbl->authoritativeHashFn != 0) {
+        *outHash = vtbl->authoritativeHashFn(self->callbackObject.self);
+    } else if (self->useStateArenas) {
+        *outHash = rectifyStateHash(self->authoritativeStateArena.octets, self->authoritativeStateArena.stateOctetSize);
+    } else if (vtbl->authoritativeGetStateFn != 0) {
+        TransmuteState state = vtbl->authoritativeGetStateFn(self->callbackObject.self);
+        *outHash = rectifyTransmuteStateHash(&state);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/// Uses the application hash if there is one, otherwise the built in hash of the predicted state
+static bool rectifyHashPredictedState(const Rectify* self, uint64_t* outHash)
+{
+    const RectifyCallbackObjectVtbl* vtbl = self->callbackObject.vtbl;
+    if (vtbl->predictionHashFn != 0) {
+        *outHash = vtbl->predictionHashFn(self->callbackObject.self);
+    } else if (self->useStateArenas) {
+        *outHash = rectifyStateHash(self->predictedStateArena.octets, self->predictedStateArena.stateOctetSize);
+    } else if (vtbl->predictionGetStateFn != 0) {
+        TransmuteState state = vtbl->predictionGetStateFn(self->callbackObject.self);
+        *outHash = rectifyTransmuteStateHash(&state);
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+static void rectifyHandleDesyncResult(Rectify* self, StepId stepId, RectifyDesyncResult result)
+{
+    switch (result) {
+        case RectifyDesyncResultPending:
+            break;
+        case RectifyDesyncResultVerified:
+            self->stats.verifiedCheckpoints++;
+            break;
+        case RectifyDesyncResultDesynced:
+            self->stats.desyncedCheckpoints++;
+            rectifyAddTraceEvent(self, RectifyTraceEventTypeDesync, stepId, 0, 0);
+            CLOG_C_NOTICE(&self->log, "authoritative state hash differs from the server at %04X, last verified at %04X",
+                          stepId, self->desync.report.lastVerifiedStepId)
+            break;
+    }
+}
+
+static void rectifyAuthoritativePreTicks(void* _self)
+{
+    Rectify* self = (Rectify*) _self;
+    if (self->callbackObject.vtbl->preAuthoritativeTicksFn != 0) {
+        self->callbackObject.vtbl->preAuthoritativeTicksFn(self->callbackObject.self);
+    }
+}
+
+/// Ticks the authoritative state and compares the authoritative input (and optionally the state hash) to what was
+/// used when predicting the same step.
+static void rectifyAuthoritativeTick(void* _self, const TransmuteInput* input, StepId stepId)
+{
+    Rectify* self = (Rectify*) _self;
+    self->callbackObject.vtbl->authoritativeTickFn(self->callbackObject.self, input, stepId);
+    self->stats.authoritativeTicks++;
+
+    uint64_t checkpointHash;
+    if (self->useDesync && rectifyDesyncIsCheckpoint(&self->desync, stepId) &&
+        rectifyHashAuthoritativeState(self, &checkpointHash)) {
+        rectifyHandleDesyncResult(self, stepId, rectifyDesyncAddLocal(&self->desync, stepId, checkpointHash));
+    }
+
+    if (!self->composedLayoutIsDirty && !rectifyComposedLayoutIsSame(self, input)) {
+        self->composedLayoutIsDirty = true;
+    }
+
+    const RectifyInputHistoryEntry* predicted = rectifyInputHistoryFind(&self->predictedInputs, stepId);
+    rectifyRemotePredictorAddAuthoritative(&self->remotePredictor, input, predicted != 0 ? &predicted->input : 0,
+                                           stepId);
+    if (self->useSpeculation) {
+        rectifySpeculationCheckAuthoritative(&self->speculation, input, predicted, stepId);
+    }
+
+    if (self->predictionHasDiverged) {
+        return;
+    }
+
+    bool inputIsSame = predicted != 0 && rectifyInputIsEqual(input, &predicted->input);
+    bool isConfirmed = inputIsSame;
+    uint64_t authoritativeHash;
+    if (isConfirmed && predicted->hasHash && rectifyHashAuthoritativeState(self, &authoritativeHash)) {
+        isConfirmed = authoritativeHash == predicted->hash;
+    }
+
+    if (!isConfirmed) {
+        self->predictionHasDiverged = true;
+        self->firstDivergentStepId = stepId;
+        if (inputIsSame && self->useSpeculation) {
+            // The branches were started from predicted states, which can not be trusted
+            rectifySpeculationDiverge(&self->speculation);
+        }
+    }
+}
+
+static void rectifyAuthoritativeDeserialize(void* _self, const TransmuteState* state, StepId stepId)
+{
+    Rectify* self = (Rectify*) _self;
+    self->callbackObject.vtbl->authoritativeDeserializeFn(self->callbackObject.self, state, stepId);
+    self->predictionHasDiverged = true;
+    self->firstDivergentStepId = stepId;
+    self->composedLayoutIsDirty = true;
+    // The authoritative state was replaced without being ticked
+    self->dirtyRangesNeedFullCopy = true;
+    if (self->useSpeculation) {
+        rectifySpeculationInvalidate(&self->speculation);
+    }
+}
+
+static uint64_t rectifyAuthoritativeHash(void* _self)
+{
+    Rectify* self = (Rectify*) _self;
+    uint64_t hash;
+    if (!rectifyHashAuthoritativeState(self, &hash)) {
+        return 0;
+    }
+    return hash;
+}
+
+/// Copies only the ranges that changed in either state since the last copy.
+/// Returns false if the full state must be copied instead.
+static bool rectifyCopyDirtyRangesFromAuthoritative(Rectify* self, StepId stepId)
+{
+    const RectifyCallbackObjectVtbl* vtbl = self->callbackObject.vtbl;
+    void* app = self->callbackObject.self;
+    RectifyDirtyRange* authoritativeRanges = self->dirtyRanges;
+    RectifyDirtyRange* predictedRanges = self->dirtyRanges + self->maxDirtyRangeCount;
+
+    // Both sides must always be asked, so that a new tracking window is started on both
+    int authoritativeRangeCount;
+    int predictedRangeCount;
+    if (self->useStateArenas) {
+        authoritativeRangeCount = rectifyStateArenaDirtyRanges(&self->authoritativeStateArena, authoritativeRanges,
+                                                               self->maxDirtyRangeCount);
+        predictedRangeCount = rectifyStateArenaDirtyRanges(&self->predictedStateArena, predictedRanges,
+                                                           self->maxDirtyRangeCount);
+    } else {
+        authoritativeRangeCount = vtbl->authoritativeDirtyRangesFn(app, authoritativeRanges, self->maxDirtyRangeCount);
+        predictedRangeCount = vtbl->predictionDirtyRangesFn(app, predictedRanges, self->maxDirtyRangeCount);
+    }
+
+    bool mustCopyFullState = self->dirtyRangesNeedFullCopy;
+    self->dirtyRangesNeedFullCopy = false;
+    if (mustCopyFullState || authoritativeRangeCount < 0 || predictedRangeCount < 0) {
+        return false;
+    }
+
+    for (int i = 0; i < predictedRangeCount; ++i) {
+        self->dirtyRanges[authoritativeRangeCount + i] = predictedRanges[i];
+    }
+    size_t rangeCount = rectifyDirtyRangesMerge(self->dirtyRanges,
+                                                (size_t) authoritativeRangeCount + (size_t) predictedRangeCount);
+
+    if (self->useStateArenas) {
+        rectifyStateArenaCopyRanges(&self->predictedStateArena, self->dirtyRanges, rangeCount,
+                                    self->authoritativeStateArena.octets);
+        // The prediction is equal to the authoritative state again
+        rectifyStateArenaForgetChanges(&self->predictedStateArena);
+    } else {
+        vtbl->copyRangesFromAuthoritativeToPredictionFn(app, self->dirtyRanges, rangeCount, stepId);
+    }
+    self->stats.predictionDirtyRangeResets++;
+    self->stats.predictionDirtyRangeOctets += rectifyDirtyRangesOctetCount(self->dirtyRanges, rangeCount);
+
+    return true;
+}
+
+static void rectifyPredictionCopyFromAuthoritative(void* _self, StepId stepId)
+{
+    Rectify* self = (Rectify*) _self;
+    if (self->useDirtyRanges && rectifyCopyDirtyRangesFromAuthoritative(self, stepId)) {
+        return;
+    }
+    if (self->useStateArenas) {
+        rectifyStateArenaCopy(&self->predictedStateArena, self->authoritativeStateArena.octets);
+        rectifyStateArenaForgetChanges(&self->predictedStateArena);
+        return;
+    }
+    self->callbackObject.vtbl->copyFromAuthoritativeToPredictionFn(self->callbackObject.self, stepId);
+}
+
+static void rectifyPredictionTick(void* _self, const TransmuteInput* input, StepId stepId)
+{
+    Rectify* self = (Rectify*) _self;
+    self->callbackObject.vtbl->predictionTickFn(self->callbackObject.self, input, stepId);
+    rectifyCountPredictionTick(self, stepId);
+
+    if (!self->comparesStateHashes || (self->useDesync && !rectifyDesyncIsCheckpoint(&self->desync, stepId))) {
+        return;
+    }
+
+    RectifyInputHistoryEntry* predicted = rectifyInputHistoryFind(&self->predictedInputs, stepId);
+    if (predicted == 0) {
+        return;
+    }
+    predicted->hasHash = rectifyHashPredictedState(self, &predicted->hash);
+}
+
+static void rectifyPredictionPostTicks(void* _self)
+{
+    Rectify* self = (Rectify*) _self;
+    if (self->callbackObject.vtbl->postPredictionTicksFn != 0) {
+        self->callbackObject.vtbl->postPredictionTicksFn(self->callbackObject.self);
+    }
+}
+
+/// Checks if all authoritative steps since the prediction was last set were exactly the ones we predicted and
+/// that the prediction has already simulated them. In that case the predicted state is still valid.
+static bool rectifyPredictionIsConfirmed(const Rectify* self)
+{
+    return self->authoritativeHasBeenCopiedToPrediction && !self->predictionHasDiverged &&
+           self->predicted.stepId >= self->authoritative.stepId;
+}
+
+/// Uses a speculative branch that predicted the remote participants correctly, instead of re-simulating
+static bool rectifyTryAdoptSpeculativeBranch(Rectify* self)
+{
+    if (!self->useSpeculation || !self->authoritativeHasBeenCopiedToPrediction) {
+        return false;
+    }
+
+    StepId authoritativeStepId = self->authoritative.stepId;
+    RectifySpeculativeBranch* branch = rectifySpeculationFindMatching(&self->speculation, authoritativeStepId,
+                                                                      self->predicted.stepId);
+    if (branch == 0) {
+        return false;
+    }
+
+    for (StepId stepId = branch->startStepId; stepId < branch->stepId; ++stepId) {
+        if (!rectifyInputHistoryHas(&branch->inputs, stepId)) {
+            return false;
+        }
+    }
+
+    // Future authoritative steps must be compared with the inputs that the branch used
+    for (StepId stepId = branch->startStepId; stepId < branch->stepId; ++stepId) {
+        const RectifyInputHistoryEntry* branchInput = rectifyInputHistoryFind(&branch->inputs, stepId);
+        rectifyInputHistoryWrite(&self->predictedInputs, &branchInput->input, stepId);
+    }
+
+    // The branch state becomes the predicted state, and the replaced predicted state is recycled by the branch
+    size_t branchIndex = (size_t) (branch - self->speculation.branches);
+    rectifySpeculationSwapArena(&self->speculation, branchIndex, &self->predictedStateArena);
+    // The written chunks of the branch do not cover how the main prediction differed from the authoritative state
+    self->dirtyRangesNeedFullCopy = true;
+    nbsStepsDiscardUpTo(&self->predicted.predictedSteps, authoritativeStepId);
+
+    self->stats.speculativeBranchAdoptions++;
+    rectifyAddTraceEvent(self, RectifyTraceEventTypePredictionBranchAdopted, authoritativeStepId, branchIndex,
+                         self->predicted.stepId);
+    rectifySpeculationInvalidate(&self->speculation);
+
+    return true;
+}
+
+/// Starts all branches over from the current predicted state, typically just after the prediction was set to the
+/// authoritative state. From there on, the branches use their own hypothesis for the remote participants.
+static void rectifyRestartSpeculativeBranches(Rectify* self)
+{
+    for (size_t i = 0; i < self->speculation.branchCount; ++i) {
+        rectifySpeculationRestart(&self->speculation, i, &self->predictedStateArena, self->predicted.stepId);
+    }
+}
+
+/// Advances the speculative branches as far as the main prediction, each with its own hypothesis for the remote
+/// participants. Each branch is ticked by predictionTickFn with its arena swapped in as the predicted state arena,
+/// so the branches are ticked serially, see RectifySpeculation.
+static void rectifyAdvanceSpeculativeBranches(Rectify* self)
+{
+    if (!self->authoritativeHasBeenCopiedToPrediction) {
+        return;
+    }
+
+    RectifyCallbackObjectVtbl* vtbl = self->callbackObject.vtbl;
+    void* app = self->callbackObject.self;
+    StepId predictedStepId = self->predicted.stepId;
+
+    for (size_t i = 0; i < self->speculation.branchCount; ++i) {
+        RectifySpeculativeBranch* branch = &self->speculation.branches[i];
+        if (!branch->isValid || branch->hasDiverged || branch->stepId > predictedStepId) {
+            rectifySpeculationRestart(&self->speculation, i, &self->predictedStateArena, predictedStepId);
+            continue;
+        }
+
+        if (branch->stepId == predictedStepId) {
+            continue;
+        }
+
+        rectifySpeculationSwapArena(&self->speculation, i, &self->predictedStateArena);
+        while (branch->stepId < predictedStepId) {
+            const RectifyInputHistoryEntry* mainInput = rectifyInputHistoryFind(&self->predictedInputs,
+                                                                                branch->stepId);
+            TransmuteInput branchInput;
+            if (mainInput == 0 ||
+                rectifySpeculationComposeInput(&self->speculation, i, &mainInput->input, &self->remotePredictor,
+                                               &self->authoritative.lastTransmuteInput,
+                                               vtbl->speculativeRemoteInputFn, app, branch->stepId, &branchInput) < 0 ||
+                rectifyInputHistoryWrite(&branch->inputs, &branchInput, branch->stepId) < 0) {
+                branch->isValid = false;
+                break;
+            }
+            // The copy in the history is used, since the composed input is only valid until the next compose
+            const RectifyInputHistoryEntry* storedInput = rectifyInputHistoryFind(&branch->inputs, branch->stepId);
+            vtbl->predictionTickFn(app, &storedInput->input, branch->stepId);
+            self->stats.speculativeTicks++;
+            branch->stepId++;
+        }
+        rectifySpeculationSwapArena(&self->speculation, i, &self->predictedStateArena);
+    }
+}
+
+static void rectifyUpdatePrediction(void* _self);
+
+/// Disables all the optional features, and catches up at most 20 authoritative ticks each update.
+/// The allocator, the step and player counts and the log must still be set before rectifyInit().
+void rectifySetupDefaults(RectifySetup* self)
+{
+    tc_mem_clear_type(self);
+    self->maxTicksFromAuthoritative = 16;
+    self->catchUp.mode = RectifyCatchUpModeTickCount;
+    self->catchUp.maxTicksPerUpdate = 20;
+    self->remotePrediction.mode = RectifyRemoteInputPredictionModeNoInput;
+}
 
 void rectifyInit(Rectify* self, RectifyCallbackObject callbackObject, RectifySetup setup, TransmuteState state,
                  StepId stepId)
 {
     self->log = setup.log;
+    self->callbackObject = callbackObject;
+    self->replayRecorder = setup.replayRecorder;
+    self->snapshotPolicy = setup.snapshotPolicy;
+    self->authoritativeSnapshotWasSet = false;
+    if (self->replayRecorder != 0) {
+        rectifyReplayRecorderAddState(self->replayRecorder, &state, stepId);
+    }
+    // assentInit() can call the deserialize callback, so the flags must be valid before that
+    self->predictionHasDiverged = false;
+    self->composedLayoutIsDirty = true;
+    self->hasPredictedAnyStep = false;
+    self->nextNeverPredictedStepId = stepId;
+    rectifyStatsClear(&self->stats);
+    self->useTrace = false;
+    self->useSpeculation = false;
+    self->useDirtyRanges = false;
+    self->dirtyRangesNeedFullCopy = true;
+    self->useDesync = false;
+    // The application keeps its states in the arenas, so they must exist before the first deserialize
+    self->useStateArenas = setup.stateArenaOctetSize > 0;
+    if (self->useStateArenas) {
+        rectifyStateArenaInit(&self->authoritativeStateArena, setup.allocator, setup.stateArenaOctetSize);
+        rectifyStateArenaInit(&self->predictedStateArena, setup.allocator, setup.stateArenaOctetSize);
+    }
     tc_snprintf(self->prefixAuthoritative, 32, "%s/Authoritative", setup.log.constantPrefix);
     Clog authSubLog;
     authSubLog.config = setup.log.config;
     authSubLog.constantPrefix = self->prefixAuthoritative;
 
     AssentCallbackVtbl assentVtbl = {
-        .preTicksFn = callbackObject.vtbl->preAuthoritativeTicksFn,
-        .tickFn = callbackObject.vtbl->authoritativeTickFn,
-        .deserializeFn = callbackObject.vtbl->authoritativeDeserializeFn,
-        .hashFn = callbackObject.vtbl->authoritativeHashFn,
+        .preTicksFn = rectifyAuthoritativePreTicks,
+        .tickFn = rectifyAuthoritativeTick,
+        .deserializeFn = rectifyAuthoritativeDeserialize,
+        .hashFn = rectifyAuthoritativeHash,
     };
     self->assentCallbackVtbl = assentVtbl;
 
-    const AssentCallbackObject assentCallbackObject = {.vtbl = &self->assentCallbackVtbl, .self = callbackObject.self};
+    const AssentCallbackObject assentCallbackObject = {.vtbl = &self->assentCallbackVtbl, .self = self};
+
+    // Assent and Seer reserve a max size input for each of these participants, in every step they keep
+    size_t stepBufferPlayerCount = setup.maxPlayerCount;
+    if (setup.maxActivePlayerCount > 0 && setup.maxActivePlayerCount < setup.maxPlayerCount) {
+        stepBufferPlayerCount = setup.maxActivePlayerCount;
+    }
 
     AssentSetup assentSetup;
     assentSetup.allocator = setup.allocator;
     assentSetup.maxStepOctetSizeForSingleParticipant = setup.maxStepOctetSizeForSingleParticipant;
-    assentSetup.maxPlayers = setup.maxPlayerCount;
+    assentSetup.maxPlayers = stepBufferPlayerCount;
+    self->stepParticipantCapacity = stepBufferPlayerCount;
     assentSetup.log = authSubLog;
-    assentSetup.maxTicksPerRead = 20u;
+    assentSetup.maxTicksPerRead = 20u; // is overwritten by the catch up policy before every update
 
     assentInit(&self->authoritative, assentCallbackObject, assentSetup, state, stepId);
 
     const SeerCallbackObjectVtbl seerVtbl = {
-        .predictionTickFn = callbackObject.vtbl->predictionTickFn,
-        .copyFromAuthoritativeFn = callbackObject.vtbl->copyFromAuthoritativeToPredictionFn,
-        .postPredictionTicksFn = callbackObject.vtbl->postPredictionTicksFn,
+        .predictionTickFn = rectifyPredictionTick,
+        .copyFromAuthoritativeFn = rectifyPredictionCopyFromAuthoritative,
+        .postPredictionTicksFn = rectifyPredictionPostTicks,
     };
 
     self->seerCallbackVtbl = seerVtbl;
-    const SeerCallbackObject seerCallbackObject = {.vtbl = &self->seerCallbackVtbl, .self = callbackObject.self};
+    const SeerCallbackObject seerCallbackObject = {.vtbl = &self->seerCallbackVtbl, .self = self};
 
     tc_snprintf(self->prefixPredicted, 32, "%s/Predict", setup.log.constantPrefix);
     Clog seerSubLog;
@@ -48,64 +515,212 @@ void rectifyInit(Rectify* self, RectifyCallbackObject callbackObject, RectifySet
     seerSubLog.constantPrefix = self->prefixPredicted;
 
     SeerSetup seerSetup;
-    seerSetup.maxPlayers = setup.maxPlayerCount;
+    seerSetup.maxPlayers = stepBufferPlayerCount;
     seerSetup.maxStepOctetSizeForSingleParticipant = setup.maxStepOctetSizeForSingleParticipant;
     seerSetup.allocator = setup.allocator;
     seerSetup.maxTicksFromAuthoritative = setup.maxTicksFromAuthoritative;
     seerSetup.log = seerSubLog;
 
     seerInit(&self->predicted, seerCallbackObject, seerSetup, stepId);
+    rectifyPredictionWindowInit(&self->predictionWindow, setup.predictionWindow, setup.maxTicksFromAuthoritative);
+    rectifyTimeSyncInit(&self->timeSync, setup.timeSync);
+    rectifyInputDelayInit(&self->inputDelay, setup.inputDelay);
+    rectifyResimulationInit(&self->resimulation, setup.resimulation);
+    self->stats.inputDelayTicks = self->inputDelay.ticks;
+    self->stats.predictionWindowTicks = self->predictionWindow.effectiveTicks;
 
     CLOG_C_DEBUG(&self->log, "prepare memory for build composed max player count: %zu", setup.maxPlayerCount)
     self->buildComposedPredictedInput.participantInputs = IMPRINT_ALLOC_TYPE_COUNT(
         setup.allocator, TransmuteParticipantInput, setup.maxPlayerCount);
     self->buildComposedPredictedInput.participantCount = 0;
     self->buildComposedPredictedInputMaxParticipantCount = setup.maxPlayerCount;
+    self->patchedComposedIndices = IMPRINT_ALLOC_TYPE_COUNT(setup.allocator, size_t, setup.maxPlayerCount);
+    self->patchedComposedIndexCount = 0;
+    rectifyRemotePredictorInit(&self->remotePredictor, setup.allocator, setup.remotePrediction, setup.maxPlayerCount,
+                               setup.maxStepOctetSizeForSingleParticipant);
+    self->composedLayoutIsDirty = true;
     self->authoritativeHasBeenCopiedToPrediction = false;
+
+    // Predicted inputs must be kept until the authoritative step for the same StepId has been ticked
+    rectifyInputHistoryInit(&self->predictedInputs, setup.allocator, setup.maxTicksFromAuthoritative * 2 + 1,
+                            setup.maxPlayerCount, setup.maxStepOctetSizeForSingleParticipant,
+                            setup.compactStepOctetSize, setup.useDeltaEncodedSteps);
+    self->predictionHasDiverged = false;
+    self->firstDivergentStepId = stepId;
+
+    rectifyCatchUpInit(&self->catchUp, setup.catchUp);
+
+    self->useTrace = setup.traceEventCapacity > 0;
+    if (self->useTrace) {
+        rectifyTraceInit(&self->trace, setup.allocator, setup.traceEventCapacity);
+    }
+
+    // The branches are ticked in their own arenas, so that adopting one is a swap instead of a state copy
+    self->useSpeculation = setup.speculation.branchCount > 0 && self->useStateArenas;
+    if (setup.speculation.branchCount > 0 && !self->useStateArenas) {
+        CLOG_C_NOTICE(&self->log, "speculative branches need the state arenas, speculation is disabled")
+    }
+    if (self->useSpeculation) {
+        rectifySpeculationInit(&self->speculation, setup.allocator, &setup.speculation,
+                               setup.maxTicksFromAuthoritative * 2 + 1, setup.maxPlayerCount,
+                               setup.maxStepOctetSizeForSingleParticipant, setup.compactStepOctetSize,
+                               setup.useDeltaEncodedSteps, setup.stateArenaOctetSize);
+    }
+
+    self->usePresentation = setup.maxPresentationStateOctetSize > 0 &&
+                            callbackObject.vtbl->predictionGetStateFn != 0;
+    if (self->usePresentation) {
+        rectifyPresentationInit(&self->presentation, setup.allocator, setup.maxPresentationStateOctetSize);
+    }
+
+    self->useDirtyRanges = self->useStateArenas ||
+                           (setup.maxDirtyRangeCount > 0 && callbackObject.vtbl->authoritativeDirtyRangesFn != 0 &&
+                            callbackObject.vtbl->predictionDirtyRangesFn != 0 &&
+                            callbackObject.vtbl->copyRangesFromAuthoritativeToPredictionFn != 0);
+    if (self->useDirtyRanges) {
+        // A state arena can never have more ranges than pages
+        self->maxDirtyRangeCount = self->useStateArenas ? self->authoritativeStateArena.writtenPages.chunkCount
+                                                        : setup.maxDirtyRangeCount;
+        // Room for the ranges of both the authoritative and the predicted side
+        self->dirtyRanges = IMPRINT_ALLOC_TYPE_COUNT(setup.allocator, RectifyDirtyRange, self->maxDirtyRangeCount * 2);
+    }
+
+    self->useDesync = setup.desync.checkpointInterval > 0;
+    if (self->useDesync && callbackObject.vtbl->authoritativeHashFn == 0 &&
+        callbackObject.vtbl->authoritativeGetStateFn == 0 && !self->useStateArenas) {
+        CLOG_C_SOFT_ERROR(&self->log, "desync checks need authoritativeHashFn, authoritativeGetStateFn or state arenas")
+        self->useDesync = false;
+    }
+    if (self->useDesync) {
+        rectifyDesyncInit(&self->desync, setup.allocator, setup.desync);
+    }
+
+    // The predicted and authoritative hashes must come from the same hash function to be comparable.
+    // The built in hash costs a full pass over the state, so it is only used at the desync checkpoints.
+    bool hasApplicationHashes = callbackObject.vtbl->authoritativeHashFn != 0 &&
+                                callbackObject.vtbl->predictionHashFn != 0;
+    bool hasBuiltInHashes = callbackObject.vtbl->authoritativeHashFn == 0 &&
+                            callbackObject.vtbl->predictionHashFn == 0 && self->useDesync &&
+                            (self->useStateArenas || (callbackObject.vtbl->authoritativeGetStateFn != 0 &&
+                                                      callbackObject.vtbl->predictionGetStateFn != 0));
+    self->comparesStateHashes = hasApplicationHashes || hasBuiltInHashes;
+
+    self->authoritativeWasDrainedLastUpdate = false;
+    self->authoritativeBacklogAfterUpdate = 0;
+    rectifyPredictionWorkerInit(&self->predictionWorker, setup.allocator, setup.useAsyncPrediction,
+                                rectifyUpdatePrediction, self);
 }
 
-void rectifyUpdate(Rectify* self)
+/// Starts over from a new authoritative state, e.g. for the next match.
+/// Reuses all the memory from rectifyInit(), so nothing is allocated.
+/// Assent has no re-init of its own, so this is the only place where its fields are rewound.
+/// The step buffer is recycled through nimble-steps and the state is set through the deserialize callback.
+static void rectifyAuthoritativeReInit(Rectify* self, TransmuteState state, StepId stepId)
 {
-    /*
-    if (targetTickId < self->authoritative.stepId) {
-        CLOG_C_ERROR(&self->log,
-                     "can not get to a targetTickId that happened before the current authoritative step %04X %04X",
-                     targetTickId, self->authoritative.stepId)
-        return;
+    nbsStepsReInit(&self->authoritative.authoritativeSteps, stepId);
+    self->authoritative.stepId = stepId;
+    self->authoritative.lastTransmuteInput.participantCount = 0;
+    rectifyAuthoritativeDeserialize(self, &state, stepId);
+}
+
+/// Recycles the predicted step buffer and lets Seer copy the new authoritative state, so the prediction can continue
+/// from `stepId` without waiting for the first authoritative step.
+static void rectifyPredictedReInit(Rectify* self, StepId stepId)
+{
+    nbsStepsReInit(&self->predicted.predictedSteps, stepId);
+    seerAuthoritativeGotNewState(&self->predicted, stepId);
+    self->authoritativeHasBeenCopiedToPrediction = true;
+    self->predictionHasDiverged = false;
+    self->firstDivergentStepId = stepId;
+}
+
+/// Starts over from `state` at `stepId`, reusing all the memory from rectifyInit()
+void rectifyReset(Rectify* self, TransmuteState state, StepId stepId)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+
+    CLOG_C_DEBUG(&self->log, "reset to %04X", stepId)
+    if (self->replayRecorder != 0) {
+        rectifyReplayRecorderAddState(self->replayRecorder, &state, stepId);
     }
-     */
 
-    size_t authoritativeStepCountBeforeUpdate = self->authoritative.authoritativeSteps.stepsCount;
-    // Try to advance the authoritative steps as far as possible
-    assentUpdate(&self->authoritative);
+    rectifyPredictionWindowReInit(&self->predictionWindow);
+    rectifyTimeSyncReInit(&self->timeSync);
+    rectifyInputDelayReInit(&self->inputDelay);
+    rectifyResimulationReInit(&self->resimulation);
 
-    if (self->authoritative.authoritativeSteps.stepsCount != 0) {
-        StepId firstStepId;
-        bool didHaveAtLeastOneStep = nbsStepsPeek(&self->authoritative.authoritativeSteps, &firstStepId);
-        if (!didHaveAtLeastOneStep) {
-            CLOG_C_ERROR(&self->log, "nbsStepsPeek should have returned true")
-        }
+    self->buildComposedPredictedInput.participantCount = 0;
+    self->patchedComposedIndexCount = 0;
+    self->composedLayoutIsDirty = true;
+    rectifyRemotePredictorReInit(&self->remotePredictor);
 
-        CLOG_C_NOTICE(&self->log,
-                      "still trying to catch up to a complete authoritative state, couldn't advance through all steps "
-                      "this update, hopefully catching up "
-                      "next update() %04X (%zu count now and %zu before. max %zu ticks/update)",
-                      firstStepId, self->authoritative.authoritativeSteps.stepsCount,
-                      authoritativeStepCountBeforeUpdate, self->authoritative.maxTicksPerRead)
+    self->hasPredictedAnyStep = false;
+    self->nextNeverPredictedStepId = stepId;
+    rectifyInputHistoryReInit(&self->predictedInputs);
+    if (self->usePresentation) {
+        rectifyPresentationReInit(&self->presentation);
+    }
+    if (self->useDesync) {
+        rectifyDesyncReInit(&self->desync);
     }
+    self->dirtyRangesNeedFullCopy = true;
 
-    // Everytime we have consumed *all* the knowledge about the truth, we should update our predictions
-    // or if we don't have any predictions at all, then it is time to set a prediction
-    if (authoritativeStepCountBeforeUpdate > 0 && self->authoritative.authoritativeSteps.stepsCount == 0) {
-        CLOG_C_VERBOSE(&self->log,
-                       "we have a new authoritative state (truth) at %04X, copy to prediction (which was at %04X) and "
-                       "starts predicting our future",
-                       self->authoritative.stepId, self->predicted.stepId)
-        // seerSetState discards all predicted inputs before the `authoritativeTickId`
-        seerAuthoritativeGotNewState(&self->predicted, self->authoritative.stepId);
-        self->authoritativeHasBeenCopiedToPrediction = true;
+    rectifyCatchUpInit(&self->catchUp, self->catchUp.setup);
+    rectifyStatsClear(&self->stats);
+    self->stats.predictionWindowTicks = self->predictionWindow.effectiveTicks;
+    self->stats.inputDelayTicks = self->inputDelay.ticks;
+    if (self->useTrace) {
+        rectifyTraceClear(&self->trace);
+    }
+    self->authoritativeWasDrainedLastUpdate = false;
+    self->authoritativeBacklogAfterUpdate = 0;
+    self->authoritativeSnapshotWasSet = false;
+
+    rectifyAuthoritativeReInit(self, state, stepId);
+    rectifyPredictedReInit(self, stepId);
+}
+
+/// Stops the prediction thread and unmaps the state arenas.
+/// The memory from the allocator is not freed, it belongs to the owner of the allocator.
+void rectifyDestroy(Rectify* self)
+{
+    rectifyPredictionWorkerDestroy(&self->predictionWorker);
+    if (self->useSpeculation) {
+        rectifySpeculationDestroy(&self->speculation);
+    }
+    if (self->useStateArenas) {
+        rectifyStateArenaDestroy(&self->authoritativeStateArena);
+        rectifyStateArenaDestroy(&self->predictedStateArena);
+    }
+}
+
+/// The most ticks that seerUpdate() may do this time, the smallest of the limits that apply.
+/// The prediction window, the re-simulation time slice and the input delay all limit the same Seer field, so only this
+/// sets it. With an input delay the prediction stops at the local tick, the steps after it only hold queued inputs.
+static size_t rectifyPredictionTicksThisUpdate(const Rectify* self)
+{
+    size_t ticks = self->predictionWindow.effectiveTicks;
+    StepId localTickId;
+    if (rectifyInputDelayLocalTick(&self->inputDelay, &localTickId)) {
+        size_t horizonTicks = localTickId >= self->predicted.stepId ? localTickId - self->predicted.stepId + 1u : 0;
+        if (horizonTicks < ticks) {
+            ticks = horizonTicks;
+        }
+    }
+    if (self->resimulation.isInProgress) {
+        size_t sliceTicks = rectifyResimulationTicksThisUpdate(&self->resimulation,
+                                                               self->catchUp.report.tickCostMicroseconds);
+        if (sliceTicks < ticks) {
+            ticks = sliceTicks;
+        }
     }
 
+    return ticks;
+}
+
+/// Continues the ongoing prediction, if there is any
+static void rectifyAdvancePrediction(Rectify* self)
+{
     if (!self->authoritativeHasBeenCopiedToPrediction) {
         CLOG_C_VERBOSE(
             &self->log,
@@ -137,60 +752,576 @@ void rectifyUpdate(Rectify* self)
     // We need to continue our ongoing prediction, up to the number of predicted inputs or the maximum prediction ticks
     // that are allowed
     CLOG_C_VERBOSE(&self->log, "we can ask seer to predict the future from %04X", self->predicted.stepId)
+    // seerUpdate() ticks at most maxPredictionTicksFromAuthoritative steps
+    self->predicted.maxPredictionTicksFromAuthoritative = rectifyPredictionTicksThisUpdate(self);
+    StepId predictedStepIdBefore = self->predicted.stepId;
     seerUpdate(&self->predicted);
     CLOG_C_VERBOSE(&self->log, "new prediction from seer at %04X", self->predicted.stepId)
+
+    if (rectifyResimulationAdvance(&self->resimulation, self->predicted.stepId,
+                                   self->predicted.stepId - predictedStepIdBefore)) {
+        CLOG_C_VERBOSE(&self->log, "re-simulation reached %04X in %zu updates", self->predicted.stepId,
+                       self->resimulation.updateCount)
+        if (self->resimulation.updateCount > 1) {
+            self->stats.slicedResimulations++;
+            self->stats.slicedResimulationUpdates += self->resimulation.updateCount;
+        }
+        rectifyAddTraceEvent(self, RectifyTraceEventTypeResimulationCompleted, self->predicted.stepId,
+                             self->resimulation.updateCount, self->resimulation.tickCount);
+    }
+}
+
+static void rectifyCountAddedAuthoritativeStep(Rectify* self, StepId tickId, StepId expectedWriteId, ssize_t result)
+{
+    if (result < 0) {
+        self->stats.rejectedAuthoritativeSteps++;
+        rectifyAddTraceEvent(self, RectifyTraceEventTypeAuthoritativeStepRejected, tickId, (size_t) -result, 0);
+    } else if (tickId < expectedWriteId) {
+        self->stats.duplicateAuthoritativeSteps++;
+    } else {
+        rectifyAddTraceEvent(self, RectifyTraceEventTypeAuthoritativeStepAdded, tickId, 0, 0);
+    }
+}
+
+/// Number of authoritative steps waiting to be ticked
+static size_t rectifyAuthoritativeBacklog(const Rectify* self)
+{
+    return self->authoritative.authoritativeSteps.stepsCount;
+}
+
+static StepId rectifyFirstWaitingAuthoritativeStepId(Rectify* self)
+{
+    StepId firstStepId = self->authoritative.stepId;
+    bool didHaveAtLeastOneStep = nbsStepsPeek(&self->authoritative.authoritativeSteps, &firstStepId);
+    if (!didHaveAtLeastOneStep) {
+        CLOG_C_ERROR(&self->log, "nbsStepsPeek should have returned true")
+    }
+
+    return firstStepId;
+}
+
+/// Measures how many predicted steps were waiting for the authoritative steps that just arrived, and
+/// adapts the effective window that the next prediction update is limited to
+static void rectifyAdaptPredictionWindow(Rectify* self)
+{
+    size_t leadTicks = self->predicted.predictedSteps.stepsCount;
+    size_t previousTicks = self->predictionWindow.effectiveTicks;
+    size_t effectiveTicks = rectifyPredictionWindowAddLead(&self->predictionWindow, leadTicks);
+    if (effectiveTicks == previousTicks) {
+        return;
+    }
+
+    CLOG_C_VERBOSE(&self->log, "prediction window changed from %zu to %zu ticks, lead was %zu ticks", previousTicks,
+                   effectiveTicks, leadTicks)
+    self->stats.predictionWindowTicks = effectiveTicks;
+    self->stats.predictionWindowChanges++;
+    rectifyAddTraceEvent(self, RectifyTraceEventTypePredictionWindowChanged, self->authoritative.stepId,
+                         effectiveTicks, leadTicks);
+}
+
+/// The re-simulations from the previous prediction update are priced with the measured authoritative tick cost
+static void rectifyAdaptInputDelay(Rectify* self)
+{
+    size_t previousTicks = self->inputDelay.ticks;
+    size_t inputDelayTicks = rectifyInputDelayUpdate(&self->inputDelay, self->catchUp.report.tickCostMicroseconds);
+    if (inputDelayTicks == previousTicks) {
+        return;
+    }
+
+    CLOG_C_VERBOSE(&self->log, "input delay changed from %zu to %zu ticks, re-simulation cost was %zu us per update",
+                   previousTicks, inputDelayTicks, self->inputDelay.lastResimulationCostMicroseconds)
+    self->stats.inputDelayTicks = inputDelayTicks;
+    self->stats.inputDelayChanges++;
+    rectifyAddTraceEvent(self, RectifyTraceEventTypeInputDelayChanged, self->authoritative.stepId, inputDelayTicks,
+                         self->inputDelay.lastResimulationCostMicroseconds);
+}
+
+void rectifyUpdate(Rectify* self)
+{
+    // The previous prediction must be done before the authoritative state can be advanced
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+
+    /*
+    if (targetTickId < self->authoritative.stepId) {
+        CLOG_C_ERROR(&self->log,
+                     "can not get to a targetTickId that happened before the current authoritative step %04X %04X",
+                     targetTickId, self->authoritative.stepId)
+        return;
+    }
+     */
+
+    size_t authoritativeStepCountBeforeUpdate = rectifyAuthoritativeBacklog(self);
+    rectifyAddTraceEvent(self, RectifyTraceEventTypeUpdateBegin, self->authoritative.stepId,
+                         authoritativeStepCountBeforeUpdate, 0);
+    // Try to advance the authoritative steps as far as the catch up policy allows
+    rectifyCatchUpBegin(&self->catchUp, authoritativeStepCountBeforeUpdate);
+    while (rectifyAuthoritativeBacklog(self) > 0) {
+        size_t maxTicksThisChunk = rectifyCatchUpNextChunk(&self->catchUp);
+        if (maxTicksThisChunk == 0) {
+            break;
+        }
+        size_t stepCountBeforeChunk = self->authoritative.authoritativeSteps.stepsCount;
+        self->authoritative.maxTicksPerRead = maxTicksThisChunk;
+        assentUpdate(&self->authoritative);
+        rectifyCatchUpChunkDone(&self->catchUp,
+                                stepCountBeforeChunk - self->authoritative.authoritativeSteps.stepsCount);
+    }
+    size_t authoritativeStepCountAfterUpdate = rectifyAuthoritativeBacklog(self);
+    rectifyCatchUpEnd(&self->catchUp, authoritativeStepCountAfterUpdate);
+
+    self->stats.updateCount++;
+    self->stats.authoritativeBacklog = authoritativeStepCountAfterUpdate;
+    if (authoritativeStepCountBeforeUpdate > self->stats.maxAuthoritativeBacklog) {
+        self->stats.maxAuthoritativeBacklog = authoritativeStepCountBeforeUpdate;
+    }
+    if (self->catchUp.report.wasCappedLastUpdate) {
+        self->stats.cappedUpdates++;
+    }
+
+    if (authoritativeStepCountAfterUpdate != 0) {
+        StepId firstStepId = rectifyFirstWaitingAuthoritativeStepId(self);
+
+        if (self->useTrace) {
+            // This happens every update while catching up, so avoid formatting a log message
+            rectifyAddTraceEvent(self, RectifyTraceEventTypeCatchUpCapped, firstStepId,
+                                 authoritativeStepCountAfterUpdate, authoritativeStepCountBeforeUpdate);
+        } else {
+            CLOG_C_NOTICE(&self->log,
+                          "still trying to catch up to a complete authoritative state, couldn't advance through all "
+                          "steps this update, hopefully catching up "
+                          "next update() %04X (%zu count now and %zu before. %zu ticks this update)",
+                          firstStepId, authoritativeStepCountAfterUpdate, authoritativeStepCountBeforeUpdate,
+                          self->catchUp.report.ticksLastUpdate)
+        }
+    }
+
+    // Everytime we have consumed *all* the knowledge about the truth, we should update our predictions
+    // or if we don't have any predictions at all, then it is time to set a prediction
+    // A snapshot is new knowledge about the truth, even if there were no steps to tick
+    self->authoritativeWasDrainedLastUpdate = (authoritativeStepCountBeforeUpdate > 0 ||
+                                               self->authoritativeSnapshotWasSet) &&
+                                              authoritativeStepCountAfterUpdate == 0;
+    self->authoritativeSnapshotWasSet = false;
+    self->authoritativeBacklogAfterUpdate = authoritativeStepCountAfterUpdate;
+    if (self->authoritativeWasDrainedLastUpdate) {
+        // The confirmed predicted steps are still kept, they are discarded by the prediction update
+        rectifyAdaptPredictionWindow(self);
+        rectifyTimeSyncAddAuthoritative(&self->timeSync, self->authoritative.stepId);
+    }
+    rectifyAdaptInputDelay(self);
+
+    rectifyPredictionWorkerKick(&self->predictionWorker);
+}
+
+/// Updates the prediction from the authoritative state that was reached in rectifyUpdate().
+/// Runs on the prediction worker thread when async prediction is enabled.
+static void rectifyUpdatePrediction(void* _self)
+{
+    Rectify* self = (Rectify*) _self;
+
+    if (self->authoritativeWasDrainedLastUpdate) {
+        if (rectifyPredictionIsConfirmed(self)) {
+            CLOG_C_VERBOSE(&self->log,
+                           "authoritative state (truth) at %04X confirmed our prediction, keep predicting from %04X",
+                           self->authoritative.stepId, self->predicted.stepId)
+            // The predicted inputs up to the truth are not needed anymore, but the predicted state is kept as is
+            nbsStepsDiscardUpTo(&self->predicted.predictedSteps, self->authoritative.stepId);
+            self->stats.predictionConfirmations++;
+            rectifyAddTraceEvent(self, RectifyTraceEventTypePredictionConfirmed, self->authoritative.stepId,
+                                 self->predicted.stepId, 0);
+        } else if (rectifyTryAdoptSpeculativeBranch(self)) {
+            CLOG_C_VERBOSE(&self->log, "a speculative branch matched the truth at %04X, keep predicting from %04X",
+                           self->authoritative.stepId, self->predicted.stepId)
+        } else {
+            CLOG_C_VERBOSE(&self->log,
+                           "we have a new authoritative state (truth) at %04X, copy to prediction (which was at %04X) "
+                           "and starts predicting our future",
+                           self->authoritative.stepId, self->predicted.stepId)
+            rectifyAddTraceEvent(self, RectifyTraceEventTypePredictionReset, self->authoritative.stepId,
+                                 self->predicted.stepId, 0);
+            // seerSetState discards all predicted inputs before the `authoritativeTickId`
+            seerAuthoritativeGotNewState(&self->predicted, self->authoritative.stepId);
+            self->stats.predictionResets++;
+            rectifyResimulationBegin(&self->resimulation, self->predicted.stepId,
+                                     self->predicted.predictedSteps.expectedWriteId);
+        }
+        if (self->useSpeculation && self->predicted.stepId == self->authoritative.stepId) {
+            rectifyRestartSpeculativeBranches(self);
+        }
+        self->authoritativeHasBeenCopiedToPrediction = true;
+        self->predictionHasDiverged = false;
+    }
+
+    rectifyAdvancePrediction(self);
+
+    // The presentation keeps the previous complete prediction until the re-simulation is done.
+    // Before the first copy from the authoritative state, the predicted state has not been set at all.
+    if (self->usePresentation && self->authoritativeHasBeenCopiedToPrediction && !self->resimulation.isInProgress) {
+        TransmuteState predictedState = self->callbackObject.vtbl->predictionGetStateFn(self->callbackObject.self);
+        if (rectifyPresentationWrite(&self->presentation, &predictedState, self->predicted.stepId) < 0) {
+            CLOG_C_SOFT_ERROR(&self->log, "predicted state is too large for the presentation (%zu octets)",
+                              predictedState.octetSize)
+        }
+    }
+
+    // The branches are only needed for the next correction, so they are advanced after the presentation is written
+    if (self->useSpeculation) {
+        rectifyAdvanceSpeculativeBranches(self);
+    }
+
+    rectifyAddTraceEvent(self, RectifyTraceEventTypeUpdateEnd, self->predicted.stepId,
+                         self->catchUp.report.ticksLastUpdate, self->authoritativeBacklogAfterUpdate);
+}
+
+/// Assent and Seer only have room for RectifySetup::maxActivePlayerCount participants in each step, so a step with
+/// more participants is rejected instead of being truncated.
+static bool rectifyParticipantCountFits(Rectify* self, size_t participantCount, StepId tickId)
+{
+    if (participantCount <= self->stepParticipantCapacity) {
+        return true;
+    }
+
+    CLOG_C_SOFT_ERROR(&self->log, "authoritative step %04X has %zu participants, but maxActivePlayerCount is %zu",
+                      tickId, participantCount, self->stepParticipantCapacity)
+    rectifyCountAddedAuthoritativeStep(self, tickId, self->authoritative.authoritativeSteps.expectedWriteId,
+                                       RECTIFY_ERROR_TOO_MANY_PARTICIPANTS);
+    return false;
+}
+
+/// The participant count of a combined step, as serialized by nimble-steps-serialize
+static size_t rectifyCombinedStepParticipantCount(const uint8_t* combinedStep, size_t octetCount)
+{
+    return octetCount > 0 ? combinedStep[0] : 0;
 }
 
+/// Returns RECTIFY_ERROR_TOO_MANY_PARTICIPANTS if `input` has more participants than
+/// RectifySetup::maxActivePlayerCount.
 ssize_t rectifyAddAuthoritativeStep(Rectify* self, const TransmuteInput* input, StepId tickId)
 {
-    return assentAddAuthoritativeStep(&self->authoritative, input, tickId);
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    if (!rectifyParticipantCountFits(self, input->participantCount, tickId)) {
+        return RECTIFY_ERROR_TOO_MANY_PARTICIPANTS;
+    }
+    if (self->replayRecorder != 0) {
+        rectifyReplayRecorderAddInputStep(self->replayRecorder, input, tickId);
+    }
+    StepId expectedWriteId = self->authoritative.authoritativeSteps.expectedWriteId;
+    ssize_t result = assentAddAuthoritativeStep(&self->authoritative, input, tickId);
+    rectifyCountAddedAuthoritativeStep(self, tickId, expectedWriteId, result);
+    return result;
+}
+
+/// Jumps the authoritative state to a snapshot from the server, instead of ticking all the steps up to it.
+/// Queued authoritative steps before `stepId` are discarded, and the prediction is reset from the snapshot in the
+/// next rectifyUpdate().
+/// Returns 0 on success, or -1 if the snapshot is older than the current authoritative state.
+int rectifySetAuthoritativeSnapshot(Rectify* self, TransmuteState state, StepId stepId)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    StepId authoritativeStepId = self->authoritative.stepId;
+    if (stepId < authoritativeStepId) {
+        CLOG_C_NOTICE(&self->log, "authoritative snapshot %04X is older than the authoritative state %04X", stepId,
+                      authoritativeStepId)
+        return -1;
+    }
+
+    if (self->replayRecorder != 0) {
+        rectifyReplayRecorderAddSnapshot(self->replayRecorder, &state, stepId);
+    }
+
+    size_t discardedStepCount = rectifyAuthoritativeBacklog(self);
+    NbsSteps* authoritativeSteps = &self->authoritative.authoritativeSteps;
+    if (authoritativeSteps->expectedWriteId > stepId) {
+        // The steps after the snapshot are kept
+        nbsStepsDiscardUpTo(authoritativeSteps, stepId);
+    } else {
+        nbsStepsReInit(authoritativeSteps, stepId);
+    }
+    discardedStepCount -= rectifyAuthoritativeBacklog(self);
+    self->authoritative.stepId = stepId;
+
+    CLOG_C_DEBUG(&self->log, "authoritative snapshot at %04X, skipped %04X steps and discarded %zu queued", stepId,
+                 stepId - authoritativeStepId, discardedStepCount)
+    rectifyAuthoritativeDeserialize(self, &state, stepId);
+    self->authoritativeSnapshotWasSet = true;
+
+    self->stats.authoritativeSnapshots++;
+    self->stats.authoritativeSnapshotSkippedSteps += stepId - authoritativeStepId;
+    rectifyAddTraceEvent(self, RectifyTraceEventTypeAuthoritativeSnapshot, stepId, stepId - authoritativeStepId,
+                         discardedStepCount);
+
+    return 0;
+}
+
+/// Checks if RectifySetup::snapshotPolicy prefers a snapshot at `stepId` over ticking through the steps up to it
+bool rectifyPrefersAuthoritativeSnapshot(const Rectify* self, StepId stepId)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    if (stepId <= self->authoritative.stepId) {
+        return false;
+    }
+
+    return rectifyCatchUpPrefersSnapshot(&self->catchUp, &self->snapshotPolicy, stepId - self->authoritative.stepId);
+}
+
+/// Sets the snapshot if RectifySetup::snapshotPolicy prefers it, e.g. for late joins or large backlogs.
+/// Returns 1 if the snapshot was set, 0 if ticking through the steps is preferred.
+int rectifyOfferAuthoritativeSnapshot(Rectify* self, TransmuteState state, StepId stepId)
+{
+    if (!rectifyPrefersAuthoritativeSnapshot(self, stepId)) {
+        return 0;
+    }
+
+    int result = rectifySetAuthoritativeSnapshot(self, state, stepId);
+    if (result < 0) {
+        return result;
+    }
+
+    return 1;
+}
+
+/// Adds the server hash of the authoritative state after `stepId` was ticked, see RectifySetup::desync.
+/// Only steps on the checkpoint interval are compared. Returns 1 if verified, 0 if waiting for the local state,
+/// -1 if the hashes differ and -2 if the step is not a checkpoint.
+int rectifyAddAuthoritativeHash(Rectify* self, StepId stepId, uint64_t hash)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    if (!self->useDesync || !rectifyDesyncIsCheckpoint(&self->desync, stepId)) {
+        return -2;
+    }
+
+    RectifyDesyncResult result = rectifyDesyncAddServer(&self->desync, stepId, hash);
+    rectifyHandleDesyncResult(self, stepId, result);
+    switch (result) {
+        case RectifyDesyncResultVerified:
+            return 1;
+        case RectifyDesyncResultDesynced:
+            return -1;
+        case RectifyDesyncResultPending:
+            break;
+    }
+
+    return 0;
 }
 
 int rectifyAddAuthoritativeStepRaw(Rectify* self, const uint8_t* combinedStep, size_t octetCount, StepId tickId)
 {
-    return assentAddAuthoritativeStepRaw(&self->authoritative, combinedStep, octetCount, tickId);
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    if (!rectifyParticipantCountFits(self, rectifyCombinedStepParticipantCount(combinedStep, octetCount), tickId)) {
+        return RECTIFY_ERROR_TOO_MANY_PARTICIPANTS;
+    }
+    if (self->replayRecorder != 0) {
+        rectifyReplayRecorderAddRawStep(self->replayRecorder, combinedStep, octetCount, tickId);
+    }
+    StepId expectedWriteId = self->authoritative.authoritativeSteps.expectedWriteId;
+    int result = assentAddAuthoritativeStepRaw(&self->authoritative, combinedStep, octetCount, tickId);
+    rectifyCountAddedAuthoritativeStep(self, tickId, expectedWriteId, result);
+    return result;
+}
+
+/// Writes `combinedStep` to `target` in the RECTIFY_AUTHORITATIVE_STEPS_RAW_LENGTH_OCTET_SIZE framing.
+/// Returns the number of octets written, or a negative error code if it does not fit.
+int rectifyWriteAuthoritativeStepsRawStep(uint8_t* target, size_t maxOctetCount, const uint8_t* combinedStep,
+                                          size_t octetCount)
+{
+    if (octetCount > UINT16_MAX) {
+        return -1;
+    }
+    if (RECTIFY_AUTHORITATIVE_STEPS_RAW_LENGTH_OCTET_SIZE + octetCount > maxOctetCount) {
+        return -2;
+    }
+
+    target[0] = (uint8_t) (octetCount >> 8u);
+    target[1] = (uint8_t) (octetCount & 0xffu);
+    tc_memcpy_octets(target + RECTIFY_AUTHORITATIVE_STEPS_RAW_LENGTH_OCTET_SIZE, combinedStep, octetCount);
+
+    return (int) (RECTIFY_AUTHORITATIVE_STEPS_RAW_LENGTH_OCTET_SIZE + octetCount);
+}
+
+/// Checks that `buffer` holds exactly `stepCount` framed steps
+static int rectifyValidateAuthoritativeStepsRaw(Rectify* self, const uint8_t* buffer, size_t octetCount,
+                                                size_t stepCount)
+{
+    size_t pos = 0;
+    for (size_t i = 0; i < stepCount; ++i) {
+        if (pos + RECTIFY_AUTHORITATIVE_STEPS_RAW_LENGTH_OCTET_SIZE > octetCount) {
+            CLOG_C_SOFT_ERROR(&self->log, "authoritative steps buffer ended prematurely at step %zu of %zu", i,
+                              stepCount)
+            return -1;
+        }
+        size_t stepOctetCount = ((size_t) buffer[pos] << 8u) | buffer[pos + 1];
+        pos += RECTIFY_AUTHORITATIVE_STEPS_RAW_LENGTH_OCTET_SIZE;
+        if (pos + stepOctetCount > octetCount) {
+            CLOG_C_SOFT_ERROR(&self->log, "authoritative step %zu is larger than the buffer (%zu octets)", i,
+                              stepOctetCount)
+            return -2;
+        }
+        pos += stepOctetCount;
+    }
+
+    if (pos != octetCount) {
+        CLOG_C_SOFT_ERROR(&self->log, "authoritative steps buffer has %zu octets after the last step",
+                          octetCount - pos)
+        return -3;
+    }
+
+    return 0;
+}
+
+/// Adds a range of consecutive authoritative steps, as received in a single redundant datagram.
+/// See RECTIFY_AUTHORITATIVE_STEPS_RAW_LENGTH_OCTET_SIZE for the format of `buffer`.
+/// The whole buffer is validated first. If it is malformed, or if the steps start after the next expected step,
+/// nothing is added and a negative error code is returned.
+/// Steps that have already been received are skipped without being copied.
+/// Returns the number of steps that were added, which is less than the new steps only if a step had too many
+/// participants or Assent rejected one.
+int rectifyAddAuthoritativeStepsRaw(Rectify* self, const uint8_t* buffer, size_t octetCount, StepId firstStepId,
+                                    size_t stepCount)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+
+    int validateResult = rectifyValidateAuthoritativeStepsRaw(self, buffer, octetCount, stepCount);
+    if (validateResult < 0) {
+        return validateResult;
+    }
+
+    StepId expectedWriteId = self->authoritative.authoritativeSteps.expectedWriteId;
+    if (stepCount > 0 && firstStepId > expectedWriteId) {
+        CLOG_C_NOTICE(&self->log, "authoritative steps start at %04X, but %04X is expected next", firstStepId,
+                      expectedWriteId)
+        self->stats.rejectedAuthoritativeSteps += stepCount;
+        rectifyAddTraceEvent(self, RectifyTraceEventTypeAuthoritativeStepRejected, firstStepId, 4, 0);
+        return -4;
+    }
+
+    size_t pos = 0;
+    int addedCount = 0;
+    for (size_t i = 0; i < stepCount; ++i) {
+        size_t stepOctetCount = ((size_t) buffer[pos] << 8u) | buffer[pos + 1];
+        pos += RECTIFY_AUTHORITATIVE_STEPS_RAW_LENGTH_OCTET_SIZE;
+        const uint8_t* combinedStep = buffer + pos;
+        pos += stepOctetCount;
+
+        StepId stepId = firstStepId + (StepId) i;
+        if (stepId < self->authoritative.authoritativeSteps.expectedWriteId) {
+            self->stats.duplicateAuthoritativeSteps++;
+            continue;
+        }
+
+        if (!rectifyParticipantCountFits(self, rectifyCombinedStepParticipantCount(combinedStep, stepOctetCount),
+                                         stepId)) {
+            break;
+        }
+        if (self->replayRecorder != 0) {
+            rectifyReplayRecorderAddRawStep(self->replayRecorder, combinedStep, stepOctetCount, stepId);
+        }
+        StepId stepExpectedWriteId = self->authoritative.authoritativeSteps.expectedWriteId;
+        int result = assentAddAuthoritativeStepRaw(&self->authoritative, combinedStep, stepOctetCount, stepId);
+        rectifyCountAddedAuthoritativeStep(self, stepId, stepExpectedWriteId, result);
+        if (result < 0) {
+            // The steps after this one would not be consecutive anymore
+            break;
+        }
+        addedCount++;
+    }
+
+    return addedCount;
 }
 
 bool rectifyMustAddPredictedStepThisTick(const Rectify* self)
 {
-    return seerShouldAddPredictedStepThisTick(&self->predicted);
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    // Seer's own limit is only set for each prediction update, see rectifyPredictionTicksThisUpdate()
+    return self->predicted.predictedSteps.stepsCount < self->predictionWindow.effectiveTicks;
 }
 
+/// Returns how many predicted steps can be ahead of the authoritative state right now, see
+/// RectifySetup::predictionWindow. A shorter window also means fewer ticks to re-simulate after a misprediction.
+size_t rectifyEffectivePredictionWindow(const Rectify* self)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    return self->predictionWindow.effectiveTicks;
+}
+
+/// Returns the recommended duration of the next local ticks, in permille of the normal tick duration.
+/// Ticking a bit slower or faster keeps the prediction lead at RectifySetup::timeSync targetLeadTicks, which keeps
+/// the re-simulations after mispredictions short. Always 1000 if the time sync is disabled.
+uint32_t rectifyTickDurationPermille(const Rectify* self)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    return self->timeSync.tickDurationPermille;
+}
+
+/// Returns false while a re-simulation after a correction is spread over the updates, see
+/// RectifySetup::resimulation. The presentation state is the previous complete prediction until then.
+bool rectifyPredictionIsCurrent(const Rectify* self)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    return !self->resimulation.isInProgress;
+}
+
+/// Returns how many ticks later the local input is used, see RectifySetup::inputDelay
+size_t rectifyInputDelayTicks(const Rectify* self)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    return self->inputDelay.ticks;
+}
+
+/// Adds the local input for `tickId`. With an input delay the input is predicted for a later StepId.
 int rectifyAddPredictedStep(Rectify* self, const TransmuteInput* predictedInput, StepId tickId)
 {
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    StepId firstStepId;
+    size_t stepCount = rectifyInputDelayMap(&self->inputDelay, tickId, &firstStepId);
+    if (stepCount == 0) {
+        // The input delay just shrunk, so the delayed step already has an input
+        return 0;
+    }
+    StepId delayedStepId = firstStepId + (StepId) (stepCount - 1u);
+    // The lead is measured on the steps that are actually predicted
+    rectifyTimeSyncAddPredicted(&self->timeSync, delayedStepId);
     if (predictedInput->participantCount > self->buildComposedPredictedInputMaxParticipantCount) {
         CLOG_C_ERROR(&self->log, "more input than was prepared for predictedInput:%zu, buildComposed:%zu",
                      predictedInput->participantCount, self->buildComposedPredictedInputMaxParticipantCount)
         // return -1;
     }
 
-    const TransmuteInput* lastAuthoritativeInput = &self->authoritative.lastTransmuteInput;
-    for (size_t i = 0; i < lastAuthoritativeInput->participantCount; ++i) {
-        const TransmuteParticipantInput* authoritativeParticipant = &lastAuthoritativeInput->participantInputs[i];
-        TransmuteParticipantInput* buildTarget = &self->buildComposedPredictedInput.participantInputs[i];
-        buildTarget->participantId = authoritativeParticipant->participantId;
-        buildTarget->localPartyId = 0; // localPartyId is not used in prediction
-        int foundInPredicted = transmuteInputFindParticipantId(predictedInput, authoritativeParticipant->participantId);
-        if (foundInPredicted < 0) {
-            // Set zero input for remote participants
-            //CLOG_C_VERBOSE(&self->log, "set null for remote participants")
-            buildTarget->octetSize = 0;
-            buildTarget->input = 0;
-            buildTarget->inputType = TransmuteParticipantInputTypeNoInputInTime;
-        } else {
-            TransmuteParticipantInput* participantInput = &predictedInput->participantInputs[foundInPredicted];
-            if (participantInput->input == 0 || participantInput->octetSize == 0) {
-                CLOG_C_ERROR(&self->log, "can not set empty participant input for prediction")
-            }
-            CLOG_ASSERT(participantInput->inputType == TransmuteParticipantInputTypeNormal,
-                        "local participants must be of normal type")
-            buildTarget->octetSize = participantInput->octetSize;
-            CLOG_ASSERT(participantInput->input != 0, "local participants must have a valid input pointer")
-            buildTarget->input = participantInput->input;
-            buildTarget->inputType = TransmuteParticipantInputTypeNormal;
+    if (self->composedLayoutIsDirty) {
+        rectifyRebuildComposedLayout(self);
+    }
+
+    // Clear the local inputs from the last call, so a local participant that leaves out its input this time is
+    // no input in time, instead of keeping a pointer to an input the caller may have reused. The remote
+    // participants are predicted again for every step below.
+    for (size_t i = 0; i < self->patchedComposedIndexCount; ++i) {
+        rectifySetComposedRemote(&self->buildComposedPredictedInput.participantInputs[self->patchedComposedIndices[i]]);
+    }
+    self->patchedComposedIndexCount = 0;
+    bool remoteInputIsPredicted = rectifyRemoteInputIsPredicted(self);
+
+    for (size_t i = 0; i < predictedInput->participantCount; ++i) {
+        const TransmuteParticipantInput* participantInput = &predictedInput->participantInputs[i];
+        int composedIndex = self->composedIndexForParticipantId[participantInput->participantId];
+        if (composedIndex < 0) {
+            // Local participant has not joined according to the authoritative input
+            continue;
+        }
+        if (participantInput->input == 0 || participantInput->octetSize == 0) {
+            CLOG_C_ERROR(&self->log, "can not set empty participant input for prediction")
+        }
+        CLOG_ASSERT(participantInput->inputType == TransmuteParticipantInputTypeNormal,
+                    "local participants must be of normal type")
+        CLOG_ASSERT(participantInput->input != 0, "local participants must have a valid input pointer")
+        rectifyRemotePredictorSetLocal(&self->remotePredictor, participantInput->participantId);
+        TransmuteParticipantInput* buildTarget = &self->buildComposedPredictedInput.participantInputs[composedIndex];
+        buildTarget->octetSize = participantInput->octetSize;
+        buildTarget->input = participantInput->input;
+        buildTarget->inputType = TransmuteParticipantInputTypeNormal;
+        self->patchedComposedIndices[self->patchedComposedIndexCount++] = (size_t) composedIndex;
+        if (self->patchedComposedIndexCount == self->buildComposedPredictedInputMaxParticipantCount) {
+            break;
         }
     }
-    self->buildComposedPredictedInput.participantCount = self->authoritative.lastTransmuteInput.participantCount;
 
     /* TODO: Check if this code is correct, but ignore it for now
         for (size_t i = 0; i < predictedInput->participantCount; ++i) {
@@ -215,5 +1346,109 @@ int rectifyAddPredictedStep(Rectify* self, const TransmuteInput* predictedInput,
         //return 0;
     }
 
-    return seerAddPredictedStep(&self->predicted, &self->buildComposedPredictedInput, tickId);
+    // Right after the input delay grew, the same local input is used for the steps in between
+    int result = 0;
+    for (size_t i = 0; i < stepCount; ++i) {
+        StepId stepId = firstStepId + (StepId) i;
+        if (remoteInputIsPredicted) {
+            rectifyPredictComposedRemotes(self, stepId);
+        }
+        result = seerAddPredictedStep(&self->predicted, &self->buildComposedPredictedInput, stepId);
+        if (result < 0) {
+            self->stats.rejectedPredictedSteps++;
+            rectifyAddTraceEvent(self, RectifyTraceEventTypePredictedStepRejected, stepId, (size_t) -result, 0);
+            return result;
+        }
+        rectifyAddTraceEvent(self, RectifyTraceEventTypePredictedStepAdded, stepId, 0, 0);
+
+        rectifyInputHistoryWrite(&self->predictedInputs, &self->buildComposedPredictedInput, stepId);
+    }
+
+    return result;
+}
+
+/// Returns how the authoritative catch up went during the last rectifyUpdate()
+const RectifyCatchUpReport* rectifyCatchUpReport(const Rectify* self)
+{
+    return &self->catchUp.report;
+}
+
+const RectifyStats* rectifyStats(const Rectify* self)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    return &self->stats;
+}
+
+/// Starts a new stats window. The current authoritative backlog is kept, since it is not a counter.
+void rectifyStatsReset(Rectify* self)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    size_t authoritativeBacklog = self->stats.authoritativeBacklog;
+    rectifyStatsClear(&self->stats);
+    rectifyRemotePredictorClearCounters(&self->remotePredictor);
+    self->stats.authoritativeBacklog = authoritativeBacklog;
+    self->stats.maxAuthoritativeBacklog = authoritativeBacklog;
+    self->stats.predictionWindowTicks = self->predictionWindow.effectiveTicks;
+    self->stats.inputDelayTicks = self->inputDelay.ticks;
+}
+
+/// Returns the trace ring, or NULL if it was not enabled in the setup
+const RectifyTrace* rectifyGetTrace(const Rectify* self)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    return self->useTrace ? &self->trace : 0;
+}
+
+/// The first checkpoint where the authoritative state differed from the server, and the last one that was the same
+const RectifyDesyncReport* rectifyDesyncReport(const Rectify* self)
+{
+    return self->useDesync ? &self->desync.report : 0;
+}
+
+/// Waits until the prediction started by the last rectifyUpdate() is done.
+/// Must be called before the predicted VM is read directly, when async prediction is enabled.
+void rectifyPredictionFence(const Rectify* self)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+}
+
+bool rectifyPredictionIsBusy(const Rectify* self)
+{
+    return rectifyPredictionWorkerIsBusy(&self->predictionWorker);
+}
+
+/// Returns the most recent complete predicted state, without waiting for an ongoing prediction.
+/// Returns NULL if the presentation is not enabled, or if no prediction has been done yet.
+const RectifyPresentationState* rectifyPresentationState(Rectify* self)
+{
+    if (!self->usePresentation) {
+        return 0;
+    }
+
+    return rectifyPresentationRead(&self->presentation);
+}
+
+/// Returns the last seen input and the prediction hit and miss counters for a participant.
+/// Returns NULL if the participant is not in the last authoritative step.
+const RectifyRemoteParticipant* rectifyRemoteParticipant(const Rectify* self, uint8_t participantId)
+{
+    rectifyPredictionWorkerFence(&self->predictionWorker);
+    return rectifyRemotePredictorFind(&self->remotePredictor, participantId);
+}
+
+/// Memory for the authoritative state, only valid if RectifySetup::stateArenaOctetSize was set.
+/// The application writes its state directly in the arena. The written pages are detected, see RectifyStateArena,
+/// so the copy to the prediction only needs to copy those pages.
+RectifyStateArena* rectifyAuthoritativeStateArena(Rectify* self)
+{
+    return self->useStateArenas ? &self->authoritativeStateArena : 0;
+}
+
+/// Memory for the predicted state, only valid if RectifySetup::stateArenaOctetSize was set.
+/// Rectify copies the pages that were written in either arena since the last copy from the authoritative state.
+/// With speculative branches, the octets are exchanged with a branch arena, so `octets` must be read from the arena
+/// in every predictionTickFn instead of being kept by the application.
+RectifyStateArena* rectifyPredictedStateArena(Rectify* self)
+{
+    return self->useStateArenas ? &self->predictedStateArena : 0;
 }
@@ -0,0 +1,198 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <imprint/allocator.h>
+#include <rectify/input_history.h>
+#include <rectify/remote_predictor.h>
+#include <tiny-libc/tiny_libc.h>
+
+void rectifyRemotePredictorInit(RectifyRemotePredictor* self, struct ImprintAllocator* allocator,
+                                RectifyRemotePredictorSetup setup, size_t maxParticipantCount, size_t maxOctetSize)
+{
+    self->setup = setup;
+    self->maxOctetSize = maxOctetSize;
+    self->maxParticipantCount = maxParticipantCount;
+    self->participants = IMPRINT_ALLOC_TYPE_COUNT(allocator, RectifyRemoteParticipant, maxParticipantCount);
+    self->octets = 0;
+    self->neutralOctets = 0;
+    if (setup.mode != RectifyRemoteInputPredictionModeNoInput) {
+        self->octets = IMPRINT_ALLOC_TYPE_COUNT(allocator, uint8_t, maxParticipantCount * maxOctetSize);
+        self->neutralOctets = IMPRINT_ALLOC_TYPE_COUNT(allocator, uint8_t, maxOctetSize);
+        tc_mem_clear_type_n(self->neutralOctets, maxOctetSize);
+    }
+
+    for (size_t i = 0; i < maxParticipantCount; ++i) {
+        self->participants[i].octets = self->octets != 0 ? self->octets + i * maxOctetSize : 0;
+    }
+
+    rectifyRemotePredictorReInit(self);
+}
+
+/// Forgets all participants, keeps the memory
+void rectifyRemotePredictorReInit(RectifyRemotePredictor* self)
+{
+    self->participantCount = 0;
+    for (size_t i = 0; i < RECTIFY_PARTICIPANT_ID_COUNT; ++i) {
+        self->participantIndexForParticipantId[i] = -1;
+    }
+}
+
+/// Returns null if the participant has not been seen, or has left
+const RectifyRemoteParticipant* rectifyRemotePredictorFind(const RectifyRemotePredictor* self, uint8_t participantId)
+{
+    int index = self->participantIndexForParticipantId[participantId];
+    return index < 0 ? 0 : &self->participants[index];
+}
+
+static RectifyRemoteParticipant* rectifyRemotePredictorFindOrAdd(RectifyRemotePredictor* self, uint8_t participantId)
+{
+    int index = self->participantIndexForParticipantId[participantId];
+    if (index >= 0) {
+        return &self->participants[index];
+    }
+    if (self->participantCount == self->maxParticipantCount) {
+        return 0;
+    }
+
+    RectifyRemoteParticipant* participant = &self->participants[self->participantCount];
+    self->participantIndexForParticipantId[participantId] = (int16_t) self->participantCount;
+    self->participantCount++;
+
+    participant->participantId = participantId;
+    participant->isLocal = false;
+    participant->hasInput = false;
+    participant->lastSeenStepId = 0;
+    participant->lastPresentStepId = 0;
+    participant->octetSize = 0;
+    participant->hits = 0;
+    participant->misses = 0;
+
+    return participant;
+}
+
+/// Gives back the slots of the participants that were not in the authoritative step, by moving the last slot
+/// into the released one. The octets of the two slots are swapped along, so each slot keeps its own memory.
+static void rectifyRemotePredictorRemoveLeft(RectifyRemotePredictor* self, StepId stepId)
+{
+    size_t index = 0;
+    while (index < self->participantCount) {
+        RectifyRemoteParticipant* participant = &self->participants[index];
+        if (participant->lastPresentStepId == stepId) {
+            index++;
+            continue;
+        }
+
+        self->participantIndexForParticipantId[participant->participantId] = -1;
+        self->participantCount--;
+        if (index != self->participantCount) {
+            RectifyRemoteParticipant* last = &self->participants[self->participantCount];
+            RectifyRemoteParticipant left = *participant;
+            *participant = *last;
+            *last = left;
+            self->participantIndexForParticipantId[participant->participantId] = (int16_t) index;
+        }
+    }
+}
+
+/// Local participants are set by the application, so they are never predicted or counted
+void rectifyRemotePredictorSetLocal(RectifyRemotePredictor* self, uint8_t participantId)
+{
+    RectifyRemoteParticipant* participant = rectifyRemotePredictorFindOrAdd(self, participantId);
+    if (participant != 0) {
+        participant->isLocal = true;
+    }
+}
+
+bool rectifyRemotePredictorIsLocal(const RectifyRemotePredictor* self, uint8_t participantId)
+{
+    const RectifyRemoteParticipant* participant = rectifyRemotePredictorFind(self, participantId);
+    return participant != 0 && participant->isLocal;
+}
+
+static bool rectifyParticipantInputIsEqual(const TransmuteParticipantInput* a, const TransmuteParticipantInput* b)
+{
+    if (a->inputType != b->inputType || a->octetSize != b->octetSize) {
+        return false;
+    }
+
+    return a->octetSize == 0 || tc_memcmp(a->input, b->input, a->octetSize) == 0;
+}
+
+/// Counts how well the remote participants were predicted, and remembers the last input for each of them.
+/// `predictedInput` is the input that was used when predicting the same step, or null if it was not predicted.
+/// Participants that are not in `authoritativeInput` have left, and are forgotten, also if they were local.
+void rectifyRemotePredictorAddAuthoritative(RectifyRemotePredictor* self, const TransmuteInput* authoritativeInput,
+                                            const TransmuteInput* predictedInput, StepId stepId)
+{
+    for (size_t i = 0; i < authoritativeInput->participantCount; ++i) {
+        const TransmuteParticipantInput* authoritativeParticipant = &authoritativeInput->participantInputs[i];
+        uint8_t participantId = authoritativeParticipant->participantId;
+        RectifyRemoteParticipant* participant = rectifyRemotePredictorFindOrAdd(self, participantId);
+        if (participant == 0) {
+            // More participants than maxParticipantCount, the rest is predicted as no input in time
+            continue;
+        }
+        participant->lastPresentStepId = stepId;
+        if (participant->isLocal) {
+            continue;
+        }
+
+        if (predictedInput != 0) {
+            // The composed predicted input uses the same participant order as the authoritative input
+            const TransmuteParticipantInput* predictedParticipant = i < predictedInput->participantCount
+                                                                        ? &predictedInput->participantInputs[i]
+                                                                        : 0;
+            if (predictedParticipant != 0 &&
+                predictedParticipant->participantId == authoritativeParticipant->participantId) {
+                if (rectifyParticipantInputIsEqual(authoritativeParticipant, predictedParticipant)) {
+                    participant->hits++;
+                } else {
+                    participant->misses++;
+                }
+            }
+        }
+
+        if (participant->octets == 0 || authoritativeParticipant->inputType != TransmuteParticipantInputTypeNormal ||
+            authoritativeParticipant->octetSize > self->maxOctetSize) {
+            continue;
+        }
+
+        tc_memcpy_octets(participant->octets, authoritativeParticipant->input, authoritativeParticipant->octetSize);
+        participant->octetSize = authoritativeParticipant->octetSize;
+        participant->lastSeenStepId = stepId;
+        participant->hasInput = true;
+    }
+
+    rectifyRemotePredictorRemoveLeft(self, stepId);
+}
+
+/// Sets the predicted input for a remote participant. `participantInput->participantId` must already be set.
+/// The input points into the predictor, and is valid until the participant is seen in an authoritative step again.
+void rectifyRemotePredictorPredict(const RectifyRemotePredictor* self, StepId stepId,
+                                   TransmuteParticipantInput* participantInput)
+{
+    const RectifyRemoteParticipant* participant = rectifyRemotePredictorFind(self, participantInput->participantId);
+
+    if (self->setup.mode == RectifyRemoteInputPredictionModeNoInput || participant == 0 || !participant->hasInput) {
+        participantInput->octetSize = 0;
+        participantInput->input = 0;
+        participantInput->inputType = TransmuteParticipantInputTypeNoInputInTime;
+        return;
+    }
+
+    participantInput->octetSize = participant->octetSize;
+    participantInput->inputType = TransmuteParticipantInputTypeNormal;
+    bool hasDecayed = self->setup.mode == RectifyRemoteInputPredictionModeDecayToNeutral &&
+                      stepId > participant->lastSeenStepId &&
+                      stepId - participant->lastSeenStepId > self->setup.decayAfterTicks;
+    participantInput->input = hasDecayed ? self->neutralOctets : participant->octets;
+}
+
+void rectifyRemotePredictorClearCounters(RectifyRemotePredictor* self)
+{
+    for (size_t i = 0; i < self->participantCount; ++i) {
+        self->participants[i].hits = 0;
+        self->participants[i].misses = 0;
+    }
+}
@@ -0,0 +1,269 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#if (defined TORNADO_OS_LINUX || defined TORNADO_OS_MACOS) && !defined __EMSCRIPTEN__
+#define RECTIFY_REPLAY_USE_MMAP
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <imprint/allocator.h>
+#include <rectify/replay.h>
+#include <stdint.h>
+#include <tiny-libc/tiny_libc.h>
+
+// Steps handed over before each update, the catch up is unlimited so all of them are ticked
+#define RECTIFY_REPLAY_STEPS_PER_UPDATE (32u)
+
+static uint16_t rectifyReplayReadUint16(const uint8_t* source)
+{
+    return (uint16_t) (source[0] | (source[1] << 8u));
+}
+
+static uint32_t rectifyReplayReadUint32(const uint8_t* source)
+{
+    return (uint32_t) source[0] | ((uint32_t) source[1] << 8u) | ((uint32_t) source[2] << 16u) |
+           ((uint32_t) source[3] << 24u);
+}
+
+/// Without mmap the whole file is read into memory from the allocator
+static int rectifyReplayLoad(RectifyReplay* self, struct ImprintAllocator* allocator, const char* path)
+{
+#if defined RECTIFY_REPLAY_USE_MMAP
+    (void) allocator;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) {
+        close(fd);
+        return -2;
+    }
+    void* mapped = mmap(0, (size_t) fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return -3;
+    }
+    // The records are read front to back, exactly once
+    madvise(mapped, (size_t) fileStat.st_size, MADV_SEQUENTIAL);
+    self->octets = (const uint8_t*) mapped;
+    self->octetCount = (size_t) fileStat.st_size;
+    self->isMapped = true;
+#else
+    FILE* file = fopen(path, "rb");
+    if (file == 0) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (fileSize <= 0) {
+        fclose(file);
+        return -2;
+    }
+    uint8_t* octets = IMPRINT_ALLOC_TYPE_COUNT(allocator, uint8_t, (size_t) fileSize);
+    size_t readCount = fread(octets, 1, (size_t) fileSize, file);
+    fclose(file);
+    if (readCount != (size_t) fileSize) {
+        return -3;
+    }
+    self->octets = octets;
+    self->octetCount = readCount;
+    self->isMapped = false;
+#endif
+
+    return 0;
+}
+
+/// Opens a replay file written by RectifyReplayRecorder
+/// @param maxParticipantCount the max participant count of the input steps
+int rectifyReplayOpen(RectifyReplay* self, struct ImprintAllocator* allocator, const char* path,
+                      size_t maxParticipantCount)
+{
+    self->octets = 0;
+    self->octetCount = 0;
+    self->position = 0;
+    self->isMapped = false;
+
+    int result = rectifyReplayLoad(self, allocator, path);
+    if (result < 0) {
+        return result;
+    }
+
+    if (self->octetCount < RECTIFY_REPLAY_FILE_HEADER_OCTET_SIZE ||
+        tc_memcmp(self->octets, RECTIFY_REPLAY_MAGIC, RECTIFY_REPLAY_MAGIC_OCTET_SIZE) != 0 ||
+        rectifyReplayReadUint32(self->octets + RECTIFY_REPLAY_MAGIC_OCTET_SIZE) != RECTIFY_REPLAY_VERSION) {
+        rectifyReplayClose(self);
+        return -4;
+    }
+
+    self->maxParticipantCount = maxParticipantCount;
+    self->participantInputs = IMPRINT_ALLOC_TYPE_COUNT(allocator, TransmuteParticipantInput, maxParticipantCount);
+    rectifyReplayRewind(self);
+
+    return 0;
+}
+
+void rectifyReplayRewind(RectifyReplay* self)
+{
+    self->position = RECTIFY_REPLAY_FILE_HEADER_OCTET_SIZE;
+}
+
+static int rectifyReplayDecodeInputStep(RectifyReplay* self, RectifyReplayRecord* record)
+{
+    if (record->octetCount < 2) {
+        return -1;
+    }
+    size_t participantCount = rectifyReplayReadUint16(record->octets);
+    if (participantCount > self->maxParticipantCount) {
+        return -2;
+    }
+
+    size_t position = 2;
+    for (size_t i = 0; i < participantCount; ++i) {
+        if (position + RECTIFY_REPLAY_PARTICIPANT_HEADER_OCTET_SIZE > record->octetCount) {
+            return -1;
+        }
+        const uint8_t* header = record->octets + position;
+        TransmuteParticipantInput* participantInput = &self->participantInputs[i];
+        participantInput->participantId = header[0];
+        participantInput->localPartyId = header[1];
+        participantInput->inputType = (TransmuteParticipantInputType) header[2];
+        participantInput->octetSize = rectifyReplayReadUint16(&header[4]);
+        position += RECTIFY_REPLAY_PARTICIPANT_HEADER_OCTET_SIZE;
+        if (position + participantInput->octetSize > record->octetCount) {
+            return -1;
+        }
+        participantInput->input = participantInput->octetSize > 0 ? record->octets + position : 0;
+        position += participantInput->octetSize;
+    }
+
+    record->input.participantInputs = self->participantInputs;
+    record->input.participantCount = participantCount;
+
+    return 0;
+}
+
+/// Reads the next record. Returns 1 if a record was read, 0 at the end of the file, and a negative error code if
+/// the file is malformed. A truncated last record, e.g. from a crash while recording, is reported as the end.
+int rectifyReplayNext(RectifyReplay* self, RectifyReplayRecord* record)
+{
+    if (self->position + RECTIFY_REPLAY_RECORD_HEADER_OCTET_SIZE > self->octetCount) {
+        return 0;
+    }
+
+    const uint8_t* header = self->octets + self->position;
+    record->type = (RectifyReplayRecordType) header[0];
+    record->stepId = (StepId) rectifyReplayReadUint32(&header[4]);
+    record->octetCount = rectifyReplayReadUint32(&header[8]);
+    record->octets = header + RECTIFY_REPLAY_RECORD_HEADER_OCTET_SIZE;
+    if (self->position + RECTIFY_REPLAY_RECORD_HEADER_OCTET_SIZE + record->octetCount > self->octetCount) {
+        return 0;
+    }
+
+    switch (record->type) {
+        case RectifyReplayRecordTypeState:
+        case RectifyReplayRecordTypeSnapshot:
+            record->state.state = record->octets;
+            record->state.octetSize = record->octetCount;
+            break;
+        case RectifyReplayRecordTypeRawStep:
+            break;
+        case RectifyReplayRecordTypeInputStep:
+            if (rectifyReplayDecodeInputStep(self, record) < 0) {
+                return -2;
+            }
+            break;
+        default:
+            return -1;
+    }
+
+    self->position += RECTIFY_REPLAY_RECORD_HEADER_OCTET_SIZE + record->octetCount;
+
+    return 1;
+}
+
+void rectifyReplayClose(RectifyReplay* self)
+{
+#if defined RECTIFY_REPLAY_USE_MMAP
+    if (self->isMapped) {
+        munmap((void*) self->octets, self->octetCount);
+    }
+#endif
+    self->octets = 0;
+    self->octetCount = 0;
+    self->isMapped = false;
+}
+
+/// Feeds the whole replay to Rectify, ticking the authoritative steps as fast as the application can.
+/// The first state record initializes `rectify`, later state records reset it and snapshots are set as they were
+/// when recorded. The catch up is unlimited and nothing is recorded, the rest of the setup is used as is.
+/// Returns zero when the end of the replay was reached, or a negative error code.
+int rectifyReplayRun(RectifyReplay* self, Rectify* rectify, RectifyCallbackObject callbackObject, RectifySetup setup,
+                     RectifyReplayReport* report)
+{
+    tc_mem_clear_type(report);
+    MonotonicTimeMs startedAt = monotonicTimeMsNow();
+
+    setup.catchUp.mode = RectifyCatchUpModeTickCount;
+    setup.catchUp.maxTicksPerUpdate = SIZE_MAX;
+    setup.replayRecorder = 0;
+
+    bool isInitialized = false;
+    size_t stepsSinceUpdate = 0;
+    RectifyReplayRecord record;
+    int result;
+    while ((result = rectifyReplayNext(self, &record)) > 0) {
+        if (record.type == RectifyReplayRecordTypeState) {
+            if (isInitialized) {
+                rectifyUpdate(rectify);
+                report->authoritativeTicks += rectifyStats(rectify)->authoritativeTicks;
+                rectifyReset(rectify, record.state, record.stepId);
+            } else {
+                rectifyInit(rectify, callbackObject, setup, record.state, record.stepId);
+                isInitialized = true;
+            }
+            stepsSinceUpdate = 0;
+            report->stateCount++;
+            continue;
+        }
+
+        if (!isInitialized) {
+            result = -3;
+            break;
+        }
+
+        if (record.type == RectifyReplayRecordTypeSnapshot) {
+            rectifySetAuthoritativeSnapshot(rectify, record.state, record.stepId);
+            report->snapshotCount++;
+            continue;
+        }
+
+        int addResult = record.type == RectifyReplayRecordTypeRawStep
+                            ? rectifyAddAuthoritativeStepRaw(rectify, record.octets, record.octetCount, record.stepId)
+                            : (int) rectifyAddAuthoritativeStep(rectify, &record.input, record.stepId);
+        if (addResult < 0) {
+            report->rejectedStepCount++;
+        }
+        report->stepCount++;
+
+        if (++stepsSinceUpdate >= RECTIFY_REPLAY_STEPS_PER_UPDATE) {
+            rectifyUpdate(rectify);
+            stepsSinceUpdate = 0;
+        }
+    }
+
+    if (isInitialized) {
+        rectifyUpdate(rectify);
+        report->authoritativeTicks += rectifyStats(rectify)->authoritativeTicks;
+    }
+    report->elapsedMs = monotonicTimeMsNow() - startedAt;
+
+    return result < 0 ? result : 0;
+}
@@ -0,0 +1,184 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <imprint/allocator.h>
+#include <rectify/replay_recorder.h>
+#include <tiny-libc/tiny_libc.h>
+
+#define RECTIFY_REPLAY_RECORDER_DEFAULT_BLOCK_OCTET_SIZE (64 * 1024)
+
+static void rectifyReplayWriteUint16(uint8_t* target, uint16_t value)
+{
+    target[0] = (uint8_t) value;
+    target[1] = (uint8_t) (value >> 8u);
+}
+
+static void rectifyReplayWriteUint32(uint8_t* target, uint32_t value)
+{
+    target[0] = (uint8_t) value;
+    target[1] = (uint8_t) (value >> 8u);
+    target[2] = (uint8_t) (value >> 16u);
+    target[3] = (uint8_t) (value >> 24u);
+}
+
+/// @param blockOctetSize octets collected before each write to the file, zero means the default of 64 KiB
+int rectifyReplayRecorderOpen(RectifyReplayRecorder* self, struct ImprintAllocator* allocator, const char* path,
+                              size_t blockOctetSize)
+{
+    self->blockOctetSize = blockOctetSize > 0 ? blockOctetSize : RECTIFY_REPLAY_RECORDER_DEFAULT_BLOCK_OCTET_SIZE;
+    if (self->blockOctetSize < RECTIFY_REPLAY_FILE_HEADER_OCTET_SIZE) {
+        self->blockOctetSize = RECTIFY_REPLAY_FILE_HEADER_OCTET_SIZE;
+    }
+    self->blockOctetCount = 0;
+    self->recordCount = 0;
+    self->writtenOctetCount = 0;
+    self->hasFailed = false;
+    self->file = fopen(path, "wb");
+    if (self->file == 0) {
+        self->hasFailed = true;
+        return -1;
+    }
+    // The recorder does its own block buffering
+    setvbuf(self->file, 0, _IONBF, 0);
+    self->block = IMPRINT_ALLOC_TYPE_COUNT(allocator, uint8_t, self->blockOctetSize);
+
+    tc_memcpy_octets(self->block, RECTIFY_REPLAY_MAGIC, RECTIFY_REPLAY_MAGIC_OCTET_SIZE);
+    rectifyReplayWriteUint32(self->block + RECTIFY_REPLAY_MAGIC_OCTET_SIZE, RECTIFY_REPLAY_VERSION);
+    self->blockOctetCount = RECTIFY_REPLAY_FILE_HEADER_OCTET_SIZE;
+
+    return 0;
+}
+
+/// Writes the collected block to the file
+int rectifyReplayRecorderFlush(RectifyReplayRecorder* self)
+{
+    if (self->file == 0 || self->blockOctetCount == 0) {
+        return self->hasFailed ? -1 : 0;
+    }
+
+    size_t written = fwrite(self->block, 1, self->blockOctetCount, self->file);
+    self->writtenOctetCount += written;
+    if (written != self->blockOctetCount) {
+        self->hasFailed = true;
+    }
+    self->blockOctetCount = 0;
+
+    return self->hasFailed ? -1 : 0;
+}
+
+static void rectifyReplayRecorderWrite(RectifyReplayRecorder* self, const uint8_t* octets, size_t octetCount)
+{
+    if (octetCount == 0) {
+        return;
+    }
+
+    if (octetCount >= self->blockOctetSize) {
+        // Large states are written directly, instead of being copied through the block
+        rectifyReplayRecorderFlush(self);
+        size_t written = fwrite(octets, 1, octetCount, self->file);
+        self->writtenOctetCount += written;
+        if (written != octetCount) {
+            self->hasFailed = true;
+        }
+        return;
+    }
+
+    if (self->blockOctetCount + octetCount > self->blockOctetSize) {
+        rectifyReplayRecorderFlush(self);
+    }
+    tc_memcpy_octets(self->block + self->blockOctetCount, octets, octetCount);
+    self->blockOctetCount += octetCount;
+}
+
+static void rectifyReplayRecorderWriteRecordHeader(RectifyReplayRecorder* self, RectifyReplayRecordType type,
+                                                   StepId stepId, size_t octetCount)
+{
+    uint8_t header[RECTIFY_REPLAY_RECORD_HEADER_OCTET_SIZE];
+    header[0] = (uint8_t) type;
+    header[1] = 0;
+    header[2] = 0;
+    header[3] = 0;
+    rectifyReplayWriteUint32(&header[4], (uint32_t) stepId);
+    rectifyReplayWriteUint32(&header[8], (uint32_t) octetCount);
+    rectifyReplayRecorderWrite(self, header, sizeof(header));
+    self->recordCount++;
+}
+
+void rectifyReplayRecorderAddState(RectifyReplayRecorder* self, const TransmuteState* state, StepId stepId)
+{
+    if (self->file == 0) {
+        return;
+    }
+    rectifyReplayRecorderWriteRecordHeader(self, RectifyReplayRecordTypeState, stepId, state->octetSize);
+    rectifyReplayRecorderWrite(self, (const uint8_t*) state->state, state->octetSize);
+}
+
+void rectifyReplayRecorderAddSnapshot(RectifyReplayRecorder* self, const TransmuteState* state, StepId stepId)
+{
+    if (self->file == 0) {
+        return;
+    }
+    rectifyReplayRecorderWriteRecordHeader(self, RectifyReplayRecordTypeSnapshot, stepId, state->octetSize);
+    rectifyReplayRecorderWrite(self, (const uint8_t*) state->state, state->octetSize);
+}
+
+void rectifyReplayRecorderAddRawStep(RectifyReplayRecorder* self, const uint8_t* combinedStep, size_t octetCount,
+                                     StepId stepId)
+{
+    if (self->file == 0) {
+        return;
+    }
+    rectifyReplayRecorderWriteRecordHeader(self, RectifyReplayRecordTypeRawStep, stepId, octetCount);
+    rectifyReplayRecorderWrite(self, combinedStep, octetCount);
+}
+
+void rectifyReplayRecorderAddInputStep(RectifyReplayRecorder* self, const TransmuteInput* input, StepId stepId)
+{
+    if (self->file == 0) {
+        return;
+    }
+
+    size_t octetCount = 2;
+    for (size_t i = 0; i < input->participantCount; ++i) {
+        const TransmuteParticipantInput* participantInput = &input->participantInputs[i];
+        octetCount += RECTIFY_REPLAY_PARTICIPANT_HEADER_OCTET_SIZE;
+        if (participantInput->input != 0) {
+            octetCount += participantInput->octetSize;
+        }
+    }
+
+    rectifyReplayRecorderWriteRecordHeader(self, RectifyReplayRecordTypeInputStep, stepId, octetCount);
+    uint8_t participantCount[2];
+    rectifyReplayWriteUint16(participantCount, (uint16_t) input->participantCount);
+    rectifyReplayRecorderWrite(self, participantCount, sizeof(participantCount));
+
+    for (size_t i = 0; i < input->participantCount; ++i) {
+        const TransmuteParticipantInput* participantInput = &input->participantInputs[i];
+        size_t inputOctetCount = participantInput->input != 0 ? participantInput->octetSize : 0;
+        uint8_t header[RECTIFY_REPLAY_PARTICIPANT_HEADER_OCTET_SIZE];
+        header[0] = participantInput->participantId;
+        header[1] = participantInput->localPartyId;
+        header[2] = (uint8_t) participantInput->inputType;
+        header[3] = 0;
+        rectifyReplayWriteUint16(&header[4], (uint16_t) inputOctetCount);
+        rectifyReplayRecorderWrite(self, header, sizeof(header));
+        rectifyReplayRecorderWrite(self, (const uint8_t*) participantInput->input, inputOctetCount);
+    }
+}
+
+/// Writes the remaining records and closes the file
+int rectifyReplayRecorderClose(RectifyReplayRecorder* self)
+{
+    if (self->file == 0) {
+        return -1;
+    }
+
+    rectifyReplayRecorderFlush(self);
+    if (fclose(self->file) != 0) {
+        self->hasFailed = true;
+    }
+    self->file = 0;
+
+    return self->hasFailed ? -1 : 0;
+}
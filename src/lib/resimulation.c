@@ -0,0 +1,69 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <rectify/resimulation.h>
+#include <stdint.h>
+
+void rectifyResimulationInit(RectifyResimulation* self, RectifyResimulationSetup setup)
+{
+    self->setup = setup;
+    self->isEnabled = setup.maxTicksPerUpdate > 0 || setup.timeBudgetMs > 0;
+    rectifyResimulationReInit(self);
+}
+
+void rectifyResimulationReInit(RectifyResimulation* self)
+{
+    self->isInProgress = false;
+    self->targetStepId = 0;
+    self->updateCount = 0;
+    self->tickCount = 0;
+}
+
+/// Called after the prediction was corrected and is about to be re-simulated from `predictedStepId`.
+/// A re-simulation that was in progress is started over, since its prediction is not valid anymore.
+void rectifyResimulationBegin(RectifyResimulation* self, StepId predictedStepId, StepId targetStepId)
+{
+    self->isInProgress = self->isEnabled && targetStepId > predictedStepId;
+    self->targetStepId = targetStepId;
+    self->updateCount = 0;
+    self->tickCount = 0;
+}
+
+/// Returns the maximum number of predicted ticks this update
+/// @param tickCostMicroseconds measured cost of a simulation tick, zero if unknown
+size_t rectifyResimulationTicksThisUpdate(const RectifyResimulation* self, size_t tickCostMicroseconds)
+{
+    size_t maxTicks = self->setup.maxTicksPerUpdate > 0 ? self->setup.maxTicksPerUpdate : SIZE_MAX;
+    if (self->setup.timeBudgetMs > 0 && tickCostMicroseconds > 0) {
+        size_t ticksInBudget = (size_t) self->setup.timeBudgetMs * 1000u / tickCostMicroseconds;
+        if (ticksInBudget < maxTicks) {
+            maxTicks = ticksInBudget;
+        }
+    }
+    if (maxTicks == SIZE_MAX) {
+        // Only a time budget, and the tick cost is not known yet
+        maxTicks = 8u;
+    }
+
+    // At least one tick, otherwise the prediction would never become current
+    return maxTicks > 0 ? maxTicks : 1u;
+}
+
+/// Returns true when the re-simulation was completed by this update
+bool rectifyResimulationAdvance(RectifyResimulation* self, StepId predictedStepId, size_t ticks)
+{
+    if (!self->isInProgress) {
+        return false;
+    }
+
+    self->updateCount++;
+    self->tickCount += ticks;
+    if (predictedStepId < self->targetStepId) {
+        return false;
+    }
+
+    self->isInProgress = false;
+
+    return true;
+}
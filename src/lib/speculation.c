@@ -0,0 +1,182 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <imprint/allocator.h>
+#include <rectify/speculation.h>
+#include <tiny-libc/tiny_libc.h>
+
+void rectifySpeculationInit(RectifySpeculation* self, struct ImprintAllocator* allocator,
+                            const RectifySpeculationSetup* setup, size_t historyCapacity, size_t maxParticipantCount,
+                            size_t maxOctetSizeForSingleParticipant, size_t compactInputOctetSize,
+                            bool useDeltaEncodedInputs, size_t stateArenaOctetSize)
+{
+    self->branchCount = setup->branchCount;
+    if (self->branchCount > RECTIFY_SPECULATION_MAX_BRANCH_COUNT) {
+        self->branchCount = RECTIFY_SPECULATION_MAX_BRANCH_COUNT;
+    }
+    self->buildParticipantInputs = IMPRINT_ALLOC_TYPE_COUNT(allocator, TransmuteParticipantInput,
+                                                            maxParticipantCount);
+    self->maxParticipantCount = maxParticipantCount;
+
+    for (size_t i = 0; i < self->branchCount; ++i) {
+        RectifySpeculativeBranch* branch = &self->branches[i];
+        branch->hypothesis = setup->hypotheses[i];
+        branch->isValid = false;
+        branch->hasDiverged = false;
+        branch->startStepId = 0;
+        branch->stepId = 0;
+        rectifyStateArenaInit(&branch->arena, allocator, stateArenaOctetSize);
+        rectifyInputHistoryInit(&branch->inputs, allocator, historyCapacity, maxParticipantCount,
+                                maxOctetSizeForSingleParticipant, compactInputOctetSize,
+                                useDeltaEncodedInputs);
+    }
+}
+
+/// Unmaps the branch arenas
+void rectifySpeculationDestroy(RectifySpeculation* self)
+{
+    for (size_t i = 0; i < self->branchCount; ++i) {
+        rectifyStateArenaDestroy(&self->branches[i].arena);
+    }
+}
+
+/// All branches are restarted from the main prediction the next time the prediction advances
+void rectifySpeculationInvalidate(RectifySpeculation* self)
+{
+    for (size_t i = 0; i < self->branchCount; ++i) {
+        self->branches[i].isValid = false;
+    }
+}
+
+/// None of the branches can be used, typically because the predicted state itself could not be trusted
+void rectifySpeculationDiverge(RectifySpeculation* self)
+{
+    for (size_t i = 0; i < self->branchCount; ++i) {
+        self->branches[i].hasDiverged = true;
+    }
+}
+
+/// Compares an authoritative input with the input each branch used for the same step.
+/// `mainInput` is the input used by the main prediction, or null if the main prediction did not predict the step.
+void rectifySpeculationCheckAuthoritative(RectifySpeculation* self, const TransmuteInput* authoritativeInput,
+                                          const RectifyInputHistoryEntry* mainInput, StepId stepId)
+{
+    for (size_t i = 0; i < self->branchCount; ++i) {
+        RectifySpeculativeBranch* branch = &self->branches[i];
+        if (!branch->isValid || branch->hasDiverged) {
+            continue;
+        }
+        const RectifyInputHistoryEntry* usedInput = stepId < branch->startStepId
+                                                        ? mainInput
+                                                        : rectifyInputHistoryFind(&branch->inputs, stepId);
+        if (usedInput == 0 || !rectifyInputIsEqual(authoritativeInput, &usedInput->input)) {
+            branch->hasDiverged = true;
+        }
+    }
+}
+
+/// Finds a branch that matched all authoritative inputs so far and that has predicted as far as the main prediction
+RectifySpeculativeBranch* rectifySpeculationFindMatching(RectifySpeculation* self, StepId authoritativeStepId,
+                                                         StepId predictedStepId)
+{
+    for (size_t i = 0; i < self->branchCount; ++i) {
+        RectifySpeculativeBranch* branch = &self->branches[i];
+        if (branch->isValid && !branch->hasDiverged && branch->stepId == predictedStepId &&
+            branch->stepId >= authoritativeStepId) {
+            return branch;
+        }
+    }
+
+    return 0;
+}
+
+/// Starts the branch over from the state of the main prediction. `mainArena` must have the same size as the branch.
+void rectifySpeculationRestart(RectifySpeculation* self, size_t branchIndex, const RectifyStateArena* mainArena,
+                               StepId stepId)
+{
+    RectifySpeculativeBranch* branch = &self->branches[branchIndex];
+    rectifyStateArenaCopy(&branch->arena, mainArena->octets);
+    rectifyStateArenaForgetChanges(&branch->arena);
+    branch->startStepId = stepId;
+    branch->stepId = stepId;
+    branch->hasDiverged = false;
+    branch->isValid = true;
+    rectifyInputHistoryReInit(&branch->inputs);
+}
+
+/// Exchanges the branch state with `mainArena`, without copying any state
+void rectifySpeculationSwapArena(RectifySpeculation* self, size_t branchIndex, RectifyStateArena* mainArena)
+{
+    RectifySpeculativeBranch* branch = &self->branches[branchIndex];
+    RectifyStateArena mainArenaBefore = *mainArena;
+    *mainArena = branch->arena;
+    branch->arena = mainArenaBefore;
+}
+
+static const TransmuteParticipantInput* rectifySpeculationFindParticipant(const TransmuteInput* input,
+                                                                         uint8_t participantId)
+{
+    if (input == 0) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < input->participantCount; ++i) {
+        if (input->participantInputs[i].participantId == participantId) {
+            return &input->participantInputs[i];
+        }
+    }
+
+    return 0;
+}
+
+/// Builds the input for a branch from the input used by the main prediction. The remote participants, that were
+/// predicted by the main prediction, are replaced according to the branch hypothesis.
+/// The returned input points into scratch memory, and is only valid until the next call.
+int rectifySpeculationComposeInput(RectifySpeculation* self, size_t branchIndex, const TransmuteInput* mainInput,
+                                   const RectifyRemotePredictor* remotePredictor,
+                                   const TransmuteInput* lastAuthoritativeInput,
+                                   RectifySpeculativeRemoteInputFn customFn, void* customSelf, StepId stepId,
+                                   TransmuteInput* outInput)
+{
+    if (mainInput->participantCount > self->maxParticipantCount) {
+        return -1;
+    }
+
+    const RectifySpeculativeBranch* branch = &self->branches[branchIndex];
+    for (size_t i = 0; i < mainInput->participantCount; ++i) {
+        const TransmuteParticipantInput* source = &mainInput->participantInputs[i];
+        TransmuteParticipantInput* target = &self->buildParticipantInputs[i];
+        *target = *source;
+        if (rectifyRemotePredictorIsLocal(remotePredictor, source->participantId)) {
+            continue;
+        }
+
+        switch (branch->hypothesis) {
+            case RectifySpeculationHypothesisNoInput:
+                target->inputType = TransmuteParticipantInputTypeNoInputInTime;
+                target->input = 0;
+                target->octetSize = 0;
+                break;
+            case RectifySpeculationHypothesisRepeatLastAuthoritative: {
+                const TransmuteParticipantInput* last = rectifySpeculationFindParticipant(lastAuthoritativeInput,
+                                                                                          source->participantId);
+                if (last != 0) {
+                    target->inputType = last->inputType;
+                    target->input = last->input;
+                    target->octetSize = last->octetSize;
+                }
+            } break;
+            case RectifySpeculationHypothesisCustom:
+                if (customFn != 0) {
+                    customFn(customSelf, branchIndex, stepId, target);
+                }
+                break;
+        }
+    }
+
+    outInput->participantInputs = self->buildParticipantInputs;
+    outInput->participantCount = mainInput->participantCount;
+
+    return 0;
+}
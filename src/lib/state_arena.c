@@ -0,0 +1,295 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#if (defined TORNADO_OS_LINUX || defined TORNADO_OS_MACOS) && !defined __EMSCRIPTEN__
+#define RECTIFY_STATE_ARENA_USE_MPROTECT
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <imprint/allocator.h>
+#include <rectify/state_arena.h>
+#include <tiny-libc/tiny_libc.h>
+
+#define RECTIFY_STATE_ARENA_FALLBACK_PAGE_SIZE (4096)
+
+#if defined RECTIFY_STATE_ARENA_USE_MPROTECT
+
+/// What the fault handler needs to know about a mapping. It is a copy, so it stays valid when the arena structs are
+/// swapped by the speculative branches or an arena struct goes out of scope.
+typedef struct RectifyStateArenaMapping {
+    uint8_t* octets; // zero if the slot is free, written last when a slot is taken
+    size_t octetSize;
+    size_t pageOctetSize;
+    uint64_t* writtenPageBits;
+} RectifyStateArenaMapping;
+
+static RectifyStateArenaMapping g_rectifyStateArenas[RECTIFY_STATE_ARENA_MAX_COUNT];
+static size_t g_rectifyStateArenaSlotCount; // highest used slot plus one, only grows
+static size_t g_rectifyStateArenaCount;
+static pthread_mutex_t g_rectifyStateArenasMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct sigaction g_rectifyPreviousSegvAction;
+static struct sigaction g_rectifyPreviousBusAction;
+
+/// Hands a fault that is not in any arena to the handler that was installed before the arenas
+static void rectifyStateArenaPassFault(int signalNumber, siginfo_t* info, void* context)
+{
+    const struct sigaction* previous = signalNumber == SIGSEGV ? &g_rectifyPreviousSegvAction
+                                                               : &g_rectifyPreviousBusAction;
+    if (previous->sa_flags & SA_SIGINFO) {
+        previous->sa_sigaction(signalNumber, info, context);
+    } else if (previous->sa_handler != SIG_DFL && previous->sa_handler != SIG_IGN) {
+        previous->sa_handler(signalNumber);
+    } else {
+        // Returning re-executes the faulting instruction, which now terminates the process as usual
+        struct sigaction defaultAction;
+        tc_mem_clear_type(&defaultAction);
+        defaultAction.sa_handler = SIG_DFL;
+        sigemptyset(&defaultAction.sa_mask);
+        sigaction(signalNumber, &defaultAction, 0);
+    }
+}
+
+/// Marks the page as written and lets the write through. The bits are set atomically, since the fault can happen on
+/// any thread that ticks. mprotect() only changes the mapping, so it is safe to call from the handler in practice.
+static void rectifyStateArenaFaultHandler(int signalNumber, siginfo_t* info, void* context)
+{
+    const uint8_t* address = (const uint8_t*) info->si_addr;
+    size_t slotCount = __atomic_load_n(&g_rectifyStateArenaSlotCount, __ATOMIC_ACQUIRE);
+    for (size_t i = 0; i < slotCount; ++i) {
+        const RectifyStateArenaMapping* mapping = &g_rectifyStateArenas[i];
+        uint8_t* octets = __atomic_load_n(&mapping->octets, __ATOMIC_ACQUIRE);
+        if (octets == 0 || address < octets || address >= octets + mapping->octetSize) {
+            continue;
+        }
+        size_t page = (size_t) (address - octets) / mapping->pageOctetSize;
+        __atomic_fetch_or(&mapping->writtenPageBits[page / 64], (uint64_t) 1 << (page % 64), __ATOMIC_RELAXED);
+        mprotect(octets + page * mapping->pageOctetSize, mapping->pageOctetSize, PROT_READ | PROT_WRITE);
+        return;
+    }
+
+    rectifyStateArenaPassFault(signalNumber, info, context);
+}
+
+static void rectifyStateArenaInstallHandler(void)
+{
+    struct sigaction action;
+    tc_mem_clear_type(&action);
+    action.sa_sigaction = rectifyStateArenaFaultHandler;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &g_rectifyPreviousSegvAction);
+    // macOS reports writes to a protected page as a bus error
+    sigaction(SIGBUS, &action, &g_rectifyPreviousBusAction);
+}
+
+/// Restores the previous handler, unless someone else has replaced the arena handler in the meantime
+static void rectifyStateArenaRestoreHandler(int signalNumber, const struct sigaction* previous)
+{
+    struct sigaction current;
+    sigaction(signalNumber, 0, &current);
+    if ((current.sa_flags & SA_SIGINFO) && current.sa_sigaction == rectifyStateArenaFaultHandler) {
+        sigaction(signalNumber, previous, 0);
+    }
+}
+
+/// Adds the mapping to the ones the fault handler looks in. The first arena installs the handler.
+static bool rectifyStateArenaRegister(const RectifyStateArena* self)
+{
+    bool wasRegistered = false;
+
+    pthread_mutex_lock(&g_rectifyStateArenasMutex);
+    for (size_t i = 0; i < RECTIFY_STATE_ARENA_MAX_COUNT; ++i) {
+        RectifyStateArenaMapping* mapping = &g_rectifyStateArenas[i];
+        if (mapping->octets == 0) {
+            if (g_rectifyStateArenaCount == 0) {
+                rectifyStateArenaInstallHandler();
+            }
+            mapping->octetSize = self->octetSize;
+            mapping->pageOctetSize = self->pageOctetSize;
+            mapping->writtenPageBits = self->writtenPages.bits;
+            __atomic_store_n(&mapping->octets, self->octets, __ATOMIC_RELEASE);
+            if (i + 1 > g_rectifyStateArenaSlotCount) {
+                __atomic_store_n(&g_rectifyStateArenaSlotCount, i + 1, __ATOMIC_RELEASE);
+            }
+            g_rectifyStateArenaCount++;
+            wasRegistered = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_rectifyStateArenasMutex);
+
+    return wasRegistered;
+}
+
+/// Removes the mapping from the fault handler. The last arena restores the previous handler.
+static void rectifyStateArenaUnregister(const RectifyStateArena* self)
+{
+    pthread_mutex_lock(&g_rectifyStateArenasMutex);
+    for (size_t i = 0; i < g_rectifyStateArenaSlotCount; ++i) {
+        RectifyStateArenaMapping* mapping = &g_rectifyStateArenas[i];
+        if (mapping->octets == self->octets) {
+            __atomic_store_n(&mapping->octets, (uint8_t*) 0, __ATOMIC_RELEASE);
+            g_rectifyStateArenaCount--;
+            if (g_rectifyStateArenaCount == 0) {
+                rectifyStateArenaRestoreHandler(SIGSEGV, &g_rectifyPreviousSegvAction);
+                rectifyStateArenaRestoreHandler(SIGBUS, &g_rectifyPreviousBusAction);
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_rectifyStateArenasMutex);
+}
+
+/// Sets the protection of the whole pages that `offset` and `octetCount` touch
+static void rectifyStateArenaProtect(RectifyStateArena* self, size_t offset, size_t octetCount, int protection)
+{
+    size_t first = offset / self->pageOctetSize * self->pageOctetSize;
+    size_t end = (offset + octetCount + self->pageOctetSize - 1) / self->pageOctetSize * self->pageOctetSize;
+    if (end > self->octetSize) {
+        end = self->octetSize;
+    }
+    if (end > first) {
+        mprotect(self->octets + first, end - first, protection);
+    }
+}
+
+/// Write protects the pages that have been written, so the next write to them is caught again
+static void rectifyStateArenaProtectWritten(RectifyStateArena* self)
+{
+    const RectifyDirtyChunks* pages = &self->writtenPages;
+    size_t page = 0;
+    while (page < pages->chunkCount) {
+        if (pages->bits[page / 64] == 0) {
+            page = (page / 64 + 1) * 64;
+            continue;
+        }
+        if (((pages->bits[page / 64] >> (page % 64)) & 1) == 0) {
+            page++;
+            continue;
+        }
+        size_t firstPage = page;
+        while (page < pages->chunkCount && ((pages->bits[page / 64] >> (page % 64)) & 1) != 0) {
+            page++;
+        }
+        rectifyStateArenaProtect(self, firstPage * self->pageOctetSize, (page - firstPage) * self->pageOctetSize,
+                                 PROT_READ);
+    }
+}
+
+#endif
+
+/// Allocates the arena. If the pages can be mapped and protected, the writes to them are detected.
+void rectifyStateArenaInit(RectifyStateArena* self, struct ImprintAllocator* allocator, size_t octetSize)
+{
+    self->pageOctetSize = RECTIFY_STATE_ARENA_FALLBACK_PAGE_SIZE;
+    self->isMapped = false;
+    self->isWriteTracked = false;
+
+#if defined RECTIFY_STATE_ARENA_USE_MPROTECT
+    long systemPageSize = sysconf(_SC_PAGESIZE);
+    if (systemPageSize > 0) {
+        self->pageOctetSize = (size_t) systemPageSize;
+    }
+#endif
+
+    self->stateOctetSize = octetSize;
+    self->octetSize = (octetSize + self->pageOctetSize - 1) / self->pageOctetSize * self->pageOctetSize;
+
+#if defined RECTIFY_STATE_ARENA_USE_MPROTECT
+    void* mapped = mmap(0, self->octetSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped != MAP_FAILED) {
+        self->octets = (uint8_t*) mapped;
+        self->isMapped = true;
+    }
+#endif
+    if (!self->isMapped) {
+        self->octets = IMPRINT_ALLOC_TYPE_COUNT(allocator, uint8_t, self->octetSize);
+        tc_mem_clear_type_n(self->octets, self->octetSize);
+    }
+
+    // Everything is reported as written until the first rectifyStateArenaDirtyRanges() has protected the pages
+    rectifyDirtyChunksInit(&self->writtenPages, allocator, self->octetSize, self->pageOctetSize);
+
+#if defined RECTIFY_STATE_ARENA_USE_MPROTECT
+    if (self->isMapped) {
+        self->isWriteTracked = rectifyStateArenaRegister(self);
+    }
+#endif
+}
+
+/// Unmaps the pages, and restores the previous fault handler if this was the last arena.
+/// The other memory from the allocator is not freed, it belongs to the owner of the allocator.
+void rectifyStateArenaDestroy(RectifyStateArena* self)
+{
+#if defined RECTIFY_STATE_ARENA_USE_MPROTECT
+    if (self->isWriteTracked) {
+        rectifyStateArenaUnregister(self);
+    }
+    if (self->isMapped) {
+        munmap(self->octets, self->octetSize);
+    }
+#endif
+    self->octets = 0;
+    self->isMapped = false;
+    self->isWriteTracked = false;
+}
+
+/// Copies a whole state from `source`, which must be at least as large as the arena. All pages are reported as
+/// written, without taking a fault for each of them.
+void rectifyStateArenaCopy(RectifyStateArena* self, const uint8_t* source)
+{
+#if defined RECTIFY_STATE_ARENA_USE_MPROTECT
+    if (self->isWriteTracked) {
+        mprotect(self->octets, self->octetSize, PROT_READ | PROT_WRITE);
+    }
+#endif
+    rectifyDirtyChunksMarkAll(&self->writtenPages);
+    tc_memcpy_octets(self->octets, source, self->octetSize);
+}
+
+/// Copies the `ranges` from `source`, which must be at least as large as the arena. The pages are reported as
+/// written, without taking a fault for each of them.
+void rectifyStateArenaCopyRanges(RectifyStateArena* self, const RectifyDirtyRange* ranges, size_t rangeCount,
+                                 const uint8_t* source)
+{
+    for (size_t i = 0; i < rangeCount; ++i) {
+        rectifyDirtyChunksMark(&self->writtenPages, ranges[i].offset, ranges[i].octetCount);
+#if defined RECTIFY_STATE_ARENA_USE_MPROTECT
+        if (self->isWriteTracked) {
+            rectifyStateArenaProtect(self, ranges[i].offset, ranges[i].octetCount, PROT_READ | PROT_WRITE);
+        }
+#endif
+    }
+    rectifyDirtyRangesCopy(ranges, rangeCount, self->octets, source);
+}
+
+/// Reports the pages that were written since the last call, and write protects them again.
+/// Can be used for a RectifyDirtyRangesFn. Nothing may write to the arena during the call.
+int rectifyStateArenaDirtyRanges(RectifyStateArena* self, RectifyDirtyRange* ranges, size_t maxRangeCount)
+{
+    if (!self->isWriteTracked) {
+        rectifyDirtyChunksMarkAll(&self->writtenPages);
+    }
+    int rangeCount = rectifyDirtyChunksCollect(&self->writtenPages, ranges, maxRangeCount);
+    rectifyStateArenaForgetChanges(self);
+
+    return rangeCount;
+}
+
+/// Starts a new window for rectifyStateArenaDirtyRanges(), without reporting the pages written so far.
+/// Used when the arena has been made equal to another state again. Nothing may write to the arena during the call.
+void rectifyStateArenaForgetChanges(RectifyStateArena* self)
+{
+#if defined RECTIFY_STATE_ARENA_USE_MPROTECT
+    if (self->isWriteTracked) {
+        rectifyStateArenaProtectWritten(self);
+    }
+#endif
+    rectifyDirtyChunksClear(&self->writtenPages);
+}
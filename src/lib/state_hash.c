@@ -0,0 +1,270 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#if defined __AVX2__
+#define RECTIFY_STATE_HASH_USE_AVX2
+#include <immintrin.h>
+#elif defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#define RECTIFY_STATE_HASH_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <rectify/state_hash.h>
+#include <tiny-libc/tiny_libc.h>
+
+#define RECTIFY_STATE_HASH_STRIPES_PER_BLOCK (16)
+#define RECTIFY_STATE_HASH_PRIME32 (0x9E3779B1U)
+
+// The multiply and xor constants are arbitrary, but must never change, since hashes are compared between builds
+static const uint64_t g_rectifyStateHashKeys[RECTIFY_STATE_HASH_LANE_COUNT] = {
+    0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+    0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL, 0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL,
+};
+
+static const uint64_t g_rectifyStateHashScrambleKeys[RECTIFY_STATE_HASH_LANE_COUNT] = {
+    0xcb00c391bb52283cULL, 0xa32e531b8b65d088ULL, 0x4ef90da297486471ULL, 0xd8acdea946ef1938ULL,
+    0x3f349ce33f76faa8ULL, 0x1d4f0bc7c7bbdcf9ULL, 0x3159b4cd4be0518aULL, 0x647378d9c97e9fc8ULL,
+};
+
+#if defined RECTIFY_STATE_HASH_USE_AVX2
+
+static void rectifyStateHashAccumulate(uint64_t* lanes, const uint8_t* octets, size_t stripeCount)
+{
+    __m256i accumulators[2];
+    __m256i keys[2];
+    for (size_t i = 0; i < 2; ++i) {
+        accumulators[i] = _mm256_loadu_si256((const __m256i*) (lanes + i * 4));
+        keys[i] = _mm256_loadu_si256((const __m256i*) (g_rectifyStateHashKeys + i * 4));
+    }
+
+    for (size_t stripe = 0; stripe < stripeCount; ++stripe) {
+        const uint8_t* stripeOctets = octets + stripe * RECTIFY_STATE_HASH_STRIPE_OCTET_SIZE;
+        for (size_t i = 0; i < 2; ++i) {
+            __m256i data = _mm256_loadu_si256((const __m256i*) (stripeOctets + i * 32));
+            __m256i dataKey = _mm256_xor_si256(data, keys[i]);
+            __m256i product = _mm256_mul_epu32(dataKey, _mm256_srli_epi64(dataKey, 32));
+            __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            accumulators[i] = _mm256_add_epi64(accumulators[i], _mm256_add_epi64(swapped, product));
+        }
+    }
+
+    for (size_t i = 0; i < 2; ++i) {
+        _mm256_storeu_si256((__m256i*) (lanes + i * 4), accumulators[i]);
+    }
+}
+
+static void rectifyStateHashScramble(uint64_t* lanes)
+{
+    const __m256i prime = _mm256_set1_epi32((int) RECTIFY_STATE_HASH_PRIME32);
+    for (size_t i = 0; i < 2; ++i) {
+        __m256i accumulator = _mm256_loadu_si256((const __m256i*) (lanes + i * 4));
+        __m256i key = _mm256_loadu_si256((const __m256i*) (g_rectifyStateHashScrambleKeys + i * 4));
+        accumulator = _mm256_xor_si256(accumulator, _mm256_srli_epi64(accumulator, 47));
+        accumulator = _mm256_xor_si256(accumulator, key);
+        __m256i productLow = _mm256_mul_epu32(accumulator, prime);
+        __m256i productHigh = _mm256_mul_epu32(_mm256_srli_epi64(accumulator, 32), prime);
+        accumulator = _mm256_add_epi64(productLow, _mm256_slli_epi64(productHigh, 32));
+        _mm256_storeu_si256((__m256i*) (lanes + i * 4), accumulator);
+    }
+}
+
+#elif defined RECTIFY_STATE_HASH_USE_SSE2
+
+static void rectifyStateHashAccumulate(uint64_t* lanes, const uint8_t* octets, size_t stripeCount)
+{
+    __m128i accumulators[4];
+    __m128i keys[4];
+    for (size_t i = 0; i < 4; ++i) {
+        accumulators[i] = _mm_loadu_si128((const __m128i*) (lanes + i * 2));
+        keys[i] = _mm_loadu_si128((const __m128i*) (g_rectifyStateHashKeys + i * 2));
+    }
+
+    for (size_t stripe = 0; stripe < stripeCount; ++stripe) {
+        const uint8_t* stripeOctets = octets + stripe * RECTIFY_STATE_HASH_STRIPE_OCTET_SIZE;
+        for (size_t i = 0; i < 4; ++i) {
+            __m128i data = _mm_loadu_si128((const __m128i*) (stripeOctets + i * 16));
+            __m128i dataKey = _mm_xor_si128(data, keys[i]);
+            __m128i product = _mm_mul_epu32(dataKey, _mm_srli_epi64(dataKey, 32));
+            __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            accumulators[i] = _mm_add_epi64(accumulators[i], _mm_add_epi64(swapped, product));
+        }
+    }
+
+    for (size_t i = 0; i < 4; ++i) {
+        _mm_storeu_si128((__m128i*) (lanes + i * 2), accumulators[i]);
+    }
+}
+
+static void rectifyStateHashScramble(uint64_t* lanes)
+{
+    const __m128i prime = _mm_set1_epi32((int) RECTIFY_STATE_HASH_PRIME32);
+    for (size_t i = 0; i < 4; ++i) {
+        __m128i accumulator = _mm_loadu_si128((const __m128i*) (lanes + i * 2));
+        __m128i key = _mm_loadu_si128((const __m128i*) (g_rectifyStateHashScrambleKeys + i * 2));
+        accumulator = _mm_xor_si128(accumulator, _mm_srli_epi64(accumulator, 47));
+        accumulator = _mm_xor_si128(accumulator, key);
+        __m128i productLow = _mm_mul_epu32(accumulator, prime);
+        __m128i productHigh = _mm_mul_epu32(_mm_srli_epi64(accumulator, 32), prime);
+        accumulator = _mm_add_epi64(productLow, _mm_slli_epi64(productHigh, 32));
+        _mm_storeu_si128((__m128i*) (lanes + i * 2), accumulator);
+    }
+}
+
+#else
+
+static uint64_t rectifyStateHashReadLane(const uint8_t* octets)
+{
+#if defined __BYTE_ORDER__ && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    uint64_t lane = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        lane |= (uint64_t) octets[i] << (i * 8);
+    }
+#else
+    uint64_t lane;
+    tc_memcpy_octets(&lane, octets, sizeof(lane));
+#endif
+    return lane;
+}
+
+static void rectifyStateHashAccumulate(uint64_t* lanes, const uint8_t* octets, size_t stripeCount)
+{
+    for (size_t stripe = 0; stripe < stripeCount; ++stripe) {
+        const uint8_t* stripeOctets = octets + stripe * RECTIFY_STATE_HASH_STRIPE_OCTET_SIZE;
+        for (size_t i = 0; i < RECTIFY_STATE_HASH_LANE_COUNT; ++i) {
+            uint64_t data = rectifyStateHashReadLane(stripeOctets + i * 8);
+            uint64_t dataKey = data ^ g_rectifyStateHashKeys[i];
+            lanes[i ^ 1] += data;
+            lanes[i] += (dataKey & 0xffffffff) * (dataKey >> 32);
+        }
+    }
+}
+
+static void rectifyStateHashScramble(uint64_t* lanes)
+{
+    for (size_t i = 0; i < RECTIFY_STATE_HASH_LANE_COUNT; ++i) {
+        uint64_t accumulator = lanes[i];
+        accumulator ^= accumulator >> 47;
+        accumulator ^= g_rectifyStateHashScrambleKeys[i];
+        lanes[i] = accumulator * RECTIFY_STATE_HASH_PRIME32;
+    }
+}
+
+#endif
+
+/// Multiplies to a 128-bit product and folds it to 64 bits
+static uint64_t rectifyStateHashMultiplyFold(uint64_t a, uint64_t b)
+{
+    uint64_t lowLow = (a & 0xffffffff) * (b & 0xffffffff);
+    uint64_t highLow = (a >> 32) * (b & 0xffffffff);
+    uint64_t lowHigh = (a & 0xffffffff) * (b >> 32);
+    uint64_t highHigh = (a >> 32) * (b >> 32);
+    uint64_t cross = (lowLow >> 32) + (highLow & 0xffffffff) + lowHigh;
+    uint64_t upper = (highLow >> 32) + (cross >> 32) + highHigh;
+    uint64_t lower = (cross << 32) | (lowLow & 0xffffffff);
+
+    return lower ^ upper;
+}
+
+static void rectifyStateHasherConsume(RectifyStateHasher* self, const uint8_t* octets, size_t stripeCount)
+{
+    while (stripeCount > 0) {
+        size_t count = RECTIFY_STATE_HASH_STRIPES_PER_BLOCK - self->stripesInBlock;
+        if (count > stripeCount) {
+            count = stripeCount;
+        }
+        rectifyStateHashAccumulate(self->lanes, octets, count);
+        octets += count * RECTIFY_STATE_HASH_STRIPE_OCTET_SIZE;
+        stripeCount -= count;
+        self->stripesInBlock += count;
+        if (self->stripesInBlock == RECTIFY_STATE_HASH_STRIPES_PER_BLOCK) {
+            rectifyStateHashScramble(self->lanes);
+            self->stripesInBlock = 0;
+        }
+    }
+}
+
+void rectifyStateHasherInit(RectifyStateHasher* self)
+{
+    static const uint64_t initialLanes[RECTIFY_STATE_HASH_LANE_COUNT] = {
+        0x00000000C2B2AE3DULL, 0x9E3779B185EBCA87ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL,
+        0x85EBCA77C2B2AE63ULL, 0x0000000085EBCA77ULL, 0x27D4EB2F165667C5ULL, 0x000000009E3779B1ULL,
+    };
+    for (size_t i = 0; i < RECTIFY_STATE_HASH_LANE_COUNT; ++i) {
+        self->lanes[i] = initialLanes[i];
+    }
+    self->bufferedOctetCount = 0;
+    self->stripesInBlock = 0;
+    self->totalOctetCount = 0;
+}
+
+/// Adds more octets to the hash. A large state can be added in pieces, for example spread over several updates.
+void rectifyStateHasherAdd(RectifyStateHasher* self, const uint8_t* octets, size_t octetCount)
+{
+    self->totalOctetCount += octetCount;
+
+    if (self->bufferedOctetCount > 0) {
+        size_t fillCount = RECTIFY_STATE_HASH_STRIPE_OCTET_SIZE - self->bufferedOctetCount;
+        if (fillCount > octetCount) {
+            fillCount = octetCount;
+        }
+        tc_memcpy_octets(self->buffer + self->bufferedOctetCount, octets, fillCount);
+        self->bufferedOctetCount += fillCount;
+        octets += fillCount;
+        octetCount -= fillCount;
+        if (self->bufferedOctetCount < RECTIFY_STATE_HASH_STRIPE_OCTET_SIZE) {
+            return;
+        }
+        rectifyStateHasherConsume(self, self->buffer, 1);
+        self->bufferedOctetCount = 0;
+    }
+
+    size_t stripeCount = octetCount / RECTIFY_STATE_HASH_STRIPE_OCTET_SIZE;
+    rectifyStateHasherConsume(self, octets, stripeCount);
+    octets += stripeCount * RECTIFY_STATE_HASH_STRIPE_OCTET_SIZE;
+    octetCount -= stripeCount * RECTIFY_STATE_HASH_STRIPE_OCTET_SIZE;
+
+    if (octetCount > 0) {
+        tc_memcpy_octets(self->buffer, octets, octetCount);
+        self->bufferedOctetCount = octetCount;
+    }
+}
+
+/// Returns the hash of everything added so far. More octets can still be added afterwards.
+uint64_t rectifyStateHasherFinish(const RectifyStateHasher* self)
+{
+    uint64_t lanes[RECTIFY_STATE_HASH_LANE_COUNT];
+    tc_memcpy_octets(lanes, self->lanes, sizeof(lanes));
+
+    if (self->bufferedOctetCount > 0) {
+        uint8_t lastStripe[RECTIFY_STATE_HASH_STRIPE_OCTET_SIZE];
+        tc_mem_clear_type_n(lastStripe, RECTIFY_STATE_HASH_STRIPE_OCTET_SIZE);
+        tc_memcpy_octets(lastStripe, self->buffer, self->bufferedOctetCount);
+        rectifyStateHashAccumulate(lanes, lastStripe, 1);
+    }
+
+    uint64_t hash = self->totalOctetCount * 0x9E3779B185EBCA87ULL;
+    for (size_t i = 0; i < RECTIFY_STATE_HASH_LANE_COUNT; i += 2) {
+        hash += rectifyStateHashMultiplyFold(lanes[i] ^ g_rectifyStateHashScrambleKeys[i],
+                                             lanes[i + 1] ^ g_rectifyStateHashScrambleKeys[i + 1]);
+    }
+
+    hash ^= hash >> 37;
+    hash *= 0x165667919E3779F9ULL;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+uint64_t rectifyStateHash(const uint8_t* octets, size_t octetCount)
+{
+    RectifyStateHasher hasher;
+    rectifyStateHasherInit(&hasher);
+    rectifyStateHasherAdd(&hasher, octets, octetCount);
+    return rectifyStateHasherFinish(&hasher);
+}
+
+uint64_t rectifyTransmuteStateHash(const TransmuteState* state)
+{
+    return rectifyStateHash((const uint8_t*) state->state, state->octetSize);
+}
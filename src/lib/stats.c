@@ -0,0 +1,11 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <rectify/stats.h>
+#include <tiny-libc/tiny_libc.h>
+
+void rectifyStatsClear(RectifyStats* self)
+{
+    tc_mem_clear_type(self);
+}
@@ -0,0 +1,95 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <rectify/time_sync.h>
+
+#define RECTIFY_TIME_SYNC_DEFAULT_MAX_DILATION_PERMILLE (30u)
+#define RECTIFY_TIME_SYNC_DEFAULT_PERMILLE_PER_TICK (10u)
+#define RECTIFY_TIME_SYNC_DEFAULT_SMOOTHING_UPDATES (8u)
+#define RECTIFY_TIME_SYNC_FRACTION (256)
+
+void rectifyTimeSyncInit(RectifyTimeSync* self, RectifyTimeSyncSetup setup)
+{
+    if (setup.maxDilationPermille == 0) {
+        setup.maxDilationPermille = RECTIFY_TIME_SYNC_DEFAULT_MAX_DILATION_PERMILLE;
+    }
+    if (setup.maxDilationPermille >= RECTIFY_TIME_SYNC_NORMAL_PERMILLE) {
+        setup.maxDilationPermille = RECTIFY_TIME_SYNC_NORMAL_PERMILLE - 1;
+    }
+    if (setup.permillePerTick == 0) {
+        setup.permillePerTick = RECTIFY_TIME_SYNC_DEFAULT_PERMILLE_PER_TICK;
+    }
+    if (setup.smoothingUpdates == 0) {
+        setup.smoothingUpdates = RECTIFY_TIME_SYNC_DEFAULT_SMOOTHING_UPDATES;
+    }
+    self->setup = setup;
+    self->isEnabled = setup.targetLeadTicks > 0;
+    rectifyTimeSyncReInit(self);
+}
+
+void rectifyTimeSyncReInit(RectifyTimeSync* self)
+{
+    self->hasPredicted = false;
+    self->newestPredictedStepId = 0;
+    self->hasMeasured = false;
+    self->lastLeadTicks = 0;
+    self->smoothedLeadFraction = 0;
+    self->tickDurationPermille = RECTIFY_TIME_SYNC_NORMAL_PERMILLE;
+}
+
+/// Called for every predicted step the application adds, also the rejected ones, since the StepId is what
+/// the local clock thinks
+void rectifyTimeSyncAddPredicted(RectifyTimeSync* self, StepId stepId)
+{
+    if (!self->hasPredicted || stepId > self->newestPredictedStepId) {
+        self->newestPredictedStepId = stepId;
+        self->hasPredicted = true;
+    }
+}
+
+static uint32_t rectifyTimeSyncCalculatePermille(const RectifyTimeSync* self)
+{
+    int32_t errorFraction = self->smoothedLeadFraction -
+                            (int32_t) self->setup.targetLeadTicks * RECTIFY_TIME_SYNC_FRACTION;
+    // Within half a tick of the target the lead is as good as it gets, so the tick duration does not dither
+    if (errorFraction <= RECTIFY_TIME_SYNC_FRACTION / 2 && errorFraction >= -RECTIFY_TIME_SYNC_FRACTION / 2) {
+        return RECTIFY_TIME_SYNC_NORMAL_PERMILLE;
+    }
+
+    int32_t maxDilation = (int32_t) self->setup.maxDilationPermille;
+    int32_t dilation = errorFraction * (int32_t) self->setup.permillePerTick / RECTIFY_TIME_SYNC_FRACTION;
+    if (dilation > maxDilation) {
+        dilation = maxDilation;
+    } else if (dilation < -maxDilation) {
+        dilation = -maxDilation;
+    }
+
+    // A lead that is too large needs longer ticks, so the authoritative steps can catch up
+    return (uint32_t) ((int32_t) RECTIFY_TIME_SYNC_NORMAL_PERMILLE + dilation);
+}
+
+/// Measures the lead when the authoritative state has reached `authoritativeStepId`.
+/// A client that is behind the authoritative state has a negative lead.
+/// Returns the recommended tick duration in permille of the normal tick duration.
+uint32_t rectifyTimeSyncAddAuthoritative(RectifyTimeSync* self, StepId authoritativeStepId)
+{
+    if (!self->isEnabled || !self->hasPredicted) {
+        return self->tickDurationPermille;
+    }
+
+    int32_t leadTicks = (int32_t) (self->newestPredictedStepId + 1u - authoritativeStepId);
+    self->lastLeadTicks = leadTicks;
+    int32_t leadFraction = leadTicks * RECTIFY_TIME_SYNC_FRACTION;
+    if (!self->hasMeasured) {
+        self->smoothedLeadFraction = leadFraction;
+        self->hasMeasured = true;
+    } else {
+        self->smoothedLeadFraction += (leadFraction - self->smoothedLeadFraction) /
+                                      (int32_t) self->setup.smoothingUpdates;
+    }
+
+    self->tickDurationPermille = rectifyTimeSyncCalculatePermille(self);
+
+    return self->tickDurationPermille;
+}
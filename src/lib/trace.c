@@ -0,0 +1,148 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#include <imprint/allocator.h>
+#include <rectify/trace.h>
+#include <tiny-libc/tiny_libc.h>
+
+void rectifyTraceInit(RectifyTrace* self, struct ImprintAllocator* allocator, size_t capacity)
+{
+    self->events = IMPRINT_ALLOC_TYPE_COUNT(allocator, RectifyTraceEvent, capacity);
+    self->capacity = capacity;
+    rectifyTraceClear(self);
+}
+
+void rectifyTraceClear(RectifyTrace* self)
+{
+    self->writeIndex = 0;
+    self->count = 0;
+}
+
+void rectifyTraceAdd(RectifyTrace* self, RectifyTraceEventType type, StepId stepId, uint32_t a, uint32_t b)
+{
+    RectifyTraceEvent* event = &self->events[self->writeIndex];
+    event->time = monotonicTimeMsNow();
+    event->type = (uint8_t) type;
+    event->stepId = stepId;
+    event->a = a;
+    event->b = b;
+
+    self->writeIndex = (self->writeIndex + 1) % self->capacity;
+    if (self->count < self->capacity) {
+        self->count++;
+    }
+}
+
+/// Returns the event at index, where zero is the oldest event still in the ring
+const RectifyTraceEvent* rectifyTraceEventAt(const RectifyTrace* self, size_t index)
+{
+    if (index >= self->count) {
+        return 0;
+    }
+
+    size_t oldestIndex = (self->writeIndex + self->capacity - self->count) % self->capacity;
+    return &self->events[(oldestIndex + index) % self->capacity];
+}
+
+const char* rectifyTraceEventTypeToString(RectifyTraceEventType type)
+{
+    switch (type) {
+        case RectifyTraceEventTypeUpdateBegin:
+            return "UpdateBegin";
+        case RectifyTraceEventTypeUpdateEnd:
+            return "UpdateEnd";
+        case RectifyTraceEventTypeCatchUpCapped:
+            return "CatchUpCapped";
+        case RectifyTraceEventTypePredictionConfirmed:
+            return "PredictionConfirmed";
+        case RectifyTraceEventTypePredictionReset:
+            return "PredictionReset";
+        case RectifyTraceEventTypeAuthoritativeStepAdded:
+            return "AuthoritativeStepAdded";
+        case RectifyTraceEventTypeAuthoritativeStepRejected:
+            return "AuthoritativeStepRejected";
+        case RectifyTraceEventTypePredictedStepAdded:
+            return "PredictedStepAdded";
+        case RectifyTraceEventTypePredictedStepRejected:
+            return "PredictedStepRejected";
+        case RectifyTraceEventTypePredictionBranchAdopted:
+            return "PredictionBranchAdopted";
+        case RectifyTraceEventTypeDesync:
+            return "Desync";
+        case RectifyTraceEventTypeAuthoritativeSnapshot:
+            return "AuthoritativeSnapshot";
+        case RectifyTraceEventTypePredictionWindowChanged:
+            return "PredictionWindowChanged";
+        case RectifyTraceEventTypeInputDelayChanged:
+            return "InputDelayChanged";
+        case RectifyTraceEventTypeResimulationCompleted:
+            return "ResimulationCompleted";
+    }
+
+    return "Unknown";
+}
+
+/// Renders all events, one per line. Returns the number of octets written, or -1 if the target is too small.
+int rectifyTraceToString(const RectifyTrace* self, char* target, size_t maxTargetOctetSize)
+{
+    size_t pos = 0;
+    if (maxTargetOctetSize > 0) {
+        target[0] = 0;
+    }
+
+    for (size_t i = 0; i < self->count; ++i) {
+        const RectifyTraceEvent* event = rectifyTraceEventAt(self, i);
+        int written = tc_snprintf(target + pos, maxTargetOctetSize - pos, "%lld %s %08X %u %u\n",
+                                  (long long) event->time,
+                                  rectifyTraceEventTypeToString((RectifyTraceEventType) event->type), event->stepId,
+                                  event->a, event->b);
+        if (written < 0 || (size_t) written >= maxTargetOctetSize - pos) {
+            return -1;
+        }
+        pos += (size_t) written;
+    }
+
+    return (int) pos;
+}
+
+/// Renders all events in the Chrome trace event format (chrome://tracing, Perfetto).
+/// Updates become duration events, everything else instant events.
+/// Returns the number of octets written, or -1 if the target is too small.
+int rectifyTraceToChromeTraceJson(const RectifyTrace* self, char* target, size_t maxTargetOctetSize)
+{
+    int written = tc_snprintf(target, maxTargetOctetSize, "{\"traceEvents\":[");
+    if (written < 0 || (size_t) written >= maxTargetOctetSize) {
+        return -1;
+    }
+    size_t pos = (size_t) written;
+
+    for (size_t i = 0; i < self->count; ++i) {
+        const RectifyTraceEvent* event = rectifyTraceEventAt(self, i);
+        const char* phase = "i";
+        const char* name = rectifyTraceEventTypeToString((RectifyTraceEventType) event->type);
+        if (event->type == RectifyTraceEventTypeUpdateBegin) {
+            phase = "B";
+            name = "Update";
+        } else if (event->type == RectifyTraceEventTypeUpdateEnd) {
+            phase = "E";
+            name = "Update";
+        }
+        written = tc_snprintf(target + pos, maxTargetOctetSize - pos,
+                              "%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%lld,\"pid\":0,\"tid\":0,\"s\":\"t\","
+                              "\"args\":{\"stepId\":%u,\"a\":%u,\"b\":%u}}",
+                              i == 0 ? "" : ",", name, phase, (long long) event->time * 1000, event->stepId, event->a,
+                              event->b);
+        if (written < 0 || (size_t) written >= maxTargetOctetSize - pos) {
+            return -1;
+        }
+        pos += (size_t) written;
+    }
+
+    written = tc_snprintf(target + pos, maxTargetOctetSize - pos, "]}\n");
+    if (written < 0 || (size_t) written >= maxTargetOctetSize - pos) {
+        return -1;
+    }
+
+    return (int) (pos + (size_t) written);
+}
@@ -0,0 +1,338 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Peter Bjorklund. All rights reserved.
+ *  Licensed under the MIT License. See LICENSE in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+#if (defined TORNADO_OS_LINUX || defined TORNADO_OS_MACOS) && !defined __EMSCRIPTEN__
+#define RECTIFY_WORKER_POOL_USE_THREADS
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include <imprint/allocator.h>
+#include <monotonic-time/monotonic_time.h>
+#include <rectify/rectify.h>
+#include <rectify/worker_pool.h>
+
+/// A single rectifyUpdate() usually takes less than a millisecond, so the milliseconds from monotonicTimeMsNow()
+/// are only used where there is no finer clock.
+static uint64_t rectifyWorkerPoolMicrosecondsNow(void)
+{
+#if defined RECTIFY_WORKER_POOL_USE_THREADS
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000u + (uint64_t) now.tv_nsec / 1000u;
+#else
+    return (uint64_t) monotonicTimeMsNow() * 1000u;
+#endif
+}
+
+static void rectifyWorkerPoolRunOne(RectifyWorkerPool* self, size_t instanceIndex, size_t workerIndex)
+{
+    RectifyUpdateResult* result = &self->results[instanceIndex];
+    uint64_t startedAt = rectifyWorkerPoolMicrosecondsNow();
+    rectifyUpdate(self->instances[instanceIndex]);
+    result->elapsedMicroseconds = rectifyWorkerPoolMicrosecondsNow() - startedAt;
+    result->workerIndex = workerIndex;
+    result->isDone = true;
+}
+
+static void rectifyWorkerPoolRunSerial(RectifyWorkerPool* self, struct Rectify** instances, size_t count)
+{
+    self->instances = instances;
+    self->instanceCount = count;
+    self->stolenCount = 0;
+    for (size_t i = 0; i < count; ++i) {
+        rectifyWorkerPoolRunOne(self, i, 0);
+    }
+}
+
+#if defined RECTIFY_WORKER_POOL_USE_THREADS
+
+/// The instances from `begin` up to `end` that have not been started yet
+typedef struct RectifyWorkerDeque {
+    pthread_mutex_t mutex;
+    size_t begin;
+    size_t end;
+} RectifyWorkerDeque;
+
+typedef struct RectifyWorkerThreadContext {
+    RectifyWorkerPool* pool;
+    size_t workerIndex;
+    size_t seenGeneration;
+} RectifyWorkerThreadContext;
+
+typedef struct RectifyWorkerPoolThreads {
+    pthread_t* threads;
+    RectifyWorkerThreadContext* contexts;
+    RectifyWorkerDeque* deques; // one for each worker, index zero is the calling thread
+    size_t dequeCount;
+    pthread_mutex_t mutex; // only used when a rectifyUpdateMany() starts and when a worker is done with it
+    pthread_cond_t workAvailable;
+    pthread_cond_t workDone;
+    size_t generation;
+    size_t busyThreadCount;
+} RectifyWorkerPoolThreads;
+
+static bool rectifyWorkerDequePopFront(RectifyWorkerDeque* self, size_t* outInstanceIndex)
+{
+    pthread_mutex_lock(&self->mutex);
+    bool hasInstance = self->begin < self->end;
+    if (hasInstance) {
+        *outInstanceIndex = self->begin++;
+    }
+    pthread_mutex_unlock(&self->mutex);
+
+    return hasInstance;
+}
+
+/// Moves the back half of the first deque that is not empty to the empty deque of `workerIndex`.
+/// Returns the number of stolen instances, zero if all the deques were empty.
+static size_t rectifyWorkerPoolSteal(RectifyWorkerPoolThreads* self, size_t workerIndex)
+{
+    for (size_t i = 1; i < self->dequeCount; ++i) {
+        RectifyWorkerDeque* victim = &self->deques[(workerIndex + i) % self->dequeCount];
+        pthread_mutex_lock(&victim->mutex);
+        size_t stealCount = (victim->end - victim->begin + 1) / 2;
+        size_t stolenEnd = victim->end;
+        victim->end -= stealCount;
+        pthread_mutex_unlock(&victim->mutex);
+        if (stealCount == 0) {
+            continue;
+        }
+
+        RectifyWorkerDeque* own = &self->deques[workerIndex];
+        pthread_mutex_lock(&own->mutex);
+        own->begin = stolenEnd - stealCount;
+        own->end = stolenEnd;
+        pthread_mutex_unlock(&own->mutex);
+
+        return stealCount;
+    }
+
+    return 0;
+}
+
+/// Updates the instances in the own deque, and steals more when it is empty, until all the deques are empty.
+/// Returns the number of stolen instances.
+static size_t rectifyWorkerPoolWork(RectifyWorkerPool* self, size_t workerIndex)
+{
+    RectifyWorkerPoolThreads* threads = self->threads;
+    RectifyWorkerDeque* own = &threads->deques[workerIndex];
+    size_t stolenCount = 0;
+
+    for (;;) {
+        size_t instanceIndex;
+        if (rectifyWorkerDequePopFront(own, &instanceIndex)) {
+            rectifyWorkerPoolRunOne(self, instanceIndex, workerIndex);
+            continue;
+        }
+        size_t stealCount = rectifyWorkerPoolSteal(threads, workerIndex);
+        if (stealCount == 0) {
+            break;
+        }
+        stolenCount += stealCount;
+    }
+
+    return stolenCount;
+}
+
+static void* rectifyWorkerPoolThread(void* _context)
+{
+    RectifyWorkerThreadContext* context = (RectifyWorkerThreadContext*) _context;
+    RectifyWorkerPool* self = context->pool;
+    RectifyWorkerPoolThreads* threads = self->threads;
+
+    pthread_mutex_lock(&threads->mutex);
+    for (;;) {
+        while (!self->isShuttingDown && threads->generation == context->seenGeneration) {
+            pthread_cond_wait(&threads->workAvailable, &threads->mutex);
+        }
+        if (self->isShuttingDown) {
+            break;
+        }
+        context->seenGeneration = threads->generation;
+        pthread_mutex_unlock(&threads->mutex);
+
+        size_t stolenCount = rectifyWorkerPoolWork(self, context->workerIndex);
+
+        pthread_mutex_lock(&threads->mutex);
+        self->stolenCount += stolenCount;
+        threads->busyThreadCount--;
+        if (threads->busyThreadCount == 0) {
+            pthread_cond_broadcast(&threads->workDone);
+        }
+    }
+    pthread_mutex_unlock(&threads->mutex);
+
+    return 0;
+}
+
+static void rectifyWorkerPoolStartThreads(RectifyWorkerPool* self, struct ImprintAllocator* allocator,
+                                          size_t threadCount)
+{
+    RectifyWorkerPoolThreads* threads = IMPRINT_ALLOC_TYPE(allocator, RectifyWorkerPoolThreads);
+    threads->threads = IMPRINT_ALLOC_TYPE_COUNT(allocator, pthread_t, threadCount);
+    threads->contexts = IMPRINT_ALLOC_TYPE_COUNT(allocator, RectifyWorkerThreadContext, threadCount);
+    threads->deques = IMPRINT_ALLOC_TYPE_COUNT(allocator, RectifyWorkerDeque, threadCount + 1);
+    for (size_t i = 0; i < threadCount + 1; ++i) {
+        pthread_mutex_init(&threads->deques[i].mutex, 0);
+        threads->deques[i].begin = 0;
+        threads->deques[i].end = 0;
+    }
+    pthread_mutex_init(&threads->mutex, 0);
+    pthread_cond_init(&threads->workAvailable, 0);
+    pthread_cond_init(&threads->workDone, 0);
+    threads->generation = 0;
+    threads->busyThreadCount = 0;
+    self->threads = threads;
+
+    for (size_t i = 0; i < threadCount; ++i) {
+        threads->contexts[i].pool = self;
+        threads->contexts[i].workerIndex = i + 1;
+        threads->contexts[i].seenGeneration = 0;
+        if (pthread_create(&threads->threads[i], 0, rectifyWorkerPoolThread, &threads->contexts[i]) != 0) {
+            // Keep the threads that could be started, the calling thread will do the rest of the work
+            break;
+        }
+        self->threadCount++;
+    }
+    threads->dequeCount = self->threadCount + 1;
+}
+
+static void rectifyWorkerPoolStopThreads(RectifyWorkerPool* self)
+{
+    RectifyWorkerPoolThreads* threads = self->threads;
+
+    pthread_mutex_lock(&threads->mutex);
+    self->isShuttingDown = true;
+    pthread_cond_broadcast(&threads->workAvailable);
+    pthread_mutex_unlock(&threads->mutex);
+
+    for (size_t i = 0; i < self->threadCount; ++i) {
+        pthread_join(threads->threads[i], 0);
+    }
+
+    pthread_cond_destroy(&threads->workDone);
+    pthread_cond_destroy(&threads->workAvailable);
+    pthread_mutex_destroy(&threads->mutex);
+    for (size_t i = 0; i < self->threadCount + 1; ++i) {
+        pthread_mutex_destroy(&threads->deques[i].mutex);
+    }
+    self->threadCount = 0;
+}
+
+static void rectifyWorkerPoolRun(RectifyWorkerPool* self, struct Rectify** instances, size_t count)
+{
+    RectifyWorkerPoolThreads* threads = self->threads;
+    if (threads == 0) {
+        rectifyWorkerPoolRunSerial(self, instances, count);
+        return;
+    }
+
+    pthread_mutex_lock(&threads->mutex);
+    self->instances = instances;
+    self->instanceCount = count;
+    self->stolenCount = 0;
+    // The worker threads are idle, so the deques can be filled without their locks
+    for (size_t i = 0; i < threads->dequeCount; ++i) {
+        threads->deques[i].begin = count * i / threads->dequeCount;
+        threads->deques[i].end = count * (i + 1) / threads->dequeCount;
+    }
+    threads->busyThreadCount = self->threadCount;
+    threads->generation++;
+    pthread_cond_broadcast(&threads->workAvailable);
+    pthread_mutex_unlock(&threads->mutex);
+
+    size_t stolenCount = rectifyWorkerPoolWork(self, 0);
+
+    pthread_mutex_lock(&threads->mutex);
+    self->stolenCount += stolenCount;
+    while (threads->busyThreadCount > 0) {
+        pthread_cond_wait(&threads->workDone, &threads->mutex);
+    }
+    pthread_mutex_unlock(&threads->mutex);
+}
+
+#else
+
+static void rectifyWorkerPoolStartThreads(RectifyWorkerPool* self, struct ImprintAllocator* allocator,
+                                          size_t threadCount)
+{
+    (void) self;
+    (void) allocator;
+    (void) threadCount;
+}
+
+static void rectifyWorkerPoolStopThreads(RectifyWorkerPool* self)
+{
+    (void) self;
+}
+
+static void rectifyWorkerPoolRun(RectifyWorkerPool* self, struct Rectify** instances, size_t count)
+{
+    rectifyWorkerPoolRunSerial(self, instances, count);
+}
+
+#endif
+
+/// Starts `threadCount` worker threads. The calling thread is not included in `threadCount`.
+/// On platforms without thread support, all instances are updated on the calling thread.
+int rectifyWorkerPoolInit(RectifyWorkerPool* self, struct ImprintAllocator* allocator, size_t threadCount,
+                          size_t maxInstanceCount)
+{
+    self->threads = 0;
+    self->threadCount = 0;
+    self->results = IMPRINT_ALLOC_TYPE_COUNT(allocator, RectifyUpdateResult, maxInstanceCount);
+    self->maxInstanceCount = maxInstanceCount;
+    self->instances = 0;
+    self->instanceCount = 0;
+    self->stolenCount = 0;
+    self->elapsedMicroseconds = 0;
+    self->isShuttingDown = false;
+
+    if (threadCount > 0) {
+        rectifyWorkerPoolStartThreads(self, allocator, threadCount);
+    }
+
+    return 0;
+}
+
+/// Stops and joins the worker threads. The memory is owned by the allocator given in rectifyWorkerPoolInit().
+void rectifyWorkerPoolDestroy(RectifyWorkerPool* self)
+{
+    if (self->threads != 0) {
+        rectifyWorkerPoolStopThreads(self);
+        self->threads = 0;
+    }
+}
+
+const RectifyUpdateResult* rectifyWorkerPoolResult(const RectifyWorkerPool* self, size_t instanceIndex)
+{
+    if (instanceIndex >= self->instanceCount) {
+        return 0;
+    }
+
+    return &self->results[instanceIndex];
+}
+
+/// Calls rectifyUpdate() once for every instance and returns when all of them are done.
+/// The instances must be independent, and must not be used by any other thread during the call.
+int rectifyUpdateMany(struct Rectify** instances, size_t count, RectifyWorkerPool* pool)
+{
+    if (count > pool->maxInstanceCount) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        pool->results[i].isDone = false;
+        pool->results[i].elapsedMicroseconds = 0;
+        pool->results[i].workerIndex = 0;
+    }
+
+    uint64_t startedAt = rectifyWorkerPoolMicrosecondsNow();
+    rectifyWorkerPoolRun(pool, instances, count);
+    pool->elapsedMicroseconds = rectifyWorkerPoolMicrosecondsNow() - startedAt;
+
+    return 0;
+}
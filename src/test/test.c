@@ -3,6 +3,7 @@
  *  Licensed under the MIT License. See LICENSE in the project root for license information.
  *--------------------------------------------------------------------------------------------*/
 #include "rectify/rectify.h"
+#include "rectify/replay.h"
 #include "utest.h"
 #include <clog/clog.h>
 #include <imprint/default_setup.h>
@@ -10,6 +11,9 @@
 #include <nimble-steps-serialize/out_serialize.h>
 #include <nimble-steps/steps.h>
 #include <seer/seer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 typedef struct AppSpecificState {
     int x;
@@ -28,14 +32,16 @@ void appSpecificTick(void* _self, const TransmuteInput* input)
 {
     AppSpecificVm* self = (AppSpecificVm*) _self;
 
-    if (input->participantCount > 0) {
-        const AppSpecificParticipantInput* appSpecificInput = (AppSpecificParticipantInput*) input->participantInputs[0]
+    // Participants without input in time do not move
+    for (size_t i = 0; i < input->participantCount; ++i) {
+        const AppSpecificParticipantInput* appSpecificInput = (AppSpecificParticipantInput*) input->participantInputs[i]
                                                                   .input;
+        if (appSpecificInput == 0) {
+            continue;
+        }
         self->appSpecificState.x += appSpecificInput->horizontalAxis;
         CLOG_DEBUG("app: tick with input %d, x:%d", appSpecificInput->horizontalAxis,
                    self->appSpecificState.x)
-    } else {
-        CLOG_DEBUG("app: tick with no input")
     }
 
     self->appSpecificState.time++;
@@ -80,6 +86,9 @@ typedef struct AppSpecificCallback {
     TransmuteVm* authoritative;
     TransmuteVm* predicted;
     TransmuteState cachedState;
+    size_t copyCount;
+    size_t predictionTickCount;
+    Rectify* rectify;
 } AppSpecificCallback;
 
 
@@ -107,13 +116,15 @@ uint64_t rectifyAuthoritativeHashFn(void* _self)
     AppSpecificCallback* self = (AppSpecificCallback*) _self;
     CLOG_INFO("authoritative: hashFn")
 
-    return 0;
+    TransmuteState state = transmuteVmGetState(self->authoritative);
+    return rectifyTransmuteStateHash(&state);
 }
 
 void rectifyCopyAuthoritative(void* _self, StepId stepId)
 {
     AppSpecificCallback* self = (AppSpecificCallback*) _self;
     self->cachedState = transmuteVmGetState(self->authoritative);
+    self->copyCount++;
     CLOG_INFO("copy authoritative to prediction")
 
     transmuteVmSetState(self->predicted, &self->cachedState );
@@ -124,9 +135,47 @@ void rectifyPredictionTick(void* _self, const TransmuteInput* input, StepId step
 {
     AppSpecificCallback* self = (AppSpecificCallback*) _self;
     CLOG_INFO("predicted: tick")
+    self->predictionTickCount++;
     transmuteVmTick(self->predicted, input);
 }
 
+TransmuteState rectifyPredictionGetState(void* _self)
+{
+    AppSpecificCallback* self = (AppSpecificCallback*) _self;
+    return transmuteVmGetState(self->predicted);
+}
+
+/// The states are kept in the state arenas of Rectify instead of in the VMs. The arenas detect the written pages,
+/// so the callbacks write to them like to any other memory.
+void rectifyArenaAuthoritativeDeserialize(void* _self, const TransmuteState* state, StepId stepId)
+{
+    AppSpecificCallback* self = (AppSpecificCallback*) _self;
+    memcpy(rectifyAuthoritativeStateArena(self->rectify)->octets, state->state, state->octetSize);
+}
+
+void rectifyArenaAuthoritativeTick(void* _self, const TransmuteInput* input, StepId stepId)
+{
+    AppSpecificCallback* self = (AppSpecificCallback*) _self;
+    RectifyStateArena* arena = rectifyAuthoritativeStateArena(self->rectify);
+    appSpecificTick(arena->octets, input);
+}
+
+void rectifyArenaPredictionTick(void* _self, const TransmuteInput* input, StepId stepId)
+{
+    AppSpecificCallback* self = (AppSpecificCallback*) _self;
+    RectifyStateArena* arena = rectifyPredictedStateArena(self->rectify);
+    self->predictionTickCount++;
+    appSpecificTick(arena->octets, input);
+}
+
+TransmuteState rectifyArenaPredictionGetState(void* _self)
+{
+    AppSpecificCallback* self = (AppSpecificCallback*) _self;
+    RectifyStateArena* arena = rectifyPredictedStateArena(self->rectify);
+    TransmuteState state = {.state = arena->octets, .octetSize = arena->stateOctetSize};
+    return state;
+}
+
 void rectifyPostPredictionTick(void* _self)
 {
     AppSpecificCallback* self = (AppSpecificCallback*) _self;
@@ -163,6 +212,121 @@ static TransmuteVm createVm(AppSpecificVm* vmPointer, const char* description)
     return transmuteVm;
 }
 
+/// The application VMs and callbacks for a Rectify, with the default setup. Tests override the setup before starting.
+typedef struct TestApp {
+    ImprintDefaultSetup imprint;
+    AppSpecificVm authoritativeVm;
+    AppSpecificVm predictedVm;
+    TransmuteVm authoritativeTransmuteVm;
+    TransmuteVm predictedTransmuteVm;
+    AppSpecificCallback callback;
+    RectifyCallbackObjectVtbl vtbl;
+    RectifyCallbackObject callbackObject;
+    RectifySetup setup;
+    AppSpecificState initialAppState;
+    TransmuteState initialState;
+    AppSpecificParticipantInput gameInput;
+    TransmuteParticipantInput participantInputs[1];
+    TransmuteInput input;
+    Rectify rectify;
+} TestApp;
+
+static void testAppInit(TestApp* self)
+{
+    imprintDefaultSetupInit(&self->imprint, 16 * 1024 * 1024);
+
+    self->authoritativeTransmuteVm = createVm(&self->authoritativeVm, "AuthoritativeVm");
+    self->predictedTransmuteVm = createVm(&self->predictedVm, "PredictedVm");
+
+    AppSpecificCallback callback = {.predicted = &self->predictedTransmuteVm,
+                                    .authoritative = &self->authoritativeTransmuteVm};
+    self->callback = callback;
+
+    RectifyCallbackObjectVtbl vtbl = {
+        .authoritativeDeserializeFn = rectifyAuthoritativeDeserialize,
+        .authoritativeTickFn = rectifyAuthoritativeTick,
+        .authoritativeHashFn = rectifyAuthoritativeHashFn,
+        .predictionTickFn = rectifyPredictionTick,
+        .postPredictionTicksFn = rectifyPostPredictionTick,
+        .preAuthoritativeTicksFn = rectifyAuthoritativePreTicks,
+        .copyFromAuthoritativeToPredictionFn = rectifyCopyAuthoritative,
+        .predictionGetStateFn = rectifyPredictionGetState,
+    };
+    self->vtbl = vtbl;
+    self->callbackObject.vtbl = &self->vtbl;
+    self->callbackObject.self = &self->callback;
+
+    Clog subLog;
+    subLog.constantPrefix = "rectify";
+    subLog.config = &g_clog;
+
+    rectifySetupDefaults(&self->setup);
+    self->setup.allocator = &self->imprint.slabAllocator.info.allocator;
+    self->setup.maxStepOctetSizeForSingleParticipant = 5;
+    self->setup.maxPlayerCount = 32;
+    self->setup.log = subLog;
+
+    self->initialAppState.x = 0;
+    self->initialAppState.time = 0;
+    self->initialState.state = &self->initialAppState;
+    self->initialState.octetSize = sizeof(self->initialAppState);
+
+    self->gameInput.horizontalAxis = 1;
+    self->participantInputs[0].input = &self->gameInput;
+    self->participantInputs[0].octetSize = sizeof(self->gameInput);
+    self->participantInputs[0].participantId = 1;
+    self->participantInputs[0].localPartyId = 0;
+    self->participantInputs[0].inputType = TransmuteParticipantInputTypeNormal;
+    self->input.participantInputs = self->participantInputs;
+    self->input.participantCount = 1;
+
+    self->callback.rectify = &self->rectify;
+}
+
+/// Keeps the application states in the state arenas, so only the written chunks are copied to the prediction
+static void testAppUseStateArenas(TestApp* self)
+{
+    self->setup.stateArenaOctetSize = sizeof(AppSpecificState);
+    self->vtbl.authoritativeDeserializeFn = rectifyArenaAuthoritativeDeserialize;
+    self->vtbl.authoritativeTickFn = rectifyArenaAuthoritativeTick;
+    self->vtbl.authoritativeHashFn = 0;
+    self->vtbl.predictionTickFn = rectifyArenaPredictionTick;
+    self->vtbl.predictionGetStateFn = rectifyArenaPredictionGetState;
+}
+
+static Rectify* testAppStart(TestApp* self, StepId stepId)
+{
+    rectifyInit(&self->rectify, self->callbackObject, self->setup, self->initialState, stepId);
+    return &self->rectify;
+}
+
+/// An authoritative input with the local participant of the TestApp first, and a remote participant second
+typedef struct TestRemoteInput {
+    AppSpecificParticipantInput remoteGameInput;
+    TransmuteParticipantInput participantInputs[2];
+    TransmuteInput input;
+} TestRemoteInput;
+
+static void testRemoteInputInit(TestRemoteInput* self, const TestApp* app, uint8_t participantId, int horizontalAxis)
+{
+    self->remoteGameInput.horizontalAxis = horizontalAxis;
+    self->participantInputs[0] = app->participantInputs[0];
+    self->participantInputs[1] = app->participantInputs[0];
+    self->participantInputs[1].participantId = participantId;
+    self->participantInputs[1].input = &self->remoteGameInput;
+    self->input.participantInputs = self->participantInputs;
+    self->input.participantCount = 2;
+}
+
+static AppSpecificParticipantInput g_customRemoteGameInput = {.horizontalAxis = -2};
+
+static void testPredictRemoteInput(void* _self, StepId stepId, TransmuteParticipantInput* participantInput)
+{
+    participantInput->input = &g_customRemoteGameInput;
+    participantInput->octetSize = sizeof(g_customRemoteGameInput);
+    participantInput->inputType = TransmuteParticipantInputTypeNormal;
+}
+
 UTEST(Rectify, verify)
 {
     ImprintDefaultSetup imprint;
@@ -210,10 +374,10 @@ UTEST(Rectify, verify)
     RectifyCallbackObject rectifyCallbackObject = {.vtbl = &vtbl, .self = &appCallback};
 
     RectifySetup rectifySetup;
+    rectifySetupDefaults(&rectifySetup);
     rectifySetup.allocator = allocator;
     rectifySetup.maxStepOctetSizeForSingleParticipant = 5;
     rectifySetup.maxPlayerCount = 32;
-    rectifySetup.maxTicksFromAuthoritative = 16;
     rectifySetup.log = subLog;
     rectifyInit(&rectify, rectifyCallbackObject, rectifySetup, initialTransmuteState, initialStepId);
 
@@ -322,3 +486,1351 @@ UTEST(Rectify, verify)
         ASSERT_EQ(1, currentAppState->time);
         */
 }
+
+UTEST(Rectify, confirmedPredictionIsKept)
+{
+    TestApp app;
+    testAppInit(&app);
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+    app.gameInput.horizontalAxis = 24;
+    const AppSpecificState* predicted = &app.predictedVm.appSpecificState;
+
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(1, app.callback.copyCount);
+
+    app.gameInput.horizontalAxis = -1;
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 1);
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 2);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(22, predicted->x);
+    ASSERT_EQ(2, app.callback.predictionTickCount);
+
+    CLOG_INFO("authoritative step is the same as predicted, should not roll back")
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + 1);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(1, app.callback.copyCount);
+    ASSERT_EQ(2, app.callback.predictionTickCount);
+    ASSERT_EQ(22, predicted->x);
+
+    CLOG_INFO("authoritative step differs from predicted, must roll back")
+    app.gameInput.horizontalAxis = 5;
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + 2);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(2, app.callback.copyCount);
+    ASSERT_EQ(28, predicted->x);
+
+    const RectifyStats* stats = rectifyStats(rectify);
+    ASSERT_EQ(3, stats->authoritativeTicks);
+    ASSERT_EQ(1, stats->predictionConfirmations);
+    ASSERT_EQ(2, stats->predictionResets);
+    ASSERT_EQ(0, stats->predictionResimulatedTicks);
+
+    rectifyStatsReset(rectify);
+    ASSERT_EQ(0, stats->authoritativeTicks);
+}
+
+UTEST(Rectify, predictionWindow)
+{
+    TestApp app;
+    testAppInit(&app);
+    app.setup.predictionWindow.minTicks = 2;
+    app.setup.predictionWindow.shrinkHysteresisTicks = 2;
+    app.setup.predictionWindow.shrinkAfterUpdates = 1;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+
+    ASSERT_EQ(16, rectifyEffectivePredictionWindow(rectify));
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId);
+    rectifyUpdate(rectify);
+    CLOG_INFO("nothing was predicted ahead, so the prediction window shrinks to the minimum")
+    ASSERT_EQ(2, rectifyEffectivePredictionWindow(rectify));
+
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 1);
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 2);
+    ASSERT_FALSE(rectifyMustAddPredictedStepThisTick(rectify));
+    rectifyUpdate(rectify);
+
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + 1);
+    rectifyUpdate(rectify);
+    CLOG_INFO("the prediction window was full when the authoritative step arrived, so it grows")
+    ASSERT_EQ(3, rectifyEffectivePredictionWindow(rectify));
+
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + 2);
+    rectifyUpdate(rectify);
+    CLOG_INFO("a smaller lead is within the hysteresis, so the prediction window is kept")
+    ASSERT_EQ(3, rectifyEffectivePredictionWindow(rectify));
+
+    const RectifyStats* stats = rectifyStats(rectify);
+    ASSERT_EQ(2, stats->predictionWindowChanges);
+    ASSERT_EQ(3, stats->predictionWindowTicks);
+}
+
+UTEST(Rectify, timeSync)
+{
+    TestApp app;
+    testAppInit(&app);
+    app.setup.timeSync.targetLeadTicks = 1;
+    app.setup.timeSync.smoothingUpdates = 1;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+
+    ASSERT_EQ(1000, rectifyTickDurationPermille(rectify));
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId);
+    rectifyUpdate(rectify);
+
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 1);
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 2);
+    rectifyUpdate(rectify);
+
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + 1);
+    rectifyUpdate(rectify);
+    CLOG_INFO("the prediction is one tick ahead of the authoritative state, as targeted")
+    ASSERT_EQ(1000, rectifyTickDurationPermille(rectify));
+
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + 2);
+    rectifyUpdate(rectify);
+    CLOG_INFO("the authoritative state caught up with the prediction, so the local ticks should be shorter")
+    ASSERT_EQ(990, rectifyTickDurationPermille(rectify));
+}
+
+UTEST(Rectify, correctionWithStateArenas)
+{
+    TestApp app;
+    testAppInit(&app);
+    testAppUseStateArenas(&app);
+    app.setup.maxPresentationStateOctetSize = sizeof(AppSpecificState);
+    app.setup.compactStepOctetSize = 1024;
+    app.setup.useDeltaEncodedSteps = true;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+    app.gameInput.horizontalAxis = 24;
+    const AppSpecificState* predicted = (const AppSpecificState*) rectifyPredictedStateArena(rectify)->octets;
+
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(1, rectifyStats(rectify)->predictionResets);
+
+    app.gameInput.horizontalAxis = -1;
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 1);
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 2);
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 3);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(21, predicted->x);
+
+    CLOG_INFO("first authoritative step confirms, the second diverges. only the written chunks are copied")
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + 1);
+    app.gameInput.horizontalAxis = 5;
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + 2);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(2, rectifyStats(rectify)->predictionResets);
+    ASSERT_EQ(1, rectifyStats(rectify)->predictionDirtyRangeResets);
+    ASSERT_EQ(23 + 5 - 1, predicted->x);
+    ASSERT_EQ(4, predicted->time);
+
+    const RectifyPresentationState* presentation = rectifyPresentationState(rectify);
+    ASSERT_TRUE(presentation != 0);
+    ASSERT_EQ(initialStepId + 4, presentation->stepId);
+    ASSERT_EQ(23 + 5 - 1, ((const AppSpecificState*) presentation->state.state)->x);
+    ASSERT_TRUE(rectifyPredictionIsCurrent(rectify));
+    rectifyDestroy(rectify);
+}
+
+UTEST(Rectify, slicedResimulation)
+{
+    TestApp app;
+    testAppInit(&app);
+    testAppUseStateArenas(&app);
+    app.setup.maxPresentationStateOctetSize = sizeof(AppSpecificState);
+    app.setup.resimulation.maxTicksPerUpdate = 2;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+    app.gameInput.horizontalAxis = 24;
+    const AppSpecificState* predicted = (const AppSpecificState*) rectifyPredictedStateArena(rectify)->octets;
+
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId);
+    rectifyUpdate(rectify);
+
+    app.gameInput.horizontalAxis = -1;
+    for (StepId i = 1; i < 5; ++i) {
+        rectifyAddPredictedStep(rectify, &app.input, initialStepId + i);
+    }
+    rectifyUpdate(rectify);
+    ASSERT_EQ(24 - 4, predicted->x);
+
+    CLOG_INFO("the re-simulation after the correction is spread over two updates, at most two ticks each")
+    app.gameInput.horizontalAxis = 5;
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + 1);
+    rectifyUpdate(rectify);
+    ASSERT_FALSE(rectifyPredictionIsCurrent(rectify));
+    ASSERT_EQ(24 + 5 - 2, predicted->x);
+    ASSERT_EQ(4, predicted->time);
+    const RectifyPresentationState* presentation = rectifyPresentationState(rectify);
+    ASSERT_EQ(initialStepId + 5, presentation->stepId);
+    ASSERT_EQ(24 - 4, ((const AppSpecificState*) presentation->state.state)->x);
+
+    rectifyUpdate(rectify);
+    ASSERT_TRUE(rectifyPredictionIsCurrent(rectify));
+    ASSERT_EQ(5, predicted->time);
+    presentation = rectifyPresentationState(rectify);
+    ASSERT_EQ(initialStepId + 5, presentation->stepId);
+    ASSERT_EQ(24 + 5 - 3, ((const AppSpecificState*) presentation->state.state)->x);
+    ASSERT_EQ(1, rectifyStats(rectify)->slicedResimulations);
+    ASSERT_EQ(2, rectifyStats(rectify)->slicedResimulationUpdates);
+    rectifyDestroy(rectify);
+}
+
+UTEST(Rectify, predictionWindowWithSlicedResimulation)
+{
+    TestApp app;
+    testAppInit(&app);
+    app.setup.predictionWindow.minTicks = 4;
+    app.setup.predictionWindow.shrinkHysteresisTicks = 2;
+    app.setup.predictionWindow.shrinkAfterUpdates = 1;
+    app.setup.resimulation.maxTicksPerUpdate = 2;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+    const RectifyStats* stats = rectifyStats(rectify);
+
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(4, rectifyEffectivePredictionWindow(rectify));
+
+    for (StepId i = 1; i < 5; ++i) {
+        rectifyAddPredictedStep(rectify, &app.input, initialStepId + i);
+    }
+    rectifyUpdate(rectify);
+    ASSERT_EQ(4, stats->predictionTicks);
+    ASSERT_FALSE(rectifyMustAddPredictedStepThisTick(rectify));
+
+    CLOG_INFO("the correction grows the window and starts a sliced re-simulation in the same update")
+    app.gameInput.horizontalAxis = 5;
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + 1);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(5, rectifyEffectivePredictionWindow(rectify));
+    ASSERT_FALSE(rectifyPredictionIsCurrent(rectify));
+    ASSERT_EQ(4 + 2, stats->predictionTicks);
+    CLOG_INFO("the slice does not change the window, so more steps can be added while re-simulating")
+    ASSERT_TRUE(rectifyMustAddPredictedStepThisTick(rectify));
+
+    rectifyUpdate(rectify);
+    ASSERT_TRUE(rectifyPredictionIsCurrent(rectify));
+    ASSERT_EQ(4 + 3, stats->predictionTicks);
+
+    CLOG_INFO("after the re-simulation the grown window limits the ticks again")
+    for (StepId i = 5; i < 12; ++i) {
+        rectifyAddPredictedStep(rectify, &app.input, initialStepId + i);
+    }
+    rectifyUpdate(rectify);
+    ASSERT_EQ(5, rectifyEffectivePredictionWindow(rectify));
+    ASSERT_EQ(4 + 3 + 5, stats->predictionTicks);
+}
+
+UTEST(Rectify, speculativeBranchAdoption)
+{
+    TestApp app;
+    testAppInit(&app);
+    testAppUseStateArenas(&app);
+    app.setup.speculation.branchCount = 2;
+    app.setup.speculation.hypotheses[0] = RectifySpeculationHypothesisNoInput;
+    app.setup.speculation.hypotheses[1] = RectifySpeculationHypothesisRepeatLastAuthoritative;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+    const RectifyStats* stats = rectifyStats(rectify);
+
+    TestRemoteInput remote;
+    testRemoteInputInit(&remote, &app, 2, 3);
+
+    rectifyAddAuthoritativeStep(rectify, &remote.input, initialStepId);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(1, stats->predictionResets);
+
+    CLOG_INFO("the main prediction has no input for the remote, the second branch repeats its last input")
+    for (StepId i = 1; i < 4; ++i) {
+        rectifyAddPredictedStep(rectify, &app.input, initialStepId + i);
+    }
+    rectifyUpdate(rectify);
+    const AppSpecificState* predicted = (const AppSpecificState*) rectifyPredictedStateArena(rectify)->octets;
+    ASSERT_EQ(4 + 3, predicted->x);
+    ASSERT_EQ(4, predicted->time);
+    ASSERT_EQ(6, stats->speculativeTicks);
+
+    CLOG_INFO("the remote repeated its input, so the second branch is adopted instead of re-simulating")
+    rectifyAddAuthoritativeStep(rectify, &remote.input, initialStepId + 1);
+    rectifyAddAuthoritativeStep(rectify, &remote.input, initialStepId + 2);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(1, stats->speculativeBranchAdoptions);
+    ASSERT_EQ(1, stats->predictionResets);
+    // The branch arena was swapped in, so the octets must be read from the arena again
+    predicted = (const AppSpecificState*) rectifyPredictedStateArena(rectify)->octets;
+    ASSERT_EQ(4 + 3 * 4, predicted->x);
+    ASSERT_EQ(4, predicted->time);
+
+    CLOG_INFO("the remote changed its input, no branch matches and the prediction falls back to a reset")
+    remote.remoteGameInput.horizontalAxis = 5;
+    rectifyAddAuthoritativeStep(rectify, &remote.input, initialStepId + 3);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(1, stats->speculativeBranchAdoptions);
+    ASSERT_EQ(2, stats->predictionResets);
+    predicted = (const AppSpecificState*) rectifyPredictedStateArena(rectify)->octets;
+    ASSERT_EQ(3 * 4 + 6, predicted->x);
+    ASSERT_EQ(4, predicted->time);
+    rectifyDestroy(rectify);
+}
+
+UTEST(Rectify, composedLayoutFollowsParticipants)
+{
+    TestApp app;
+    testAppInit(&app);
+    app.gameInput.horizontalAxis = 7;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+
+    AppSpecificParticipantInput remoteGameInput = {.horizontalAxis = 1};
+    TransmuteParticipantInput local = app.participantInputs[0];
+    TransmuteParticipantInput remote = local;
+    remote.participantId = 2;
+    remote.input = &remoteGameInput;
+    TransmuteParticipantInput joined = remote;
+    joined.participantId = 3;
+    TransmuteParticipantInput authoritativeParticipants[3];
+    TransmuteInput authoritativeInput = {.participantInputs = authoritativeParticipants};
+    const RectifyInputHistoryEntry* composed;
+
+    authoritativeParticipants[0] = local;
+    authoritativeInput.participantCount = 1;
+    rectifyAddAuthoritativeStep(rectify, &authoritativeInput, initialStepId);
+    rectifyUpdate(rectify);
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 1);
+    composed = rectifyInputHistoryFind(&rectify->predictedInputs, initialStepId + 1);
+    ASSERT_EQ(1, composed->input.participantCount);
+    ASSERT_EQ(7, ((const AppSpecificParticipantInput*) composed->input.participantInputs[0].input)->horizontalAxis);
+
+    CLOG_INFO("a remote participant joins, and is predicted as no input in time after the local participant")
+    authoritativeParticipants[1] = remote;
+    authoritativeInput.participantCount = 2;
+    rectifyAddAuthoritativeStep(rectify, &authoritativeInput, initialStepId + 1);
+    rectifyUpdate(rectify);
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 2);
+    composed = rectifyInputHistoryFind(&rectify->predictedInputs, initialStepId + 2);
+    ASSERT_EQ(2, composed->input.participantCount);
+    ASSERT_EQ(1, composed->input.participantInputs[0].participantId);
+    ASSERT_EQ(TransmuteParticipantInputTypeNormal, composed->input.participantInputs[0].inputType);
+    ASSERT_EQ(2, composed->input.participantInputs[1].participantId);
+    ASSERT_EQ(TransmuteParticipantInputTypeNoInputInTime, composed->input.participantInputs[1].inputType);
+
+    CLOG_INFO("the participants are reordered, the local input moves with its participant")
+    authoritativeParticipants[0] = remote;
+    authoritativeParticipants[1] = local;
+    rectifyAddAuthoritativeStep(rectify, &authoritativeInput, initialStepId + 2);
+    rectifyUpdate(rectify);
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 3);
+    composed = rectifyInputHistoryFind(&rectify->predictedInputs, initialStepId + 3);
+    ASSERT_EQ(2, composed->input.participantCount);
+    ASSERT_EQ(2, composed->input.participantInputs[0].participantId);
+    ASSERT_EQ(TransmuteParticipantInputTypeNoInputInTime, composed->input.participantInputs[0].inputType);
+    ASSERT_TRUE(composed->input.participantInputs[0].input == 0);
+    ASSERT_EQ(1, composed->input.participantInputs[1].participantId);
+    ASSERT_EQ(7, ((const AppSpecificParticipantInput*) composed->input.participantInputs[1].input)->horizontalAxis);
+
+    CLOG_INFO("the local participant leaves, so the local input is not used")
+    authoritativeParticipants[0] = remote;
+    authoritativeInput.participantCount = 1;
+    rectifyAddAuthoritativeStep(rectify, &authoritativeInput, initialStepId + 3);
+    rectifyUpdate(rectify);
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 4);
+    composed = rectifyInputHistoryFind(&rectify->predictedInputs, initialStepId + 4);
+    ASSERT_EQ(1, composed->input.participantCount);
+    ASSERT_EQ(2, composed->input.participantInputs[0].participantId);
+    ASSERT_EQ(TransmuteParticipantInputTypeNoInputInTime, composed->input.participantInputs[0].inputType);
+
+    CLOG_INFO("a new participant joins and the local participant comes back, while the remote leaves")
+    authoritativeParticipants[0] = joined;
+    authoritativeParticipants[1] = local;
+    authoritativeInput.participantCount = 2;
+    rectifyAddAuthoritativeStep(rectify, &authoritativeInput, initialStepId + 4);
+    rectifyUpdate(rectify);
+    app.gameInput.horizontalAxis = 9;
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 5);
+    composed = rectifyInputHistoryFind(&rectify->predictedInputs, initialStepId + 5);
+    ASSERT_EQ(2, composed->input.participantCount);
+    ASSERT_EQ(3, composed->input.participantInputs[0].participantId);
+    ASSERT_EQ(TransmuteParticipantInputTypeNoInputInTime, composed->input.participantInputs[0].inputType);
+    ASSERT_EQ(1, composed->input.participantInputs[1].participantId);
+    ASSERT_EQ(9, ((const AppSpecificParticipantInput*) composed->input.participantInputs[1].input)->horizontalAxis);
+    ASSERT_TRUE(rectifyRemoteParticipant(rectify, 2) == 0);
+}
+
+UTEST(Rectify, omittedLocalInputIsCleared)
+{
+    TestApp app;
+    testAppInit(&app);
+    app.setup.remotePrediction.mode = RectifyRemoteInputPredictionModeRepeatLast;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+    TestRemoteInput authoritative;
+    testRemoteInputInit(&authoritative, &app, 2, 3);
+    rectifyAddAuthoritativeStep(rectify, &authoritative.input, initialStepId);
+    rectifyUpdate(rectify);
+
+    CLOG_INFO("both participants are local in the first call")
+    AppSpecificParticipantInput secondGameInput = {.horizontalAxis = 5};
+    TransmuteParticipantInput localParticipants[2];
+    localParticipants[0] = app.participantInputs[0];
+    localParticipants[1] = app.participantInputs[0];
+    localParticipants[1].participantId = 2;
+    localParticipants[1].input = &secondGameInput;
+    TransmuteInput localInput = {.participantInputs = localParticipants, .participantCount = 2};
+    rectifyAddPredictedStep(rectify, &localInput, initialStepId + 1);
+    const RectifyInputHistoryEntry* composed = rectifyInputHistoryFind(&rectify->predictedInputs, initialStepId + 1);
+    ASSERT_EQ(5, ((const AppSpecificParticipantInput*) composed->input.participantInputs[1].input)->horizontalAxis);
+
+    CLOG_INFO("the second local participant leaves out its input, and the input of the last call is not kept")
+    localInput.participantCount = 1;
+    rectifyAddPredictedStep(rectify, &localInput, initialStepId + 2);
+    composed = rectifyInputHistoryFind(&rectify->predictedInputs, initialStepId + 2);
+    ASSERT_EQ(2, composed->input.participantCount);
+    ASSERT_EQ(TransmuteParticipantInputTypeNormal, composed->input.participantInputs[0].inputType);
+    ASSERT_EQ(2, composed->input.participantInputs[1].participantId);
+    ASSERT_EQ(TransmuteParticipantInputTypeNoInputInTime, composed->input.participantInputs[1].inputType);
+    ASSERT_TRUE(composed->input.participantInputs[1].input == 0);
+    ASSERT_TRUE(rectify->buildComposedPredictedInput.participantInputs[1].input == 0);
+}
+
+static StepId g_predictedRemoteStepIds[8];
+static size_t g_predictedRemoteStepCount;
+
+static void testRecordPredictedRemote(void* _self, StepId stepId, TransmuteParticipantInput* participantInput)
+{
+    if (g_predictedRemoteStepCount < 8) {
+        g_predictedRemoteStepIds[g_predictedRemoteStepCount++] = stepId;
+    }
+}
+
+UTEST(Rectify, inputDelay)
+{
+    TestApp app;
+    testAppInit(&app);
+    app.setup.inputDelay.ticks = 1;
+    app.setup.inputDelay.maxTicks = 3;
+    app.vtbl.predictRemoteInputFn = testRecordPredictedRemote;
+    g_predictedRemoteStepCount = 0;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+    TestRemoteInput remote;
+    testRemoteInputInit(&remote, &app, 2, 3);
+
+    rectifyAddAuthoritativeStep(rectify, &remote.input, initialStepId);
+    rectifyUpdate(rectify);
+
+    CLOG_INFO("the local input is predicted one step later, and the time sync measures the lead from that step")
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 1);
+    ASSERT_TRUE(rectifyInputHistoryHas(&rectify->predictedInputs, initialStepId + 2));
+    ASSERT_FALSE(rectifyInputHistoryHas(&rectify->predictedInputs, initialStepId + 1));
+    ASSERT_EQ(initialStepId + 2, rectify->timeSync.newestPredictedStepId);
+    ASSERT_EQ(1, g_predictedRemoteStepCount);
+    ASSERT_EQ(initialStepId + 2, g_predictedRemoteStepIds[0]);
+
+    CLOG_INFO("a skipped tick is filled with the same local input, the remote input is predicted for every step")
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 3);
+    ASSERT_TRUE(rectifyInputHistoryHas(&rectify->predictedInputs, initialStepId + 3));
+    ASSERT_TRUE(rectifyInputHistoryHas(&rectify->predictedInputs, initialStepId + 4));
+    ASSERT_EQ(initialStepId + 4, rectify->timeSync.newestPredictedStepId);
+    ASSERT_EQ(3, g_predictedRemoteStepCount);
+    ASSERT_EQ(initialStepId + 3, g_predictedRemoteStepIds[1]);
+    ASSERT_EQ(initialStepId + 4, g_predictedRemoteStepIds[2]);
+
+    CLOG_INFO("re-simulations over the budget makes the local input delay grow, one tick at a time")
+    RectifyInputDelaySetup inputDelaySetup = {
+        .ticks = 1, .maxTicks = 3, .resimulationBudgetMicroseconds = 100, .adaptAfterUpdates = 2};
+    RectifyInputDelay inputDelay;
+    rectifyInputDelayInit(&inputDelay, inputDelaySetup);
+    StepId firstStepId;
+    ASSERT_EQ(1, rectifyInputDelayMap(&inputDelay, 10, &firstStepId));
+    ASSERT_EQ(11, firstStepId);
+    for (size_t i = 0; i < 4; ++i) {
+        rectifyInputDelayCountResimulatedTick(&inputDelay);
+    }
+    ASSERT_EQ(1, rectifyInputDelayUpdate(&inputDelay, 100));
+    ASSERT_EQ(2, rectifyInputDelayUpdate(&inputDelay, 100));
+    ASSERT_EQ(2, rectifyInputDelayMap(&inputDelay, 11, &firstStepId));
+    ASSERT_EQ(12, firstStepId);
+
+    CLOG_INFO("without re-simulations the delay shrinks again, and the input for an already delayed step is dropped")
+    ASSERT_EQ(2, rectifyInputDelayUpdate(&inputDelay, 100));
+    ASSERT_EQ(1, rectifyInputDelayUpdate(&inputDelay, 100));
+    ASSERT_EQ(0, rectifyInputDelayMap(&inputDelay, 12, &firstStepId));
+    ASSERT_EQ(1, rectifyInputDelayMap(&inputDelay, 13, &firstStepId));
+    ASSERT_EQ(14, firstStepId);
+
+    CLOG_INFO("a longer delay that did not make the re-simulations cheaper is reverted, and not tried again at once")
+    inputDelaySetup.ticks = 0;
+    inputDelaySetup.adaptAfterUpdates = 1;
+    rectifyInputDelayInit(&inputDelay, inputDelaySetup);
+    for (size_t period = 0; period < 3; ++period) {
+        for (size_t i = 0; i < 4; ++i) {
+            rectifyInputDelayCountResimulatedTick(&inputDelay);
+        }
+        ASSERT_EQ(period == 0 ? 1 : 0, rectifyInputDelayUpdate(&inputDelay, 100));
+    }
+}
+
+/// Every authoritative step mispredicts the remote participant, and arrives `localLeadTicks` after the local tick.
+/// Returns the number of re-simulated ticks.
+static size_t testDelayedCorrections(size_t inputDelayTicks, size_t localLeadTicks, StepId* outPredictedStepId)
+{
+    TestApp app;
+    testAppInit(&app);
+    app.setup.inputDelay.ticks = inputDelayTicks;
+    app.setup.inputDelay.maxTicks = inputDelayTicks;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+    TestRemoteInput remote;
+    testRemoteInputInit(&remote, &app, 2, 3);
+
+    rectifyAddAuthoritativeStep(rectify, &remote.input, initialStepId);
+    rectifyUpdate(rectify);
+    for (StepId tickId = initialStepId + 1; tickId < initialStepId + 20; ++tickId) {
+        rectifyAddPredictedStep(rectify, &app.input, tickId);
+        if (tickId - initialStepId > localLeadTicks) {
+            rectifyAddAuthoritativeStep(rectify, &remote.input, tickId - (StepId) localLeadTicks);
+        }
+        rectifyUpdate(rectify);
+    }
+    *outPredictedStepId = rectify->predicted.stepId;
+
+    return rectifyStats(rectify)->predictionResimulatedTicks;
+}
+
+UTEST(Rectify, inputDelayShortensResimulation)
+{
+    StepId lastTickId = 101 + 19;
+    StepId predictedStepId;
+    size_t withoutDelay = testDelayedCorrections(0, 4, &predictedStepId);
+    ASSERT_EQ(lastTickId + 1, predictedStepId);
+    ASSERT_GT(withoutDelay, 0);
+
+    CLOG_INFO("the delayed inputs are queued, but the prediction is not ticked past the local tick")
+    size_t withDelay = testDelayedCorrections(2, 4, &predictedStepId);
+    ASSERT_EQ(lastTickId + 1, predictedStepId);
+    ASSERT_LE(withDelay, withoutDelay);
+
+    CLOG_INFO("the time sync lets the client run as many ticks less ahead as the delay, so less is re-simulated")
+    size_t withDelayAndShorterLead = testDelayedCorrections(2, 2, &predictedStepId);
+    ASSERT_EQ(lastTickId + 1, predictedStepId);
+    ASSERT_LT(withDelayAndShorterLead, withoutDelay);
+}
+
+UTEST(Rectify, remoteInputPrediction)
+{
+    TestApp app;
+    testAppInit(&app);
+    app.setup.remotePrediction.mode = RectifyRemoteInputPredictionModeRepeatLast;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+    const AppSpecificState* predicted = &app.predictedVm.appSpecificState;
+    TestRemoteInput remote;
+    testRemoteInputInit(&remote, &app, 2, 3);
+
+    rectifyAddAuthoritativeStep(rectify, &remote.input, initialStepId);
+    rectifyUpdate(rectify);
+
+    CLOG_INFO("the remote participant is predicted to repeat its last authoritative input")
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 1);
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 2);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(4 + 2 * 4, predicted->x);
+
+    CLOG_INFO("the first step is predicted correctly, the second is not")
+    rectifyAddAuthoritativeStep(rectify, &remote.input, initialStepId + 1);
+    remote.remoteGameInput.horizontalAxis = 6;
+    rectifyAddAuthoritativeStep(rectify, &remote.input, initialStepId + 2);
+    rectifyUpdate(rectify);
+    const RectifyRemoteParticipant* remoteParticipant = rectifyRemoteParticipant(rectify, 2);
+    ASSERT_TRUE(remoteParticipant != 0);
+    ASSERT_FALSE(remoteParticipant->isLocal);
+    ASSERT_EQ(1, remoteParticipant->hits);
+    ASSERT_EQ(1, remoteParticipant->misses);
+    ASSERT_EQ(initialStepId + 2, remoteParticipant->lastSeenStepId);
+    ASSERT_EQ(6, ((const AppSpecificParticipantInput*) remoteParticipant->octets)->horizontalAxis);
+    const RectifyRemoteParticipant* localParticipant = rectifyRemoteParticipant(rectify, 1);
+    ASSERT_TRUE(localParticipant != 0);
+    ASSERT_TRUE(localParticipant->isLocal);
+    ASSERT_EQ(0, localParticipant->hits + localParticipant->misses);
+
+    CLOG_INFO("the custom predictor overrides the repeated input")
+    app.vtbl.predictRemoteInputFn = testPredictRemoteInput;
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 3);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(15 + 1 - 2, predicted->x);
+    remote.remoteGameInput.horizontalAxis = -2;
+    rectifyAddAuthoritativeStep(rectify, &remote.input, initialStepId + 3);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(2, remoteParticipant->hits);
+    ASSERT_EQ(1, rectifyStats(rectify)->predictionConfirmations);
+
+    CLOG_INFO("the remote participant leaves, and its slot is given back")
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + 4);
+    rectifyUpdate(rectify);
+    ASSERT_TRUE(rectifyRemoteParticipant(rectify, 2) == 0);
+    ASSERT_TRUE(rectifyRemoteParticipant(rectify, 1) != 0);
+    ASSERT_EQ(1, rectify->remotePredictor.participantCount);
+
+    CLOG_INFO("a reset forgets the local participants too")
+    rectifyReset(rectify, app.initialState, initialStepId + 10);
+    ASSERT_TRUE(rectifyRemoteParticipant(rectify, 1) == 0);
+}
+
+UTEST(Rectify, catchUpTickCap)
+{
+    TestApp app;
+    testAppInit(&app);
+    app.setup.catchUp.maxTicksPerUpdate = 8;
+    app.setup.traceEventCapacity = 64;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+
+    for (StepId i = 0; i < 12; ++i) {
+        rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + i);
+    }
+
+    rectifyUpdate(rectify);
+    const RectifyCatchUpReport* report = rectifyCatchUpReport(rectify);
+    ASSERT_EQ(12, report->backlogBeforeUpdate);
+    ASSERT_EQ(8, report->ticksLastUpdate);
+    ASSERT_EQ(4, report->backlogAfterUpdate);
+    ASSERT_TRUE(report->wasCappedLastUpdate);
+    ASSERT_EQ(8, app.authoritativeVm.appSpecificState.time);
+
+    const RectifyTrace* trace = rectifyGetTrace(rectify);
+    ASSERT_TRUE(trace != 0);
+    const RectifyTraceEvent* cappedEvent = rectifyTraceEventAt(trace, trace->count - 2);
+    ASSERT_EQ(RectifyTraceEventTypeCatchUpCapped, cappedEvent->type);
+    ASSERT_EQ(initialStepId + 8, cappedEvent->stepId);
+    ASSERT_EQ(4, cappedEvent->a);
+
+    char json[4096];
+    ASSERT_TRUE(rectifyTraceToChromeTraceJson(trace, json, sizeof(json)) > 0);
+    ASSERT_TRUE(rectifyTraceToChromeTraceJson(trace, json, 16) < 0);
+
+    rectifyUpdate(rectify);
+    ASSERT_EQ(4, report->ticksLastUpdate);
+    ASSERT_FALSE(report->wasCappedLastUpdate);
+    ASSERT_EQ(12, app.authoritativeVm.appSpecificState.time);
+}
+
+UTEST(Rectify, resetReusesBuffers)
+{
+    TestApp app;
+    testAppInit(&app);
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+
+    for (StepId i = 0; i < 12; ++i) {
+        rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + i);
+    }
+    rectifyUpdate(rectify);
+    ASSERT_EQ(12, app.authoritativeVm.appSpecificState.time);
+    ASSERT_EQ(12, app.predictedVm.appSpecificState.time);
+
+    CLOG_INFO("a new match reuses the same buffers")
+    rectifyReset(rectify, app.initialState, initialStepId);
+    ASSERT_EQ(0, app.authoritativeVm.appSpecificState.time);
+    ASSERT_EQ(0, app.predictedVm.appSpecificState.time);
+    ASSERT_EQ(0, rectifyStats(rectify)->authoritativeTicks);
+
+    for (StepId i = 0; i < 3; ++i) {
+        ASSERT_TRUE(rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + i) >= 0);
+    }
+    rectifyUpdate(rectify);
+    ASSERT_EQ(3, rectifyCatchUpReport(rectify)->ticksLastUpdate);
+    ASSERT_EQ(3, app.authoritativeVm.appSpecificState.time);
+
+    rectifyDestroy(rectify);
+}
+
+UTEST(Rectify, authoritativeSnapshot)
+{
+    TestApp app;
+    testAppInit(&app);
+    app.setup.traceEventCapacity = 64;
+    app.setup.snapshotPolicy.minStepsBehind = 5;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+
+    for (StepId i = 0; i < 3; ++i) {
+        ASSERT_TRUE(rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + i) >= 0);
+    }
+    rectifyUpdate(rectify);
+    ASSERT_EQ(3, app.authoritativeVm.appSpecificState.time);
+
+    CLOG_INFO("a snapshot at least five steps ahead is preferred over ticking through, and replaces the queued steps")
+    for (StepId i = 3; i < 6; ++i) {
+        ASSERT_TRUE(rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + i) >= 0);
+    }
+    AppSpecificState snapshotAppState = {.x = 7, .time = 10};
+    TransmuteState snapshotState = {.state = &snapshotAppState, .octetSize = sizeof(snapshotAppState)};
+    ASSERT_EQ(-1, rectifySetAuthoritativeSnapshot(rectify, snapshotState, initialStepId + 2));
+    ASSERT_EQ(0, rectifyOfferAuthoritativeSnapshot(rectify, snapshotState, initialStepId + 6));
+    ASSERT_EQ(1, rectifyOfferAuthoritativeSnapshot(rectify, snapshotState, initialStepId + 10));
+    ASSERT_EQ(10, app.authoritativeVm.appSpecificState.time);
+    const RectifyTrace* trace = rectifyGetTrace(rectify);
+    const RectifyTraceEvent* snapshotEvent = rectifyTraceEventAt(trace, trace->count - 1);
+    ASSERT_EQ(RectifyTraceEventTypeAuthoritativeSnapshot, snapshotEvent->type);
+    ASSERT_EQ(7, snapshotEvent->a);
+    ASSERT_EQ(3, snapshotEvent->b);
+    ASSERT_EQ(1, rectifyStats(rectify)->authoritativeSnapshots);
+    ASSERT_EQ(7, rectifyStats(rectify)->authoritativeSnapshotSkippedSteps);
+
+    for (StepId i = 10; i < 12; ++i) {
+        ASSERT_TRUE(rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + i) >= 0);
+    }
+    rectifyUpdate(rectify);
+    ASSERT_EQ(12, app.authoritativeVm.appSpecificState.time);
+    ASSERT_EQ(9, app.authoritativeVm.appSpecificState.x);
+}
+
+/// Formats a path for `fileName` in the temporary directory, so tests don't write to the working directory
+static void testTempPath(char* target, size_t maxOctetCount, const char* fileName)
+{
+    const char* directory = getenv("TMPDIR");
+    if (directory == 0) {
+        directory = getenv("TEMP");
+    }
+    if (directory == 0) {
+        directory = "/tmp";
+    }
+    snprintf(target, maxOctetCount, "%s/%s", directory, fileName);
+}
+
+UTEST(Rectify, replay)
+{
+    TestApp app;
+    testAppInit(&app);
+    char replayPath[256];
+    testTempPath(replayPath, sizeof(replayPath), "rectify_test.replay");
+    RectifyReplayRecorder recorder;
+    ASSERT_EQ(0, rectifyReplayRecorderOpen(&recorder, app.setup.allocator, replayPath, 64));
+    app.setup.replayRecorder = &recorder;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+
+    for (StepId i = 0; i < 6; ++i) {
+        ASSERT_TRUE(rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + i) >= 0);
+    }
+    rectifyUpdate(rectify);
+    rectifyReset(rectify, app.initialState, initialStepId);
+    for (StepId i = 0; i < 3; ++i) {
+        ASSERT_TRUE(rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + i) >= 0);
+    }
+    AppSpecificState snapshotAppState = {.x = 7, .time = 10};
+    TransmuteState snapshotState = {.state = &snapshotAppState, .octetSize = sizeof(snapshotAppState)};
+    ASSERT_EQ(0, rectifySetAuthoritativeSnapshot(rectify, snapshotState, initialStepId + 10));
+    for (StepId i = 10; i < 12; ++i) {
+        ASSERT_TRUE(rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + i) >= 0);
+    }
+    rectifyUpdate(rectify);
+    ASSERT_EQ(12, app.authoritativeVm.appSpecificState.time);
+    ASSERT_EQ(9, app.authoritativeVm.appSpecificState.x);
+    rectifyDestroy(rectify);
+
+    CLOG_INFO("the recorded steps and states are played back at full speed")
+    ASSERT_EQ(0, rectifyReplayRecorderClose(&recorder));
+    ASSERT_EQ(2 + 6 + 3 + 1 + 2, recorder.recordCount);
+
+    RectifyReplay replay;
+    ASSERT_EQ(0, rectifyReplayOpen(&replay, app.setup.allocator, replayPath, 32));
+    RectifyReplayReport replayReport;
+    Rectify replayed;
+    ASSERT_EQ(0, rectifyReplayRun(&replay, &replayed, app.callbackObject, app.setup, &replayReport));
+    ASSERT_EQ(2, replayReport.stateCount);
+    ASSERT_EQ(1, replayReport.snapshotCount);
+    ASSERT_EQ(11, replayReport.stepCount);
+    ASSERT_EQ(0, replayReport.rejectedStepCount);
+    ASSERT_EQ(6 + 2, replayReport.authoritativeTicks);
+    ASSERT_EQ(12, app.authoritativeVm.appSpecificState.time);
+    ASSERT_EQ(9, app.authoritativeVm.appSpecificState.x);
+    rectifyReplayClose(&replay);
+    rectifyDestroy(&replayed);
+    ASSERT_EQ(0, remove(replayPath));
+}
+
+/// Frames `stepCount` copies of `combinedStep` for rectifyAddAuthoritativeStepsRaw()
+static size_t writeAuthoritativeStepsRaw(uint8_t* target, size_t maxOctetCount, const uint8_t* combinedStep,
+                                         size_t combinedStepOctetCount, size_t stepCount)
+{
+    size_t pos = 0;
+    for (size_t i = 0; i < stepCount; ++i) {
+        int written = rectifyWriteAuthoritativeStepsRawStep(target + pos, maxOctetCount - pos, combinedStep,
+                                                            combinedStepOctetCount);
+        if (written < 0) {
+            return 0;
+        }
+        pos += (size_t) written;
+    }
+    return pos;
+}
+
+UTEST(Rectify, authoritativeStepsRaw)
+{
+    TestApp app;
+    testAppInit(&app);
+    StepId initialStepId = {40};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+
+    NimbleStepsOutSerializeLocalParticipants participants;
+    participants.participants[0].participantId = 1;
+    participants.participants[0].payload = (const uint8_t*) &app.gameInput;
+    participants.participants[0].payloadCount = sizeof(app.gameInput);
+    participants.participantCount = 1;
+    uint8_t combinedStep[64];
+    int combinedStepOctetCount = nbsStepsOutSerializeCombinedStep(&participants, combinedStep, sizeof(combinedStep));
+    ASSERT_TRUE(combinedStepOctetCount > 0);
+
+    uint8_t buffer[512];
+    size_t octetCount = writeAuthoritativeStepsRaw(buffer, sizeof(buffer), combinedStep,
+                                                   (size_t) combinedStepOctetCount, 3);
+    ASSERT_EQ((size_t) (RECTIFY_AUTHORITATIVE_STEPS_RAW_LENGTH_OCTET_SIZE + combinedStepOctetCount) * 3, octetCount);
+    ASSERT_EQ(0, buffer[0]);
+    ASSERT_EQ(combinedStepOctetCount, buffer[1]);
+    ASSERT_EQ(3, rectifyAddAuthoritativeStepsRaw(rectify, buffer, octetCount, initialStepId, 3));
+
+    // The redundant steps that were already received are skipped
+    ASSERT_EQ(1, rectifyAddAuthoritativeStepsRaw(rectify, buffer, octetCount, initialStepId + 1, 3));
+    ASSERT_EQ(2, rectifyStats(rectify)->duplicateAuthoritativeSteps);
+    ASSERT_EQ(0, rectifyAddAuthoritativeStepsRaw(rectify, buffer, octetCount, initialStepId + 1, 3));
+    ASSERT_EQ(5, rectifyStats(rectify)->duplicateAuthoritativeSteps);
+
+    // A gap or a malformed buffer adds nothing, not even the steps that would have been valid
+    ASSERT_EQ(-4, rectifyAddAuthoritativeStepsRaw(rectify, buffer, octetCount, initialStepId + 5, 3));
+    ASSERT_EQ(3, rectifyStats(rectify)->rejectedAuthoritativeSteps);
+    ASSERT_EQ(-2, rectifyAddAuthoritativeStepsRaw(rectify, buffer, octetCount - 1, initialStepId + 4, 3));
+    ASSERT_EQ(-1, rectifyAddAuthoritativeStepsRaw(rectify, buffer, octetCount, initialStepId + 4, 4));
+    ASSERT_EQ(-3, rectifyAddAuthoritativeStepsRaw(rectify, buffer, octetCount, initialStepId + 4, 2));
+    ASSERT_EQ(-1, rectifyWriteAuthoritativeStepsRawStep(buffer, sizeof(buffer), combinedStep, 70000));
+    ASSERT_EQ(-2, rectifyWriteAuthoritativeStepsRawStep(buffer, 2, combinedStep, 1));
+
+    rectifyUpdate(rectify);
+    ASSERT_EQ(4, rectifyStats(rectify)->authoritativeTicks);
+    ASSERT_EQ(4, app.authoritativeVm.appSpecificState.time);
+
+    // If Assent rejects a step, the steps before it are kept and counted, and the steps after it are not added
+    static uint8_t tooLargeStep[1200];
+    size_t pos = writeAuthoritativeStepsRaw(buffer, sizeof(buffer), combinedStep, (size_t) combinedStepOctetCount, 1);
+    static uint8_t partialBuffer[1400];
+    memcpy(partialBuffer, buffer, pos);
+    pos += (size_t) rectifyWriteAuthoritativeStepsRawStep(partialBuffer + pos, sizeof(partialBuffer) - pos,
+                                                          tooLargeStep, sizeof(tooLargeStep));
+    pos += writeAuthoritativeStepsRaw(partialBuffer + pos, sizeof(partialBuffer) - pos, combinedStep,
+                                      (size_t) combinedStepOctetCount, 1);
+    ASSERT_EQ(1, rectifyAddAuthoritativeStepsRaw(rectify, partialBuffer, pos, initialStepId + 4, 3));
+    ASSERT_EQ(4, rectifyStats(rectify)->rejectedAuthoritativeSteps);
+    ASSERT_EQ(3, rectifyAddAuthoritativeStepsRaw(rectify, buffer, octetCount, initialStepId + 5, 3));
+
+    rectifyUpdate(rectify);
+    ASSERT_EQ(8, rectifyStats(rectify)->authoritativeTicks);
+}
+
+UTEST(Rectify, maxActivePlayerCountIsHardLimit)
+{
+    TestApp app;
+    testAppInit(&app);
+    app.setup.maxActivePlayerCount = 1;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+    const RectifyStats* stats = rectifyStats(rectify);
+    TestRemoteInput remote;
+    testRemoteInputInit(&remote, &app, 2, 3);
+
+    CLOG_INFO("a step with more participants than maxActivePlayerCount is rejected, not truncated")
+    ASSERT_EQ(RECTIFY_ERROR_TOO_MANY_PARTICIPANTS, rectifyAddAuthoritativeStep(rectify, &remote.input, initialStepId));
+    ASSERT_EQ(1, stats->rejectedAuthoritativeSteps);
+    ASSERT_TRUE(rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId) >= 0);
+
+    NimbleStepsOutSerializeLocalParticipants participants;
+    for (size_t i = 0; i < 2; ++i) {
+        participants.participants[i].participantId = (uint8_t) (i + 1);
+        participants.participants[i].payload = (const uint8_t*) &app.gameInput;
+        participants.participants[i].payloadCount = sizeof(app.gameInput);
+    }
+    participants.participantCount = 2;
+    uint8_t combinedStep[64];
+    int combinedStepOctetCount = nbsStepsOutSerializeCombinedStep(&participants, combinedStep, sizeof(combinedStep));
+    ASSERT_TRUE(combinedStepOctetCount > 0);
+    int rawResult = rectifyAddAuthoritativeStepRaw(rectify, combinedStep, (size_t) combinedStepOctetCount,
+                                                   initialStepId + 1);
+    ASSERT_EQ(RECTIFY_ERROR_TOO_MANY_PARTICIPANTS, rawResult);
+    ASSERT_EQ(2, stats->rejectedAuthoritativeSteps);
+
+    CLOG_INFO("the steps before the first step with too many participants are added")
+    participants.participantCount = 1;
+    uint8_t singleStep[64];
+    int singleStepOctetCount = nbsStepsOutSerializeCombinedStep(&participants, singleStep, sizeof(singleStep));
+    ASSERT_TRUE(singleStepOctetCount > 0);
+    uint8_t buffer[256];
+    size_t pos = writeAuthoritativeStepsRaw(buffer, sizeof(buffer), singleStep, (size_t) singleStepOctetCount, 1);
+    pos += writeAuthoritativeStepsRaw(buffer + pos, sizeof(buffer) - pos, combinedStep,
+                                      (size_t) combinedStepOctetCount, 1);
+    ASSERT_EQ(1, rectifyAddAuthoritativeStepsRaw(rectify, buffer, pos, initialStepId + 1, 2));
+    ASSERT_EQ(3, stats->rejectedAuthoritativeSteps);
+
+    rectifyUpdate(rectify);
+    ASSERT_EQ(2, stats->authoritativeTicks);
+}
+
+UTEST(Rectify, asyncPredictionPresentation)
+{
+    TestApp app;
+    testAppInit(&app);
+    app.setup.useAsyncPrediction = true;
+    app.setup.maxPresentationStateOctetSize = sizeof(AppSpecificState);
+    StepId initialStepId = {60};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+    ASSERT_TRUE(rectifyPresentationState(rectify) == 0);
+
+    StepId lastPresentedStepId = 0;
+    size_t presentationReadCount = 0;
+    for (StepId i = 0; i < 40; ++i) {
+        app.gameInput.horizontalAxis = 1;
+        ASSERT_EQ(0, rectifyAddPredictedStep(rectify, &app.input, initialStepId + i));
+        if (i >= 3) {
+            // Every seventh authoritative step was mispredicted, which starts a re-simulation
+            app.gameInput.horizontalAxis = (i % 7) == 0 ? 2 : 1;
+            ASSERT_TRUE(rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + i - 3) >= 0);
+        }
+        rectifyUpdate(rectify);
+
+        // The prediction might still run on the worker. Every state read meanwhile must be a complete prediction,
+        // where the step matches the number of ticks, and must never be older than the one read before.
+        do {
+            const RectifyPresentationState* presentation = rectifyPresentationState(rectify);
+            if (presentation == 0) {
+                continue;
+            }
+            const AppSpecificState* presented = (const AppSpecificState*) presentation->state.state;
+            ASSERT_EQ(sizeof(AppSpecificState), presentation->state.octetSize);
+            ASSERT_EQ(initialStepId + (StepId) presented->time, presentation->stepId);
+            ASSERT_TRUE(presentation->stepId >= lastPresentedStepId);
+            lastPresentedStepId = presentation->stepId;
+            presentationReadCount++;
+        } while (rectifyPredictionIsBusy(rectify));
+
+        // After the fence, the presentation is the state that the prediction ended with
+        rectifyPredictionFence(rectify);
+        ASSERT_FALSE(rectifyPredictionIsBusy(rectify));
+        const RectifyPresentationState* presentation = rectifyPresentationState(rectify);
+        if (i < 3) {
+            // Nothing can be predicted before the first authoritative state
+            ASSERT_TRUE(presentation == 0);
+            continue;
+        }
+        ASSERT_TRUE(presentation != 0);
+        ASSERT_EQ(app.predictedVm.appSpecificState.time, ((const AppSpecificState*) presentation->state.state)->time);
+        ASSERT_EQ(app.predictedVm.appSpecificState.x, ((const AppSpecificState*) presentation->state.state)->x);
+        ASSERT_TRUE(presentation->stepId >= lastPresentedStepId);
+        lastPresentedStepId = presentation->stepId;
+    }
+
+    ASSERT_TRUE(presentationReadCount > 0);
+    ASSERT_TRUE(rectifyStats(rectify)->predictionResets > 1);
+    rectifyDestroy(rectify);
+}
+
+/// Takes at least two milliseconds, so the measured update time is known to be more than zero
+static void testSlowAuthoritativeTick(void* _self, const TransmuteInput* input, StepId stepId)
+{
+    MonotonicTimeMs startedAt = monotonicTimeMsNow();
+    while (monotonicTimeMsNow() - startedAt < 2) {
+    }
+    rectifyAuthoritativeTick(_self, input, stepId);
+}
+
+UTEST(Rectify, workerPoolUpdatesEachInstanceOnce)
+{
+    static TestApp apps[8];
+    Rectify* instances[8];
+    StepId initialStepId = {20};
+    for (size_t i = 0; i < 8; ++i) {
+        testAppInit(&apps[i]);
+        // One authoritative tick per update, so an instance that is updated twice is one tick ahead
+        apps[i].setup.catchUp.maxTicksPerUpdate = 1;
+        if (i == 5) {
+            apps[i].vtbl.authoritativeTickFn = testSlowAuthoritativeTick;
+        }
+        instances[i] = testAppStart(&apps[i], initialStepId);
+        for (StepId stepId = 0; stepId < 4; ++stepId) {
+            ASSERT_TRUE(rectifyAddAuthoritativeStep(instances[i], &apps[i].input, initialStepId + stepId) >= 0);
+        }
+    }
+
+    RectifyWorkerPool pool;
+    ASSERT_EQ(0, rectifyWorkerPoolInit(&pool, &apps[0].imprint.slabAllocator.info.allocator, 3, 8));
+    ASSERT_EQ(-1, rectifyUpdateMany(instances, 9, &pool));
+
+    for (int update = 1; update <= 3; ++update) {
+        ASSERT_EQ(0, rectifyUpdateMany(instances, 8, &pool));
+        ASSERT_TRUE(pool.stolenCount <= 8);
+        for (size_t i = 0; i < 8; ++i) {
+            const RectifyUpdateResult* result = rectifyWorkerPoolResult(&pool, i);
+            ASSERT_TRUE(result->isDone);
+            ASSERT_TRUE(result->workerIndex <= pool.threadCount);
+            ASSERT_EQ(update, apps[i].authoritativeVm.appSpecificState.time);
+            ASSERT_TRUE(result->elapsedMicroseconds <= pool.elapsedMicroseconds);
+        }
+        // The slow instance ticks once in every update
+        ASSERT_TRUE(rectifyWorkerPoolResult(&pool, 5)->elapsedMicroseconds >= 1000);
+    }
+
+    // Fewer instances than workers leaves some deques empty
+    ASSERT_EQ(0, rectifyUpdateMany(instances, 2, &pool));
+    ASSERT_EQ(4, apps[0].authoritativeVm.appSpecificState.time);
+    ASSERT_EQ(4, apps[1].authoritativeVm.appSpecificState.time);
+    ASSERT_EQ(3, apps[2].authoritativeVm.appSpecificState.time);
+    ASSERT_TRUE(rectifyWorkerPoolResult(&pool, 2) == 0);
+
+    rectifyWorkerPoolDestroy(&pool);
+    for (size_t i = 0; i < 8; ++i) {
+        rectifyDestroy(instances[i]);
+    }
+}
+
+UTEST(Rectify, desyncCheckpoints)
+{
+    TestApp app;
+    testAppInit(&app);
+    app.setup.traceEventCapacity = 64;
+    app.setup.desync.checkpointInterval = 4;
+    app.setup.desync.maxCheckpointCount = 8;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+
+    // The server state after the tick of 104 and 108, sent before the steps have been ticked locally
+    AppSpecificState serverState = {.x = 4, .time = 4};
+    ASSERT_EQ(0, rectifyAddAuthoritativeHash(rectify, 104,
+                                             rectifyStateHash((const uint8_t*) &serverState, sizeof(serverState))));
+    serverState.x = 8;
+    serverState.time = 8;
+    ASSERT_EQ(0, rectifyAddAuthoritativeHash(rectify, 108,
+                                             rectifyStateHash((const uint8_t*) &serverState, sizeof(serverState))));
+    ASSERT_EQ(-2, rectifyAddAuthoritativeHash(rectify, 109, 0));
+
+    for (StepId i = 0; i < 12; ++i) {
+        rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + i);
+    }
+    rectifyUpdate(rectify);
+
+    const RectifyDesyncReport* report = rectifyDesyncReport(rectify);
+    ASSERT_TRUE(report->hasVerified);
+    ASSERT_EQ(108, report->lastVerifiedStepId);
+    ASSERT_FALSE(report->hasDesynced);
+
+    // The server disagrees about 112, which has already been ticked
+    ASSERT_EQ(-1, rectifyAddAuthoritativeHash(rectify, 112, 0));
+    ASSERT_TRUE(report->hasDesynced);
+    ASSERT_EQ(112, report->firstDesyncStepId);
+    ASSERT_EQ(2, rectifyStats(rectify)->verifiedCheckpoints);
+    ASSERT_EQ(1, rectifyStats(rectify)->desyncedCheckpoints);
+}
+
+UTEST(Rectify, dirtyRangeCopyMatchesFullCopy)
+{
+    TestApp app;
+    testAppInit(&app);
+    testAppUseStateArenas(&app);
+    app.setup.stateArenaOctetSize = 1;
+    StepId initialStepId = {101};
+    Rectify* rectify = testAppStart(&app, initialStepId);
+    const size_t page = rectifyAuthoritativeStateArena(rectify)->pageOctetSize;
+    rectifyDestroy(rectify);
+    app.setup.stateArenaOctetSize = page * 4;
+    rectify = testAppStart(&app, initialStepId);
+    const RectifyStats* stats = rectifyStats(rectify);
+    RectifyStateArena* authoritative = rectifyAuthoritativeStateArena(rectify);
+    RectifyStateArena* predicted = rectifyPredictedStateArena(rectify);
+
+    CLOG_INFO("nothing is known about the arenas yet, so the first copy is a full copy")
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(1, stats->predictionResets);
+    ASSERT_EQ(0, stats->predictionDirtyRangeResets);
+    ASSERT_EQ(0, memcmp(predicted->octets, authoritative->octets, authoritative->octetSize));
+
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 1);
+    rectifyAddPredictedStep(rectify, &app.input, initialStepId + 2);
+    rectifyUpdate(rectify);
+    authoritative->octets[page * 2 + 3] = 0x42;
+    predicted->octets[page * 3] = 0x17;
+
+    CLOG_INFO("a misprediction copies the pages written on either side, and ends up identical to a full copy")
+    app.gameInput.horizontalAxis = 2;
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + 1);
+    rectifyAddAuthoritativeStep(rectify, &app.input, initialStepId + 2);
+    rectifyUpdate(rectify);
+    ASSERT_EQ(2, stats->predictionResets);
+    ASSERT_EQ(1, stats->predictionDirtyRangeResets);
+    // Without memory protection every page is reported as written
+    ASSERT_EQ(authoritative->isWriteTracked ? page * 3 : page * 4, stats->predictionDirtyRangeOctets);
+    ASSERT_EQ(0, memcmp(predicted->octets, authoritative->octets, authoritative->octetSize));
+    ASSERT_EQ(0x42, predicted->octets[page * 2 + 3]);
+    ASSERT_EQ(0, predicted->octets[page * 3]);
+
+    predicted->octets[page + 7] = 0x55;
+
+    CLOG_INFO("a snapshot replaces the authoritative state without ticking it, so the full state is copied")
+    AppSpecificState snapshotAppState = {.x = 50, .time = 9};
+    TransmuteState snapshotState = {.state = &snapshotAppState, .octetSize = sizeof(snapshotAppState)};
+    ASSERT_EQ(0, rectifySetAuthoritativeSnapshot(rectify, snapshotState, initialStepId + 10));
+    rectifyUpdate(rectify);
+    ASSERT_EQ(3, stats->predictionResets);
+    ASSERT_EQ(1, stats->predictionDirtyRangeResets);
+    ASSERT_EQ(0, memcmp(predicted->octets, authoritative->octets, authoritative->octetSize));
+    ASSERT_EQ(50, ((const AppSpecificState*) predicted->octets)->x);
+
+    predicted->octets[page + 7] = 0x55;
+
+    CLOG_INFO("a reset also copies the full state")
+    snapshotAppState.x = 60;
+    rectifyReset(rectify, snapshotState, initialStepId + 20);
+    // The stats are cleared by the reset
+    ASSERT_EQ(0, stats->predictionDirtyRangeResets);
+    ASSERT_EQ(0, memcmp(predicted->octets, authoritative->octets, authoritative->octetSize));
+    ASSERT_EQ(60, ((const AppSpecificState*) predicted->octets)->x);
+    rectifyDestroy(rectify);
+}
+
+/// Writes a single participant input with `octetCount` payload octets, all set to `value`
+static int writeHistoryStep(RectifyInputHistory* history, size_t octetCount, uint8_t value, StepId stepId)
+{
+    uint8_t payload[128];
+    memset(payload, value, octetCount);
+    TransmuteParticipantInput participantInput = {.participantId = 1,
+                                                  .inputType = TransmuteParticipantInputTypeNormal,
+                                                  .input = payload,
+                                                  .octetSize = octetCount};
+    TransmuteInput input = {.participantInputs = &participantInput, .participantCount = 1};
+    return rectifyInputHistoryWrite(history, &input, stepId);
+}
+
+static uint8_t historyStepValue(RectifyInputHistory* history, StepId stepId)
+{
+    const RectifyInputHistoryEntry* entry = rectifyInputHistoryFind(history, stepId);
+    return entry == 0 ? 0 : ((const uint8_t*) entry->input.participantInputs[0].input)[0];
+}
+
+UTEST(Rectify, inputHistoryCompactRing)
+{
+    ImprintDefaultSetup imprint;
+    imprintDefaultSetupInit(&imprint, 16 * 1024 * 1024);
+    ImprintAllocator* allocator = &imprint.slabAllocator.info.allocator;
+
+    // A small step takes one unit of the ring, a large step takes two
+    const size_t unit = (sizeof(TransmuteParticipantInput) + 8 + 7) & ~(size_t) 7;
+    const size_t smallOctetCount = unit - sizeof(TransmuteParticipantInput);
+    const size_t largeOctetCount = smallOctetCount + unit;
+    RectifyInputHistory history;
+    rectifyInputHistoryInit(&history, allocator, 16, 2, 128, unit * 5, false);
+
+    CLOG_INFO("the inputs are copied into the ring and read back as they were written")
+    uint8_t payload[4] = {1, 2, 3, 4};
+    TransmuteParticipantInput participantInputs[2] = {
+        {.participantId = 3, .localPartyId = 1, .inputType = TransmuteParticipantInputTypeNormal, .input = payload,
+         .octetSize = sizeof(payload)},
+        {.participantId = 7, .inputType = TransmuteParticipantInputTypeNoInputInTime, .input = 0, .octetSize = 0},
+    };
+    TransmuteInput input = {.participantInputs = participantInputs, .participantCount = 2};
+    ASSERT_EQ(0, rectifyInputHistoryWrite(&history, &input, 9));
+    payload[0] = 42;
+    const RectifyInputHistoryEntry* entry = rectifyInputHistoryFind(&history, 9);
+    ASSERT_TRUE(entry != 0);
+    ASSERT_EQ(2, entry->input.participantCount);
+    ASSERT_EQ(1, ((const uint8_t*) entry->input.participantInputs[0].input)[0]);
+    ASSERT_EQ(4, ((const uint8_t*) entry->input.participantInputs[0].input)[3]);
+    ASSERT_EQ(7, entry->input.participantInputs[1].participantId);
+    ASSERT_TRUE(entry->input.participantInputs[1].input == 0);
+    payload[0] = 1;
+    ASSERT_TRUE(rectifyInputIsEqual(&input, &entry->input));
+    rectifyInputHistoryReInit(&history);
+    ASSERT_FALSE(rectifyInputHistoryHas(&history, 9));
+
+    CLOG_INFO("the oldest steps are evicted when the write position reaches them")
+    for (StepId stepId = 10; stepId < 15; ++stepId) {
+        ASSERT_EQ(0, writeHistoryStep(&history, smallOctetCount, (uint8_t) stepId, stepId));
+    }
+    ASSERT_EQ(0, history.evictedCount);
+    ASSERT_EQ(0, writeHistoryStep(&history, largeOctetCount, 15, 15));
+    ASSERT_EQ(0, writeHistoryStep(&history, largeOctetCount, 16, 16));
+    ASSERT_FALSE(rectifyInputHistoryHas(&history, 13));
+    ASSERT_EQ(4, history.evictedCount);
+
+    CLOG_INFO("a step that is skipped when the ring wraps is kept until the write position reaches it")
+    ASSERT_EQ(0, writeHistoryStep(&history, largeOctetCount, 17, 17));
+    ASSERT_EQ(14, historyStepValue(&history, 14));
+    ASSERT_EQ(5, history.evictedCount);
+    ASSERT_EQ(0, writeHistoryStep(&history, smallOctetCount, 18, 18));
+    ASSERT_EQ(0, writeHistoryStep(&history, smallOctetCount, 19, 19));
+    ASSERT_EQ(14, historyStepValue(&history, 14));
+    ASSERT_EQ(0, writeHistoryStep(&history, smallOctetCount, 20, 20));
+    ASSERT_FALSE(rectifyInputHistoryHas(&history, 14));
+    ASSERT_EQ(7, history.evictedCount);
+    for (StepId stepId = 17; stepId <= 20; ++stepId) {
+        ASSERT_EQ(stepId, historyStepValue(&history, stepId));
+    }
+
+    CLOG_INFO("a step that is written again leaves a stale region behind, which does not evict the new write")
+    for (size_t i = 0; i < 40; ++i) {
+        ASSERT_EQ(0, writeHistoryStep(&history, smallOctetCount, (uint8_t) (100 + i), 20));
+        ASSERT_EQ(100 + i, historyStepValue(&history, 20));
+    }
+    ASSERT_TRUE(history.ringRegionCount <= history.ringRegionCapacity);
+}
+
+static const RectifyEncodedParticipantInput* historyEncodedInputs(const RectifyInputHistory* history, StepId stepId)
+{
+    const RectifyInputHistoryEntry* entry = &history->entries[stepId % history->capacity];
+    return (const RectifyEncodedParticipantInput*) (history->ring + entry->ringOffset);
+}
+
+UTEST(Rectify, inputHistoryDeltaEncoding)
+{
+    ImprintDefaultSetup imprint;
+    imprintDefaultSetupInit(&imprint, 16 * 1024 * 1024);
+    ImprintAllocator* allocator = &imprint.slabAllocator.info.allocator;
+
+    RectifyInputHistory history;
+    rectifyInputHistoryInit(&history, allocator, 64, 3, 8, 4096, true);
+    ASSERT_TRUE(history.useDeltaEncoding);
+
+    uint8_t first[8] = {1, 2, 3, 4, 5, 6, 7, 8};
+    uint8_t third[8] = {9, 10, 11, 12, 13, 14, 15, 16};
+    TransmuteParticipantInput participantInputs[3] = {
+        {.participantId = 1, .inputType = TransmuteParticipantInputTypeNormal, .input = first, .octetSize = 8},
+        {.participantId = 2, .inputType = TransmuteParticipantInputTypeNoInputInTime, .input = 0, .octetSize = 0},
+        {.participantId = 3, .inputType = TransmuteParticipantInputTypeNormal, .input = third, .octetSize = 8},
+    };
+    TransmuteInput input = {.participantInputs = participantInputs, .participantCount = 3};
+
+    CLOG_INFO("the first step is a key step, with the full payloads")
+    StepId keyStepId = 40;
+    ASSERT_EQ(0, rectifyInputHistoryWrite(&history, &input, keyStepId));
+    ASSERT_TRUE(history.entries[keyStepId % history.capacity].isKey);
+    const RectifyEncodedParticipantInput* encoded = historyEncodedInputs(&history, keyStepId);
+    ASSERT_EQ(RectifyInputEncodingFull, encoded[0].encoding);
+    ASSERT_EQ(RectifyInputEncodingNoPayload, encoded[1].encoding);
+    ASSERT_EQ(RectifyInputEncodingFull, encoded[2].encoding);
+
+    CLOG_INFO("unchanged payloads are stored as the same, a changed octet as a xor span against the key step")
+    third[5] = 0x55;
+    ASSERT_EQ(0, rectifyInputHistoryWrite(&history, &input, keyStepId + 1));
+    ASSERT_FALSE(history.entries[(keyStepId + 1) % history.capacity].isKey);
+    encoded = historyEncodedInputs(&history, keyStepId + 1);
+    ASSERT_EQ(RectifyInputEncodingSame, encoded[0].encoding);
+    ASSERT_EQ(RectifyInputEncodingNoPayload, encoded[1].encoding);
+    ASSERT_EQ(RectifyInputEncodingXor, encoded[2].encoding);
+    ASSERT_EQ(5, encoded[2].deltaOffset);
+    ASSERT_EQ(1, encoded[2].deltaOctetCount);
+
+    const RectifyInputHistoryEntry* entry = rectifyInputHistoryFind(&history, keyStepId + 1);
+    ASSERT_TRUE(entry != 0);
+    ASSERT_TRUE(rectifyInputIsEqual(&input, &entry->input));
+    ASSERT_TRUE(entry->input.participantInputs[1].input == 0);
+    third[5] = 14;
+    entry = rectifyInputHistoryFind(&history, keyStepId);
+    ASSERT_TRUE(rectifyInputIsEqual(&input, &entry->input));
+
+    CLOG_INFO("a payload that differs in most octets makes a new key step")
+    for (size_t i = 0; i < 8; ++i) {
+        first[i] = (uint8_t) (first[i] + 100);
+        third[i] = (uint8_t) (third[i] + 100);
+    }
+    ASSERT_EQ(0, rectifyInputHistoryWrite(&history, &input, keyStepId + 2));
+    ASSERT_TRUE(history.entries[(keyStepId + 2) % history.capacity].isKey);
+
+    CLOG_INFO("the key rolls over after the key interval, and the older steps still decode against their own key")
+    StepId rolloverStepId = keyStepId + 2 + RECTIFY_INPUT_HISTORY_KEY_INTERVAL;
+    for (StepId stepId = keyStepId + 3; stepId <= rolloverStepId; ++stepId) {
+        first[0] = (uint8_t) stepId;
+        ASSERT_EQ(0, rectifyInputHistoryWrite(&history, &input, stepId));
+        ASSERT_EQ(stepId == rolloverStepId, history.entries[stepId % history.capacity].isKey);
+    }
+    first[0] = (uint8_t) (rolloverStepId - 1);
+    entry = rectifyInputHistoryFind(&history, rolloverStepId - 1);
+    ASSERT_TRUE(rectifyInputIsEqual(&input, &entry->input));
+    ASSERT_EQ(RectifyInputEncodingXor, historyEncodedInputs(&history, rolloverStepId - 1)[0].encoding);
+    ASSERT_EQ(RectifyInputEncodingSame, historyEncodedInputs(&history, rolloverStepId - 1)[2].encoding);
+}
+
+UTEST(Rectify, stateArenaWriteTracking)
+{
+    ImprintDefaultSetup imprint;
+    imprintDefaultSetupInit(&imprint, 16 * 1024 * 1024);
+    ImprintAllocator* allocator = &imprint.slabAllocator.info.allocator;
+
+    RectifyStateArena authoritative;
+    rectifyStateArenaInit(&authoritative, allocator, 1);
+    const size_t page = authoritative.pageOctetSize;
+    ASSERT_EQ(page, authoritative.octetSize);
+    rectifyStateArenaDestroy(&authoritative);
+
+    rectifyStateArenaInit(&authoritative, allocator, page * 4 - 10);
+    ASSERT_EQ(page * 4, authoritative.octetSize);
+    RectifyStateArena predicted;
+    rectifyStateArenaInit(&predicted, allocator, page * 4 - 10);
+
+    // Nothing is known about a new arena, so all of it is reported
+    RectifyDirtyRange ranges[4];
+    ASSERT_EQ(1, rectifyStateArenaDirtyRanges(&authoritative, ranges, 4));
+    ASSERT_EQ(0, ranges[0].offset);
+    ASSERT_EQ(page * 4, ranges[0].octetCount);
+    rectifyStateArenaCopy(&predicted, authoritative.octets);
+    rectifyStateArenaForgetChanges(&predicted);
+
+    if (!authoritative.isWriteTracked) {
+        CLOG_INFO("without memory protection every page is always reported as written")
+        ASSERT_EQ(1, rectifyStateArenaDirtyRanges(&authoritative, ranges, 4));
+        ASSERT_EQ(page * 4, ranges[0].octetCount);
+        rectifyStateArenaDestroy(&authoritative);
+        rectifyStateArenaDestroy(&predicted);
+        return;
+    }
+    ASSERT_EQ(0, rectifyStateArenaDirtyRanges(&authoritative, ranges, 4));
+
+    CLOG_INFO("plain writes are caught by the fault handler, only their pages are dirty")
+    uint32_t value = 0x12345678;
+    memcpy(authoritative.octets + page * 2 + 1, &value, sizeof(value));
+    authoritative.octets[5] = 0x42;
+    authoritative.octets[6] = 0x43;
+    int rangeCount = rectifyStateArenaDirtyRanges(&authoritative, ranges, 4);
+    ASSERT_EQ(2, rangeCount);
+    ASSERT_EQ(0, ranges[0].offset);
+    ASSERT_EQ(page, ranges[0].octetCount);
+    ASSERT_EQ(page * 2, ranges[1].offset);
+    ASSERT_EQ(page, ranges[1].octetCount);
+
+    CLOG_INFO("copying the dirty pages makes the arenas equal")
+    rectifyStateArenaCopyRanges(&predicted, ranges, (size_t) rangeCount, authoritative.octets);
+    ASSERT_EQ(0, memcmp(predicted.octets, authoritative.octets, authoritative.octetSize));
+    rectifyStateArenaForgetChanges(&predicted);
+    ASSERT_EQ(0, rectifyStateArenaDirtyRanges(&predicted, ranges, 4));
+
+    CLOG_INFO("the reported pages are protected again, so the next window only has the pages written after it")
+    predicted.octets[page + 8] = 0x11;
+    ASSERT_EQ(1, rectifyStateArenaDirtyRanges(&predicted, ranges, 4));
+    ASSERT_EQ(page, ranges[0].offset);
+    ASSERT_EQ(page, ranges[0].octetCount);
+    ASSERT_EQ(0, rectifyStateArenaDirtyRanges(&predicted, ranges, 4));
+    predicted.octets[page + 9] = 0x12;
+    predicted.octets[page * 3] = 0x13;
+    ASSERT_EQ(2, rectifyStateArenaDirtyRanges(&predicted, ranges, 4));
+    ASSERT_EQ(page, ranges[0].offset);
+    ASSERT_EQ(page * 3, ranges[1].offset);
+
+    CLOG_INFO("a full copy reports every page, without faulting on each of them")
+    rectifyStateArenaCopy(&predicted, authoritative.octets);
+    ASSERT_EQ(1, rectifyStateArenaDirtyRanges(&predicted, ranges, 4));
+    ASSERT_EQ(page * 4, ranges[0].octetCount);
+    ASSERT_EQ(0, memcmp(predicted.octets, authoritative.octets, authoritative.octetSize));
+
+    rectifyStateArenaDestroy(&authoritative);
+    rectifyStateArenaDestroy(&predicted);
+}